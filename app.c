@@ -1,8 +1,15 @@
 #include <stdio.h>      // Standard I/O functions
-#include <stdlib.h>     // Standard library functions (e.g., malloc, free)
+#include <stdlib.h>     // Standard library functions (e.g., atoi, strtoull)
 #include <string.h>     // String manipulation functions
 #include <fcntl.h>      // File control options for open()
 #include <unistd.h>     // UNIX standard functions
+#include <errno.h>      // errno values (EINTR retries when writing)
+#include <stdint.h>     // Fixed width integers for offsets
+#include <sys/stat.h>   // File permission constants
+
+#include "huffman.h"    // Compression library
+#include "batch.h"      // Batch mode (many files at once)
+#include "server.h"     // Server mode, its client and load generator
 
 // Define file permission constants for Windows compatibility
 #ifdef _WIN32
@@ -14,599 +21,782 @@
     #define O_BINARY 0  // O_BINARY is not needed on non-Windows systems
 #endif
 
-// Define constants
-#define MAX 100         // Maximum size for arrays (used for binary code representation)
-#define isLeaf(node) ((node->l == NULL) && (node->r == NULL))  // Macro to check if a node is a leaf node
-#define isroot(node) ((node->f == NULL) && (node->r == NULL) && (node->g != '\0'))  // Macro to check if a node is a root node
-
-// Structure for Huffman Tree nodes used during compression
-struct Node {
-    char character;     // Character stored in this node
-    int freq;           // Frequency of the character
-    struct Node *l, *r; // Left and right child pointers
-};
-
-// Structure for Min Heap (Priority Queue)
-struct Min_Heap {
-    int size;           // Current size of the heap
-    int capacity;       // Maximum capacity of the heap
-    struct Node **array; // Array of node pointers
-};
-
-// Structure to store character codes in compressed file
-typedef struct code {
-    char k;             // Character
-    int l;              // Length of the code
-    int code_arr[16];   // Array to store binary code (max 16 bits)
-    struct code* p;     // Pointer to next code (for linked list)
-} code;
-
-// Structure for rebuilding Huffman tree during decompression
-typedef struct Tree {
-    char g;             // Character stored in this node
-    int len;            // Length of code for this character
-    int dec;            // Decimal representation of the code
-    struct Tree* f;     // Left child (represents 0 in code)
-    struct Tree* r;     // Right child (represents 1 in code)
-} Tree;
-
-// Global variables
-code* data;             // Pointer to current code being processed
-code* front = NULL;     // Front of the linked list of codes
-code* rear = NULL;      // Rear of the linked list of codes
-int k = 0;              // Counter for code linked list initialization
-Tree* tree = NULL;      // Root of the Huffman tree during decompression
-Tree* tree_temp = NULL; // Temporary tree pointer for traversal
-Tree* t = NULL;         // Temporary tree node pointer
-
-// Function to create a new Huffman Tree node
-struct Node* newNode(char character, int freq) {
-    // Allocate memory for the new node
-    struct Node* temp = (struct Node*)malloc(sizeof(struct Node));
-    // Initialize left and right children as NULL
-    temp->l = temp->r = NULL;
-    // Set character and frequency values
-    temp->character = character;
-    temp->freq = freq;
-    return temp;
-}
+// Function to open an input file, "-" meaning standard input
+int openInputFile(const char* inputFile) {
+    if (strcmp(inputFile, "-") == 0)
+        return STDIN_FILENO;
 
-// Function to create a min heap with given capacity
-struct Min_Heap* createMinHeap(int capacity) {
-    // Allocate memory for the min heap structure
-    struct Min_Heap* minHeap = (struct Min_Heap*)malloc(sizeof(struct Min_Heap));
-    // Initialize size to 0
-    minHeap->size = 0;
-    // Set the capacity
-    minHeap->capacity = capacity;
-    // Allocate memory for the array of node pointers
-    minHeap->array = (struct Node**)malloc(minHeap->capacity * sizeof(struct Node*));
-    return minHeap;
-}
+    // Open input file in read-only mode (binary mode for Windows)
+    #ifdef _WIN32
+        int fd = open(inputFile, O_RDONLY | O_BINARY);
+    #else
+        int fd = open(inputFile, O_RDONLY);
+    #endif
 
-// Function to swap two min heap nodes (needed for heap operations)
-void swapMinHeapNode(struct Node** a, struct Node** b) {
-    struct Node* t = *a;
-    *a = *b;
-    *b = t;
+    if (fd == -1) {
+        perror("Open Failed For Input File");
+        exit(1);
+    }
+    return fd;
 }
 
-// Standard min heapify function to maintain min heap property
-void Heapify(struct Min_Heap* minHeap, int idx) {
-    // Initialize smallest as the current index
-    int smallest = idx;
-    // Calculate indices of left and right children
-    int left = 2 * idx + 1;
-    int right = 2 * idx + 2;
-
-    // If left child exists and has smaller frequency than current smallest
-    if (left < minHeap->size && 
-        minHeap->array[left]->freq < minHeap->array[smallest]->freq)
-        smallest = left;
-
-    // If right child exists and has smaller frequency than current smallest
-    if (right < minHeap->size && 
-        minHeap->array[right]->freq < minHeap->array[smallest]->freq)
-        smallest = right;
-
-    // If smallest is not the current index, swap and recursively heapify
-    if (smallest != idx) {
-        swapMinHeapNode(&minHeap->array[smallest], &minHeap->array[idx]);
-        Heapify(minHeap, smallest);
+// Function to create an output file, "-" meaning standard output
+int openOutputFile(const char* outputFile) {
+    if (strcmp(outputFile, "-") == 0)
+        return STDOUT_FILENO;
+
+    // Create output file with write permissions
+    #ifdef _WIN32
+        int fd = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, S_IRUSR | S_IWUSR);
+    #else
+        int fd = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    #endif
+
+    if (fd == -1) {
+        perror("Open Failed For Output File");
+        exit(1);
     }
+    return fd;
 }
 
-// Function to check if size of heap is 1
-int isSizeOne(struct Min_Heap* minHeap) {
-    return (minHeap->size == 1);
+// Output callback that writes to the file descriptor passed as user
+static int writeToFd(void* user, const void* buf, size_t n) {
+    int fd = *(int*)user;
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = write(fd, (const char*)buf + done, n - done);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += (size_t)w;
+    }
+    return 0;
 }
 
-// Function to extract the minimum value node from heap
-struct Node* extractMinFromMin_Heap(struct Min_Heap* minHeap) {
-    // Store the root node (minimum frequency node)
-    struct Node* temp = minHeap->array[0];
-    // Replace root with the last node
-    minHeap->array[0] = minHeap->array[minHeap->size - 1];
-    // Decrease the size of the heap
-    --minHeap->size;
-    // Heapify the root to maintain min heap property
-    Heapify(minHeap, 0);
-    // Return the extracted node
-    return temp;
+// Set by --mem-stats: report the allocations of each codec context on standard error
+static int showMemStats = 0;
+
+// Set by --stats: 1 prints the statistics of each call as text on standard error, 2 as one JSON line
+static int showStats = 0;
+
+// Set by --dictionary: shared code table file used to compress and decompress
+static const char* dictionaryFile = NULL;
+
+// Set by --lines: search prints the line holding each match after its offset
+static int showLines = 0;
+
+// Set by --max-count=N: search stops after N matches (0 = no limit)
+static uint64_t maxMatches = 0;
+
+#define MAX_LINE_CONTEXT (64 << 10)  // Longest part of a line printed on either side of a match
+
+// Function to append the whole contents of a file ("-" for standard input) to a growing buffer
+static void appendFile(const char* name, unsigned char** buf, size_t* size, size_t* cap) {
+    int fd = openInputFile(name);
+    for (;;) {
+        if (*size == *cap) {
+            size_t grown = *cap < 65536 ? 65536 : *cap * 2;
+            unsigned char* p = (unsigned char*)realloc(*buf, grown);
+            if (p == NULL) {
+                fprintf(stderr, "Out of memory.\n");
+                exit(1);
+            }
+            *buf = p;
+            *cap = grown;
+        }
+        ssize_t n = read(fd, *buf + *size, *cap - *size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Read Failed");
+            exit(1);
+        }
+        if (n == 0)
+            break;
+        *size += (size_t)n;
+    }
+    if (fd != STDIN_FILENO)
+        close(fd);
 }
 
-// Function to insert a new node into the Min Heap
-void insertIntoMin_Heap(struct Min_Heap* minHeap, struct Node* minHeapNode) {
-    // Increase heap size
-    ++minHeap->size;
-    // Start from the last position
-    int i = minHeap->size - 1;
-    
-    // Move up the tree until finding the right position (upheap)
-    while (i && minHeapNode->freq < minHeap->array[(i - 1) / 2]->freq) {
-        minHeap->array[i] = minHeap->array[(i - 1) / 2];
-        i = (i - 1) / 2;
-    }
-    
-    // Place the new node at the found position
-    minHeap->array[i] = minHeapNode;
+// Function to load the --dictionary file, exits if it is not a valid dictionary
+static HuffDictionary* loadDictionaryFile(const char* name) {
+    unsigned char* data = NULL;
+    size_t size = 0, cap = 0;
+    HuffDictionary* dict;
+
+    appendFile(name, &data, &size, &cap);
+    int status = huffLoadDictionary(data, size, &dict);
+    free(data);
+    if (status != HUFF_OK) {
+        fprintf(stderr, "Invalid dictionary file: %s.\n", huffErrorString(status));
+        exit(1);
+    }
+    return dict;
 }
 
-// Function to build a min heap from an array of nodes
-void buildMinHeap(struct Min_Heap* minHeap) {
-    int n = minHeap->size - 1;
-    int i;
-    // Start from last non-leaf node and heapify each node
-    for (i = (n - 1) / 2; i >= 0; --i)
-        Heapify(minHeap, i);
+// Function to print allocation counters as allocations per MB processed
+static void printMemStats(const char* what, const HuffMemoryStats* ms) {
+    double mb = (double)ms->bytesProcessed / (1 << 20);
+    fprintf(stderr, "%s: %llu allocations, %.2f MB requested, %.3f allocations per MB of data",
+            what, (unsigned long long)ms->allocations, (double)ms->bytesAllocated / (1 << 20),
+            mb > 0 ? (double)ms->allocations / mb : 0.0);
+    if (ms->tablesReused > 0)
+        fprintf(stderr, ", %llu decode tables reused", (unsigned long long)ms->tablesReused);
+    fputc('\n', stderr);
 }
 
-// Function to create and build min heap from character array and frequency array
-struct Min_Heap* createAndBuildMin_Heap(char arr[], int freq[], int unique_size) {
-    // Create a min heap with capacity equal to unique character count
-    struct Min_Heap* minHeap = createMinHeap(unique_size);
-    
-    // Add all characters and their frequencies to the heap
-    for (int i = 0; i < unique_size; ++i)
-        minHeap->array[i] = newNode(arr[i], freq[i]);
-    
-    // Set the size of the heap
-    minHeap->size = unique_size;
-    
-    // Build the min heap
-    buildMinHeap(minHeap);
-    
-    return minHeap;
+// Function to print a string as a JSON string literal on standard error
+static void printJsonString(const char* s) {
+    fputc('"', stderr);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(stderr, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(stderr, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, stderr);
+    }
+    fputc('"', stderr);
 }
 
-// Function to build Huffman Tree from character and frequency arrays
-struct Node* buildHuffmanTree(char arr[], int freq[], int unique_size) {
-    struct Node *left, *right, *top;
-    
-    // Create a min heap with unique characters and their frequencies
-    struct Min_Heap* minHeap = createAndBuildMin_Heap(arr, freq, unique_size);
-
-    // Iterate until there is only one node in the heap
-    while (!isSizeOne(minHeap)) {
-        // Extract two nodes with minimum frequency
-        left = extractMinFromMin_Heap(minHeap);
-        right = extractMinFromMin_Heap(minHeap);
-        
-        // Create a new internal node with '$' as character and sum of frequencies
-        top = newNode('$', left->freq + right->freq);
-        
-        // Connect the two nodes as children of the new node
-        top->l = left;
-        top->r = right;
-        
-        // Add the new node back to the heap
-        insertIntoMin_Heap(minHeap, top);
-    }
-    
-    // The remaining node is the root of the Huffman tree
-    return extractMinFromMin_Heap(minHeap);
+// Function to print the statistics of a compress or decompress call on standard error
+static void printStats(const char* what, const char* inputFile, const char* outputFile,
+                       const HuffStats* st, int status) {
+    static const char* phases[HUFF_PHASE_COUNT] = { "histogram", "tree", "encode", "header", "decode", "checksum" };
+    int compressing = strcmp(what, "compress") == 0;
+    uint64_t raw = compressing ? st->bytesIn : st->bytesOut;
+    uint64_t packed = compressing ? st->bytesOut : st->bytesIn;
+    double ratio = raw ? (double)packed / (double)raw : 0.0;
+    double speed = st->wallSeconds > 0 ? (double)raw / st->wallSeconds / 1e6 : 0.0;
+    int p;
+
+    if (showStats == 2) {
+        // One line per call, for log pipelines
+        fprintf(stderr, "{\"op\":\"%s\",\"input\":", what);
+        printJsonString(inputFile);
+        fprintf(stderr, ",\"output\":");
+        printJsonString(outputFile);
+        fprintf(stderr, ",\"status\":");
+        printJsonString(huffErrorString(status));
+        fprintf(stderr, ",\"bytes_in\":%llu,\"bytes_out\":%llu,\"ratio\":%.6f,\"mb_per_s\":%.2f,"
+                        "\"blocks\":%llu,\"stored_blocks\":%llu,\"rle_blocks\":%llu,\"symbols\":%d,"
+                        "\"max_code_len\":%d,\"avg_code_len\":%.4f,\"wall_s\":%.6f,\"cpu_s\":%.6f,\"phases\":{",
+                (unsigned long long)st->bytesIn, (unsigned long long)st->bytesOut, ratio, speed,
+                (unsigned long long)st->blocks, (unsigned long long)st->storedBlocks,
+                (unsigned long long)st->rleBlocks, st->symbols, st->maxCodeLen, st->avgCodeLen,
+                st->wallSeconds, st->cpuSeconds);
+        for (p = 0; p < HUFF_PHASE_COUNT; p++)
+            fprintf(stderr, "%s\"%s\":{\"wall_s\":%.6f,\"cpu_s\":%.6f}", p ? "," : "", phases[p],
+                    st->phaseWall[p], st->phaseCpu[p]);
+        fprintf(stderr, "},\"allocations\":%llu,\"bytes_allocated\":%llu}\n",
+                (unsigned long long)st->memory.allocations, (unsigned long long)st->memory.bytesAllocated);
+        return;
+    }
+
+    fprintf(stderr, "%s %s: %s\n", what, inputFile, huffErrorString(status));
+    fprintf(stderr, "  %llu -> %llu bytes, ratio %.4f, %.1f MB/s\n", (unsigned long long)st->bytesIn,
+            (unsigned long long)st->bytesOut, ratio, speed);
+    fprintf(stderr, "  %llu blocks (%llu stored, %llu single byte), %d symbols, codes up to %d bits, "
+                    "%.3f bits per coded byte\n",
+            (unsigned long long)st->blocks, (unsigned long long)st->storedBlocks,
+            (unsigned long long)st->rleBlocks, st->symbols, st->maxCodeLen, st->avgCodeLen);
+    fprintf(stderr, "  %-10s %10.6f s wall %10.6f s CPU\n", "total", st->wallSeconds, st->cpuSeconds);
+    for (p = 0; p < HUFF_PHASE_COUNT; p++) {
+        if (st->phaseWall[p] > 0 || st->phaseCpu[p] > 0)
+            fprintf(stderr, "  %-10s %10.6f s wall %10.6f s CPU\n", phases[p], st->phaseWall[p], st->phaseCpu[p]);
+    }
+    fprintf(stderr, "  %llu allocations, %.2f MB requested\n", (unsigned long long)st->memory.allocations,
+            (double)st->memory.bytesAllocated / (1 << 20));
 }
 
-// Function to convert binary array to decimal
-int convertBinaryToDecimal(int arr[], int n) {
-    int decimal = 0;
-    // Convert binary representation to decimal
-    for (int i = 0; i < n; i++)
-        decimal = decimal * 2 + arr[i];
-    return decimal;
+// Function to compress a file using Huffman coding
+int compress(const char* inputFile, const char* outputFile, const HuffOptions* opts) {
+    // Open input and output ("-" selects standard input / output)
+    int fd1 = openInputFile(inputFile);
+    int fd2 = openOutputFile(outputFile);
+
+    HuffEncoder* enc = huffEncoderCreate(opts);
+    HuffDictionary* dict = dictionaryFile ? loadDictionaryFile(dictionaryFile) : NULL;
+    int status = enc ? huffEncoderSetDictionary(enc, dict) : HUFF_ERR_NOMEM;
+    if (status == HUFF_OK)
+        status = huffCompressFd(enc, fd1, fd2);
+    if (enc && showMemStats) {
+        HuffMemoryStats ms;
+        huffEncoderMemoryStats(enc, &ms);
+        printMemStats("compress", &ms);
+    }
+    if (enc && showStats) {
+        HuffStats st;
+        huffEncoderStats(enc, &st);
+        printStats("compress", inputFile, outputFile, &st, status);
+    }
+    huffEncoderFree(enc);
+    huffDictionaryFree(dict);
+    close(fd1);
+    close(fd2);
+
+    if (status == HUFF_ERR_ARGUMENT && opts->format == HUFF_FORMAT_DICTIONARY) {
+        fprintf(stderr, "Format 4 needs a dictionary; make one with train and pass it with --dictionary=FILE.\n");
+        return 1;
+    }
+    if (status == HUFF_ERR_UNSUPPORTED && opts->format == HUFF_FORMAT_DICTIONARY) {
+        fprintf(stderr, "Format 4 reads at most 64 MiB from a pipe; use a regular file or --format=3.\n");
+        return 1;
+    }
+    if (status == HUFF_ERR_UNSUPPORTED && opts->format != HUFF_FORMAT_BLOCKS) {
+        fprintf(stderr, "Formats 1 and 2 need a seekable input, and format 1 one of less than 2 GiB; use --format=3 for pipes.\n");
+        return 1;
+    }
+    if (status != HUFF_OK) {
+        fprintf(stderr, "%s.\n", huffErrorString(status));
+        return 1;
+    }
+
+    // Keep standard output clean when it carries the compressed data
+    if (strcmp(outputFile, "-") != 0)
+        printf("File compressed successfully.\n");
+    return 0;
 }
 
-// Function to convert decimal to binary representation
-void convertDecimalToBinary(int bin[], int decimal, int size) {
-    // Convert decimal to binary and store in array
-    for (int i = size - 1; i >= 0; i--) {
-        bin[i] = decimal % 2;
-        decimal = decimal / 2;
+// Function to decompress a compressed file
+int decompress(const char* inputFile, const char* outputFile, const HuffOptions* opts) {
+    // Open input and output ("-" selects standard input / output)
+    int fd1 = openInputFile(inputFile);
+    int fd2 = openOutputFile(outputFile);
+
+    HuffDecoder* dec = huffDecoderCreate(opts);
+    HuffDictionary* dict = dictionaryFile ? loadDictionaryFile(dictionaryFile) : NULL;
+    int status = dec ? huffDecoderSetDictionary(dec, dict) : HUFF_ERR_NOMEM;
+    if (status == HUFF_OK)
+        status = huffDecompressFd(dec, fd1, fd2);
+    if (dec && showMemStats) {
+        HuffMemoryStats ms;
+        huffDecoderMemoryStats(dec, &ms);
+        printMemStats("decompress", &ms);
     }
+    if (dec && showStats) {
+        HuffStats st;
+        huffDecoderStats(dec, &st);
+        printStats("decompress", inputFile, outputFile, &st, status);
+    }
+    huffDecoderFree(dec);
+    huffDictionaryFree(dict);
+    close(fd1);
+    close(fd2);
+
+    if (status == HUFF_ERR_DICTIONARY) {
+        fprintf(stderr, "The file was compressed with a dictionary; pass the same one with --dictionary=FILE.\n");
+        return 1;
+    }
+    if (status != HUFF_OK) {
+        fprintf(stderr, "%s.\n", huffErrorString(status));
+        return 1;
+    }
+
+    // Keep standard output clean when it carries the decompressed data
+    if (strcmp(outputFile, "-") != 0)
+        printf("File decompressed successfully.\n");
+    return 0;
 }
 
-// Function to generate and store Huffman codes in file
-void printCodesIntoFile(int fd2, struct Node* root, int arr[], int top) {
-    // If there is a left child, add 0 to the code and recur
-    if (root->l) {
-        arr[top] = 0;
-        printCodesIntoFile(fd2, root->l, arr, top + 1);
-    }
-
-    // If there is a right child, add 1 to the code and recur
-    if (root->r) {
-        arr[top] = 1;
-        printCodesIntoFile(fd2, root->r, arr, top + 1);
-    }
-
-    // If this is a leaf node, store the character and its code
-    if (isLeaf(root)) {
-        // Allocate memory for the code structure
-        data = (code*)malloc(sizeof(code));
-        // Allocate memory for the tree node
-        t = (Tree*)malloc(sizeof(Tree));
-        
-        // Initialize code structure
-        data->p = NULL;
-        data->k = root->character;
-        
-        // Initialize tree node
-        t->g = root->character;
-        // Write character to file
-        write(fd2, &t->g, sizeof(char));
-        
-        // Copy binary code to code structure
-        for (int i = 0; i < top; i++) {
-            data->code_arr[i] = arr[i];
-        }
-        
-        // Store code length
-        t->len = top;
-        // Write code length to file
-        write(fd2, &t->len, sizeof(int));
-        
-        // Convert binary code to decimal
-        t->dec = convertBinaryToDecimal(data->code_arr, top);
-        // Write decimal representation to file
-        write(fd2, &t->dec, sizeof(int));
-        
-        // Store code length in code structure
-        data->l = top;
-        data->p = NULL;
-        
-        // Add code to linked list
-        if (k == 0) {
-            // If first code, initialize front and rear
-            front = rear = data;
-            k++;
+// Function to decode compressed files without writing the data, checking their checksums;
+// returns 0 if every file is intact
+int test(char* files[], int count, const HuffOptions* opts) {
+    HuffDecoder* dec = huffDecoderCreate(opts);
+    HuffDictionary* dict = dictionaryFile ? loadDictionaryFile(dictionaryFile) : NULL;
+    int status = dec ? huffDecoderSetDictionary(dec, dict) : HUFF_ERR_NOMEM;
+    int failed = 0;
+
+    // One context for all files, so its threads and buffers are reused
+    for (int i = 0; i < count && status == HUFF_OK; i++) {
+        // A missing file is reported like a damaged one, and the others are still checked
+        int fd = strcmp(files[i], "-") == 0 ? STDIN_FILENO : open(files[i], O_RDONLY | O_BINARY);
+        if (fd == -1) {
+            fprintf(stderr, "%s: %s.\n", files[i], strerror(errno));
+            failed++;
+            continue;
+        }
+        uint64_t size;
+        int checked, result = huffVerifyFd(dec, fd, &size, &checked);
+        close(fd);
+        if (showStats) {
+            HuffStats st;
+            huffDecoderStats(dec, &st);
+            printStats("test", files[i], "", &st, result);
+        }
+        if (result != HUFF_OK) {
+            fprintf(stderr, "%s: %s.\n", files[i], huffErrorString(result));
+            failed++;
+        }
+        else if (checked) {
+            printf("%s: OK, %llu bytes, checksums match.\n", files[i], (unsigned long long)size);
         }
         else {
-            // Otherwise, add to end of linked list
-            rear->p = data;
-            rear = rear->p;
+            printf("%s: OK, %llu bytes, decoded (the file has no checksums).\n", files[i], (unsigned long long)size);
         }
     }
+    if (dec && showMemStats) {
+        HuffMemoryStats ms;
+        huffDecoderMemoryStats(dec, &ms);
+        printMemStats("test", &ms);
+    }
+    huffDecoderFree(dec);
+    huffDictionaryFree(dict);
+
+    if (status != HUFF_OK) {
+        fprintf(stderr, "%s.\n", huffErrorString(status));
+        return 1;
+    }
+    return failed > 0;
 }
 
-// Function to compress file using Huffman coding
-void compressFile(int fd1, int fd2, unsigned char a) {
-    char n;
-    int h = 0, i;
-    // Reset file pointer to beginning
-    lseek(fd1, 0, SEEK_SET);
-
-    // Process each character in the input file
-    while (read(fd1, &n, sizeof(char)) != 0) {
-        // Find the code for this character
-        code* current = front;
-        while (current != NULL && current->k != n) {
-            current = current->p;
-        }
-        
-        // If code exists, encode the character
-        if (current != NULL) {
-            // Process each bit in the code
-            for (i = 0; i < current->l; i++) {
-                if (h < 7) {
-                    // If we haven't filled a byte yet
-                    if (current->code_arr[i] == 1) {
-                        // For a '1' bit, increment and shift
-                        a++;
-                        a = a << 1;
-                        h++;
-                    }
-                    else if (current->code_arr[i] == 0) {
-                        // For a '0' bit, just shift
-                        a = a << 1;
-                        h++;
-                    }
-                }
-                else if (h == 7) {
-                    // If we've reached 8 bits (a full byte)
-                    if (current->code_arr[i] == 1) {
-                        // For the last bit, increment if it's '1'
-                        a++;
-                        h = 0;
-                    }
-                    else {
-                        // For the last bit, leave as '0'
-                        h = 0;
-                    }
-                    // Write the byte to the output file
-                    write(fd2, &a, sizeof(char));
-                    // Reset byte accumulator
-                    a = 0;
-                }
-            }
-        }
+// Function to write bytes [offset, offset + length) of a compressed file to standard output
+int extract(const char* inputFile, uint64_t offset, uint64_t length, const HuffOptions* opts) {
+    int fd = openInputFile(inputFile);
+    int out = STDOUT_FILENO;
+
+    HuffDecoder* dec = huffDecoderCreate(opts);
+    int status = dec ? huffExtractFd(dec, fd, offset, length, writeToFd, &out) : HUFF_ERR_NOMEM;
+    if (dec && showMemStats) {
+        HuffMemoryStats ms;
+        huffDecoderMemoryStats(dec, &ms);
+        printMemStats("extract", &ms);
     }
-    
-    // Pad the last byte with zeros if needed
-    for (i = 0; i < 7 - h; i++) {
-        a = a << 1;
+    huffDecoderFree(dec);
+    close(fd);
+
+    if (status == HUFF_ERR_UNSUPPORTED) {
+        fprintf(stderr, "Random access needs a seekable file written with --format=3.\n");
+        return 1;
     }
-    // Write the final byte
-    write(fd2, &a, sizeof(char));
+    if (status != HUFF_OK) {
+        fprintf(stderr, "%s.\n", huffErrorString(status));
+        return 1;
+    }
+    return 0;
 }
 
-// Function to read Huffman codes from a compressed file
-void ExtractCodesFromFile(int fd1, Tree* t) {
-    // Read character
-    read(fd1, &t->g, sizeof(char));
-    // Read code length
-    read(fd1, &t->len, sizeof(int));
-    // Read decimal representation of code
-    read(fd1, &t->dec, sizeof(int));
+// Growable buffer filled by an output callback
+typedef struct MemoryOut {
+    unsigned char* data;
+    size_t size;
+    size_t cap;
+} MemoryOut;
+
+// Output callback that appends to the MemoryOut passed as user
+static int writeToMemory(void* user, const void* buf, size_t n) {
+    MemoryOut* m = (MemoryOut*)user;
+    if (m->size + n > m->cap) {
+        size_t cap = m->cap ? m->cap : 4096;
+        while (cap < m->size + n)
+            cap *= 2;
+        unsigned char* grown = (unsigned char*)realloc(m->data, cap);
+        if (grown == NULL)
+            return -1;
+        m->data = grown;
+        m->cap = cap;
+    }
+    memcpy(m->data + m->size, buf, n);
+    m->size += n;
+    return 0;
 }
 
-// Function to rebuild the Huffman tree from the codes in the compressed file
-void ReBuildHuffmanTree(int fd1, int size) {
-    int i, j, k;
-    
-    // Allocate memory for the root of the tree
-    tree = (Tree*)malloc(sizeof(Tree));
-    tree_temp = tree;
-    tree->f = NULL;
-    tree->r = NULL;
-    
-    // Allocate memory for temporary node
-    t = (Tree*)malloc(sizeof(Tree));
-    t->f = NULL;
-    t->r = NULL;
-    
-    // Process each character code
-    for (k = 0; k < size; k++) {
-        // Start from the root
-        tree_temp = tree;
-        // Extract code for current character
-        ExtractCodesFromFile(fd1, t);
-        
-        // Arrays for binary representation
-        int bin[MAX], bin_con[MAX];
-        
-        // Initialize arrays
-        for (i = 0; i < MAX; i++) {
-            bin[i] = bin_con[i] = 0;
-        }
-        
-        // Convert decimal code to binary
-        convertDecimalToBinary(bin, t->dec, t->len);
-        
-        // Copy binary code
-        for (i = 0; i < t->len; i++) {
-            bin_con[i] = bin[i];
-        }
-
-        // Traverse the tree according to the code
-        for (j = 0; j < t->len; j++) {
-            if (bin_con[j] == 0) {
-                // If bit is 0, go left
-                if (tree_temp->f == NULL) {
-                    // Create left child if it doesn't exist
-                    tree_temp->f = (Tree*)malloc(sizeof(Tree));
-                    tree_temp->f->f = NULL;
-                    tree_temp->f->r = NULL;
-                }
-                tree_temp = tree_temp->f;
-            }
-            else if (bin_con[j] == 1) {
-                // If bit is 1, go right
-                if (tree_temp->r == NULL) {
-                    // Create right child if it doesn't exist
-                    tree_temp->r = (Tree*)malloc(sizeof(Tree));
-                    tree_temp->r->f = NULL;
-                    tree_temp->r->r = NULL;
-                }
-                tree_temp = tree_temp->r;
-            }
+// State of a search while matches are printed
+typedef struct SearchOutput {
+    int fd;                 // Compressed file (read again to fetch lines)
+    HuffDecoder* lines;     // Second decoder for fetching lines (the search's own is busy)
+    MemoryOut line;         // Uncompressed bytes around the current match
+    uint64_t count;         // Matches (with --lines, lines) printed
+    uint64_t lineEnd;       // End of the last line printed; later matches before it are on that line
+    int status;             // First error while fetching a line
+} SearchOutput;
+
+// Function to fetch the line around the match at offset and print it after the offset; the window
+// grows until it holds the whole line or MAX_LINE_CONTEXT bytes on each side
+static int printMatchLine(SearchOutput* so, uint64_t offset) {
+    uint64_t back = 256, ahead = 256;
+    for (;;) {
+        uint64_t from = offset > back ? offset - back : 0;
+        size_t at = (size_t)(offset - from), start = at, end = at;
+        so->line.size = 0;
+        int status = huffExtractFd(so->lines, so->fd, from, offset - from + ahead, writeToMemory, &so->line);
+        if (status != HUFF_OK)
+            return status;
+        while (start > 0 && so->line.data[start - 1] != '\n')
+            start--;
+        while (end < so->line.size && so->line.data[end] != '\n')
+            end++;
+        if (start == 0 && from > 0 && back < MAX_LINE_CONTEXT) {
+            back *= 4;
+            continue;
+        }
+        if (end == so->line.size && so->line.size == offset - from + ahead && ahead < MAX_LINE_CONTEXT) {
+            ahead *= 4;
+            continue;
         }
-        
-        // At leaf node, store character and code information
-        tree_temp->g = t->g;
-        tree_temp->len = t->len;
-        tree_temp->dec = t->dec;
+        printf("%llu:", (unsigned long long)offset);
+        fwrite(so->line.data + start, 1, end - start, stdout);
+        putchar('\n');
+        so->lineEnd = from + end;
+        return HUFF_OK;
     }
 }
 
-// Function to decompress the compressed file
-void decompressFile(int fd1, int fd2, int totalChars) {
-    int inp[8], i;
-    int charsProcessed = 0;
-    unsigned char p;
-    // Start from the root of the Huffman tree
-    tree_temp = tree;
-    
-    // Process each byte in the compressed file
-    while (read(fd1, &p, sizeof(char)) != 0 && charsProcessed < totalChars) {
-        // Convert byte to binary
-        convertDecimalToBinary(inp, p, 8);
-        
-        // Process each bit
-        for (i = 0; i < 8 && charsProcessed < totalChars; i++) {
-            if (inp[i] == 0) {
-                // If bit is 0, go left
-                tree_temp = tree_temp->f;
-            } else {
-                // If bit is 1, go right
-                tree_temp = tree_temp->r;
-            }
-            
-            // If we've reached a leaf node
-            if (tree_temp->f == NULL && tree_temp->r == NULL) {
-                // Write the character to the output file
-                write(fd2, &tree_temp->g, sizeof(char));
-                // Increment character count
-                charsProcessed++;
-                // Reset to root for next character
-                tree_temp = tree;
-            }
-        }
-    }
+// Search callback: print one match, returns nonzero to stop the search
+static int printMatch(void* user, uint64_t offset) {
+    SearchOutput* so = (SearchOutput*)user;
+    if (showLines && so->count > 0 && offset < so->lineEnd)
+        return 0;   // Already printed with an earlier match on the same line
+    if (!showLines)
+        printf("%llu\n", (unsigned long long)offset);
+    else if ((so->status = printMatchLine(so, offset)) != HUFF_OK)
+        return 1;
+    so->count++;
+    return maxMatches != 0 && so->count >= maxMatches;
 }
 
-// Function to compress a file using Huffman coding
-void compress(const char* inputFile, const char* outputFile) {
-    // Open input file in read-only mode (binary mode for Windows)
-    #ifdef _WIN32
-        int fd1 = open(inputFile, O_RDONLY | O_BINARY);
-    #else
-        int fd1 = open(inputFile, O_RDONLY);
-    #endif
-    
-    if (fd1 == -1) {
-        perror("Open Failed For Input File");
-        exit(1);
+// Function to print the uncompressed offsets (and with --lines the lines) where pattern occurs;
+// like grep, returns 0 if it was found, 1 if not and 2 on errors
+int search(const char* inputFile, const char* pattern, const HuffOptions* opts) {
+    int fd = openInputFile(inputFile);
+    SearchOutput so;
+    HuffOptions lineOpts = *opts;
+
+    memset(&so, 0, sizeof(so));
+    so.fd = fd;
+    lineOpts.threads = 1;
+    HuffDecoder* dec = huffDecoderCreate(opts);
+    HuffDictionary* dict = dictionaryFile ? loadDictionaryFile(dictionaryFile) : NULL;
+    so.lines = showLines ? huffDecoderCreate(&lineOpts) : NULL;
+    int status = dec && (so.lines || !showLines) ? huffDecoderSetDictionary(dec, dict) : HUFF_ERR_NOMEM;
+    if (status == HUFF_OK)
+        status = huffSearchFd(dec, fd, pattern, strlen(pattern), printMatch, &so);
+    if (status == HUFF_OK)
+        status = so.status;
+    fflush(stdout);
+    if (dec && showMemStats) {
+        HuffMemoryStats ms;
+        huffDecoderMemoryStats(dec, &ms);
+        printMemStats("search", &ms);
     }
-    
-    // Create output file with write permissions
-    #ifdef _WIN32
-        int fd2 = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, S_IRUSR | S_IWUSR);
-    #else
-        int fd2 = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-    #endif
-    
-    if (fd2 == -1) {
-        perror("Open Failed For Output File");
-        close(fd1);
-        exit(1);
+    huffDecoderFree(dec);
+    huffDecoderFree(so.lines);
+    huffDictionaryFree(dict);
+    free(so.line.data);
+    close(fd);
+
+    if (status == HUFF_ERR_UNSUPPORTED && showLines) {
+        fprintf(stderr, "--lines needs a seekable file written with --format=3.\n");
+        return 2;
     }
-    
-    // Count character frequencies
-    char ch;
-    int freq[256] = {0};  // Initialize frequency array for all possible characters
-    int totalChars = 0;   // Total number of characters in the file
-    
-    // Read each character and update frequencies
-    while (read(fd1, &ch, sizeof(char)) != 0) {
-        freq[(unsigned char)ch]++;
-        totalChars++;
-    }
-    
-    // Count unique characters
-    int uniqueChars = 0;
-    for (int i = 0; i < 256; i++) {
-        if (freq[i] > 0) {
-            uniqueChars++;
-        }
-    }
-    
-    // Create arrays for unique characters and their frequencies
-    char arr[uniqueChars];
-    int freqArr[uniqueChars];
-    int index = 0;
-    
-    // Fill the arrays
-    for (int i = 0; i < 256; i++) {
-        if (freq[i] > 0) {
-            arr[index] = (char)i;
-            freqArr[index] = freq[i];
-            index++;
-        }
-    }
-    
-    // Write header information to compressed file
-    write(fd2, &uniqueChars, sizeof(int));  // Number of unique characters
-    write(fd2, &totalChars, sizeof(int));   // Total number of characters
-    
-    // Build Huffman tree
-    struct Node* root = buildHuffmanTree(arr, freqArr, uniqueChars);
-    
-    // Generate Huffman codes and write to file
-    int codeArr[MAX];
-    printCodesIntoFile(fd2, root, codeArr, 0);
-    
-    // Compress the file using generated codes
-    compressFile(fd1, fd2, 0);
-    
-    // Close file descriptors
-    close(fd1);
-    close(fd2);
-    
-    printf("File compressed successfully.\n");
+    if (status != HUFF_OK) {
+        fprintf(stderr, "%s.\n", huffErrorString(status));
+        return 2;
+    }
+    return so.count > 0 ? 0 : 1;
 }
 
-// Function to decompress a compressed file
-void decompress(const char* inputFile, const char* outputFile) {
-    // Open compressed file in read-only mode (binary mode for Windows)
-    #ifdef _WIN32
-        int fd1 = open(inputFile, O_RDONLY | O_BINARY);
-    #else
-        int fd1 = open(inputFile, O_RDONLY);
-    #endif
-    
-    if (fd1 == -1) {
-        perror("Open Failed For Input File");
-        exit(1);
+// Function to build a dictionary from sample files and save it
+int train(const char* dictFile, char* samples[], int count, const HuffOptions* opts) {
+    unsigned char* data = NULL;
+    size_t size = 0, cap = 0, saved;
+    unsigned char out[HUFF_MAX_DICTIONARY_SIZE];
+    HuffDictionary* dict;
+
+    // Only the byte frequencies matter, so the samples are simply concatenated
+    for (int i = 0; i < count; i++)
+        appendFile(samples[i], &data, &size, &cap);
+    int status = huffTrainDictionary(data, size, opts->maxCodeLen, &dict);
+    free(data);
+    if (status != HUFF_OK) {
+        fprintf(stderr, "%s.\n", huffErrorString(status));
+        return 1;
     }
-    
-    // Create output file with write permissions
-    #ifdef _WIN32
-        int fd2 = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, S_IRUSR | S_IWUSR);
-    #else
-        int fd2 = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-    #endif
-    
-    if (fd2 == -1) {
-        perror("Open Failed For Output File");
-        close(fd1);
-        exit(1);
+    uint32_t id = huffDictionaryId(dict);
+    status = huffSaveDictionary(dict, out, sizeof(out), &saved);
+    huffDictionaryFree(dict);
+
+    int fd = openOutputFile(dictFile);
+    if (status != HUFF_OK || writeToFd(&fd, out, saved) != 0) {
+        fprintf(stderr, "Could not save the dictionary.\n");
+        close(fd);
+        return 1;
     }
-    
-    // Read header information
-    int uniqueChars, totalChars;
-    read(fd1, &uniqueChars, sizeof(int));  // Number of unique characters
-    read(fd1, &totalChars, sizeof(int));   // Total number of characters
-    
-    // Rebuild Huffman tree from codes in the compressed file
-    ReBuildHuffmanTree(fd1, uniqueChars);
-    
-    // Decompress the file
-    decompressFile(fd1, fd2, totalChars);
-    
-    // Close file descriptors
-    close(fd1);
-    close(fd2);
-    
-    printf("File decompressed successfully.\n");
+    close(fd);
+    if (strcmp(dictFile, "-") != 0)
+        printf("Dictionary %08x trained on %zu bytes.\n", (unsigned)id, size);
+    return 0;
+}
+
+// Function to parse a size such as 65536, 512K or 4M
+size_t parseSize(const char* s) {
+    char* end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*end == 'K' || *end == 'k')
+        v <<= 10, end++;
+    else if (*end == 'M' || *end == 'm')
+        v <<= 20, end++;
+    return *end == '\0' ? (size_t)v : 0;
 }
 
 // Main function
 int main(int argc, char* argv[]) {
-    // Check if enough command line arguments are provided
-    if (argc < 4) {
-        printf("Usage: %s [compress/decompress] [input_file] [output_file]\n", argv[0]);
+    // Client takes four arguments after the command, extract and batch three, train and loadgen
+    // two or more, test one or more, serve one, the others two
+    int isExtract = argc > 1 && strcmp(argv[1], "extract") == 0;
+    int isTrain = argc > 1 && strcmp(argv[1], "train") == 0;
+    int isTest = argc > 1 && strcmp(argv[1], "test") == 0;
+    int isBatch = argc > 1 && strcmp(argv[1], "batch") == 0;
+    int isServe = argc > 1 && strcmp(argv[1], "serve") == 0;
+    int isClient = argc > 1 && strcmp(argv[1], "client") == 0;
+    int isLoadgen = argc > 1 && strcmp(argv[1], "loadgen") == 0;
+    int firstOption = isClient ? 6 : isExtract || isBatch ? 5 : isTrain || isServe || isLoadgen ? 3 : isTest ? 2 : 4;
+    int archive = 0, requests = 1000, connections = 4;
+    HuffOptions opts;
+
+    huffDefaultOptions(&opts);
+    // Payloads sent to a server often share their code tables
+    if (isServe)
+        opts.tableCache = SERVER_TABLE_CACHE;
+
+    // Every argument up to the first option is a sample file (train), a file to check (test)
+    // or a payload (loadgen)
+    if (isTrain || isTest || isLoadgen) {
+        while (firstOption < argc && strncmp(argv[firstOption], "--", 2) != 0)
+            firstOption++;
+    }
+
+    // Check if enough command line arguments are provided (train and loadgen need at least one
+    // file, test one file)
+    if (argc < firstOption || firstOption < (isTest || isServe ? 3 : 4)) {
+        fprintf(stderr, "Usage: %s [compress/decompress] [input_file] [output_file] [options]\n", argv[0]);
+        fprintf(stderr, "       %s extract [compressed_file] [offset] [length] [options]\n", argv[0]);
+        fprintf(stderr, "       %s train [dictionary_file] [sample_files...] [options]\n", argv[0]);
+        fprintf(stderr, "       %s batch [compress/decompress] [directory/list/archive] [output] [options]\n", argv[0]);
+        fprintf(stderr, "       %s search [compressed_file] [pattern] [options]\n", argv[0]);
+        fprintf(stderr, "       %s test [compressed_files...] [options]\n", argv[0]);
+        fprintf(stderr, "       %s serve [socket] [options]\n", argv[0]);
+        fprintf(stderr, "       %s client [socket] [compress/decompress] [input_file] [output_file]\n", argv[0]);
+        fprintf(stderr, "       %s loadgen [socket] [files...] [options]\n", argv[0]);
+        fprintf(stderr, "Use - as a file name for standard input or output; serve - answers requests on them.\n");
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --table-bits=N   Decode table size as 2^N entries (%d-%d, default %d)\n",
+                        HUFF_MIN_TABLE_BITS, HUFF_MAX_TABLE_BITS, opts.tableBits);
+        fprintf(stderr, "  --max-code-len=N Longest Huffman code when compressing (%d-%d, default %d)\n",
+                        HUFF_MIN_CODE_LEN, HUFF_MAX_CODE_LEN, opts.maxCodeLen);
+        fprintf(stderr, "  --block-size=N   Uncompressed bytes per block, K/M suffixes allowed (default 1M)\n");
+        fprintf(stderr, "  --threads=N      Worker threads (default: one per CPU)\n");
+        fprintf(stderr, "  --sync-interval=N Bytes between random access points, 0 for none (default 64K)\n");
+        fprintf(stderr, "  --streams=N      Interleaved bitstreams per block, 1-%d (default %d)\n",
+                        HUFF_MAX_STREAMS, opts.streams);
+        fprintf(stderr, "  --format=N       File format to write: 1 original, 2 single table, 3 blocks (default),\n");
+        fprintf(stderr, "                   4 dictionary, 5 adaptive (streams without lookahead)\n");
+        fprintf(stderr, "  --dictionary=FILE Shared code table made by train; compresses in format 4\n");
+        fprintf(stderr, "  --adapt-interval=N Format 5: most bytes between code rebuilds, 256-16M (default 16K)\n");
+        fprintf(stderr, "  --legacy         Same as --format=1\n");
+        fprintf(stderr, "  --sync-io        Read and write on the coding thread instead of overlapping I/O\n");
+        fprintf(stderr, "  --io-threads     Overlap I/O on helper threads even where io_uring is available\n");
+        fprintf(stderr, "  --no-checksum    Compress without the CRC32C of each block and of the whole file\n");
+        fprintf(stderr, "  --mem-stats      Print heap allocations per MB processed on standard error\n");
+        fprintf(stderr, "  --stats[=json]   Print sizes, ratio, code lengths and time per phase on standard error\n");
+        fprintf(stderr, "  --archive        batch compress: write one archive instead of a directory of files\n");
+        fprintf(stderr, "  --lines          search: print the line holding each match after its offset\n");
+        fprintf(stderr, "  --max-count=N    search: stop after N matches (with --lines, N lines)\n");
+        fprintf(stderr, "  --table-cache=N  Decode tables kept per thread for reuse, 0-%d (default 0, serve %d)\n",
+                        HUFF_MAX_TABLE_CACHE, SERVER_TABLE_CACHE);
+        fprintf(stderr, "  --requests=N     loadgen: compress/decompress round trips to send (default %d)\n", requests);
+        fprintf(stderr, "  --connections=N  loadgen: concurrent connections (default %d)\n", connections);
         return 1;
     }
-    
-    // Determine operation: compress or decompress
+
+    // Parse the options following the file names
+    for (int i = firstOption; i < argc; i++) {
+        if (strncmp(argv[i], "--table-bits=", 13) == 0) {
+            opts.tableBits = atoi(argv[i] + 13);
+            if (opts.tableBits < HUFF_MIN_TABLE_BITS || opts.tableBits > HUFF_MAX_TABLE_BITS) {
+                fprintf(stderr, "Invalid table size. Use %d to %d bits.\n", HUFF_MIN_TABLE_BITS, HUFF_MAX_TABLE_BITS);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--max-code-len=", 15) == 0) {
+            opts.maxCodeLen = atoi(argv[i] + 15);
+            if (opts.maxCodeLen < HUFF_MIN_CODE_LEN || opts.maxCodeLen > HUFF_MAX_CODE_LEN) {
+                fprintf(stderr, "Invalid code length limit. Use %d to %d bits.\n", HUFF_MIN_CODE_LEN, HUFF_MAX_CODE_LEN);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--block-size=", 13) == 0) {
+            opts.blockSize = parseSize(argv[i] + 13);
+            if (opts.blockSize < HUFF_MIN_BLOCK_SIZE || opts.blockSize > HUFF_MAX_BLOCK_SIZE) {
+                fprintf(stderr, "Invalid block size. Use 16K to 64M.\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--sync-interval=", 16) == 0) {
+            opts.syncInterval = parseSize(argv[i] + 16);
+            if (opts.syncInterval != 0 && opts.syncInterval < HUFF_MIN_SYNC_INTERVAL) {
+                fprintf(stderr, "Invalid sync interval. Use 0 or at least 1K.\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            opts.threads = atoi(argv[i] + 10);
+            if (opts.threads < 1 || opts.threads > HUFF_MAX_THREADS) {
+                fprintf(stderr, "Invalid thread count. Use 1 to %d.\n", HUFF_MAX_THREADS);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--streams=", 10) == 0) {
+            opts.streams = atoi(argv[i] + 10);
+            if (opts.streams < 1 || opts.streams > HUFF_MAX_STREAMS) {
+                fprintf(stderr, "Invalid stream count. Use 1 to %d.\n", HUFF_MAX_STREAMS);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--format=", 9) == 0) {
+            opts.format = atoi(argv[i] + 9);
+            if (opts.format < HUFF_FORMAT_LEGACY || opts.format > HUFF_FORMAT_ADAPTIVE) {
+                fprintf(stderr, "Invalid format. Use 1, 2, 3, 4 or 5.\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--legacy") == 0) {
+            opts.format = HUFF_FORMAT_LEGACY;
+        }
+        else if (strcmp(argv[i], "--sync-io") == 0) {
+            opts.asyncIo = 0;
+        }
+        else if (strcmp(argv[i], "--io-threads") == 0) {
+            opts.asyncIo = 2;
+        }
+        else if (strcmp(argv[i], "--no-checksum") == 0) {
+            opts.checksum = 0;
+        }
+        else if (strcmp(argv[i], "--mem-stats") == 0) {
+            showMemStats = 1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=text") == 0) {
+            showStats = 1;
+            opts.stats = 1;
+        }
+        else if (strcmp(argv[i], "--stats=json") == 0) {
+            showStats = 2;
+            opts.stats = 1;
+        }
+        else if (strncmp(argv[i], "--dictionary=", 13) == 0) {
+            dictionaryFile = argv[i] + 13;
+            opts.format = HUFF_FORMAT_DICTIONARY;
+        }
+        else if (strncmp(argv[i], "--adapt-interval=", 17) == 0) {
+            opts.adaptInterval = parseSize(argv[i] + 17);
+            if (opts.adaptInterval < HUFF_MIN_ADAPT_INTERVAL || opts.adaptInterval > HUFF_MAX_ADAPT_INTERVAL) {
+                fprintf(stderr, "Invalid adapt interval. Use 256 to 16M.\n");
+                return 1;
+            }
+        }
+        else if (isBatch && strcmp(argv[i], "--archive") == 0) {
+            archive = 1;
+        }
+        else if (strcmp(argv[i], "--lines") == 0) {
+            showLines = 1;
+        }
+        else if (strncmp(argv[i], "--max-count=", 12) == 0) {
+            char* end;
+            maxMatches = strtoull(argv[i] + 12, &end, 10);
+            if (*end != '\0' || maxMatches == 0) {
+                fprintf(stderr, "Invalid match count.\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--table-cache=", 14) == 0) {
+            char* end;
+            long n = strtol(argv[i] + 14, &end, 10);
+            if (*end != '\0' || n < 0 || n > HUFF_MAX_TABLE_CACHE) {
+                fprintf(stderr, "Invalid table cache size. Use 0 to %d tables.\n", HUFF_MAX_TABLE_CACHE);
+                return 1;
+            }
+            opts.tableCache = (int)n;
+        }
+        else if (isLoadgen && strncmp(argv[i], "--requests=", 11) == 0) {
+            requests = atoi(argv[i] + 11);
+            if (requests < 1) {
+                fprintf(stderr, "Invalid request count.\n");
+                return 1;
+            }
+        }
+        else if (isLoadgen && strncmp(argv[i], "--connections=", 14) == 0) {
+            connections = atoi(argv[i] + 14);
+            if (connections < 1) {
+                fprintf(stderr, "Invalid connection count.\n");
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // Determine operation: compress, decompress or extract
     if (strcmp(argv[1], "compress") == 0) {
-        compress(argv[2], argv[3]);
+        return compress(argv[2], argv[3], &opts);
     } else if (strcmp(argv[1], "decompress") == 0) {
-        decompress(argv[2], argv[3]);
+        return decompress(argv[2], argv[3], &opts);
+    } else if (isExtract) {
+        // The requested range goes to standard output
+        char* end1;
+        char* end2;
+        uint64_t offset = strtoull(argv[3], &end1, 10);
+        uint64_t length = strtoull(argv[4], &end2, 10);
+        if (*end1 != '\0' || *end2 != '\0') {
+            fprintf(stderr, "Offset and length must be byte counts.\n");
+            return 1;
+        }
+        return extract(argv[2], offset, length, &opts);
+    } else if (isTrain) {
+        return train(argv[2], argv + 3, firstOption - 3, &opts);
+    } else if (isTest) {
+        return test(argv + 2, firstOption - 2, &opts);
+    } else if (strcmp(argv[1], "search") == 0) {
+        if (argv[3][0] == '\0' || strlen(argv[3]) > HUFF_MAX_PATTERN) {
+            fprintf(stderr, "The pattern must be 1 to %d bytes.\n", HUFF_MAX_PATTERN);
+            return 2;
+        }
+        return search(argv[2], argv[3], &opts);
+    } else if (isBatch) {
+        int compressing = strcmp(argv[2], "compress") == 0;
+        if (!compressing && strcmp(argv[2], "decompress") != 0) {
+            fprintf(stderr, "Invalid batch mode. Use 'compress' or 'decompress'.\n");
+            return 1;
+        }
+        if (archive && !compressing) {
+            fprintf(stderr, "--archive only applies to batch compress; archives are recognised when decompressing.\n");
+            return 1;
+        }
+        HuffDictionary* dict = dictionaryFile ? loadDictionaryFile(dictionaryFile) : NULL;
+        int status = batch(compressing, argv[3], argv[4], &opts, dict, archive);
+        huffDictionaryFree(dict);
+        return status;
+    } else if (isServe) {
+        HuffDictionary* dict = dictionaryFile ? loadDictionaryFile(dictionaryFile) : NULL;
+        int status = serve(argv[2], &opts, dict);
+        huffDictionaryFree(dict);
+        return status;
+    } else if (isClient) {
+        int compressing = strcmp(argv[3], "compress") == 0;
+        if (!compressing && strcmp(argv[3], "decompress") != 0) {
+            fprintf(stderr, "Invalid request. Use 'compress' or 'decompress'.\n");
+            return 1;
+        }
+        return client(argv[2], compressing ? SERVER_OP_COMPRESS : SERVER_OP_DECOMPRESS, argv[4], argv[5]);
+    } else if (isLoadgen) {
+        return loadgen(argv[2], argv + 3, firstOption - 3, requests, connections);
     } else {
-        printf("Invalid command. Use 'compress' or 'decompress'.\n");
+        fprintf(stderr, "Invalid command. Use 'compress', 'decompress', 'extract', 'train', 'batch', 'search', 'test',\n"
+                        "'serve', 'client' or 'loadgen'.\n");
         return 1;
     }
-    
-    return 0;
 }
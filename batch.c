@@ -0,0 +1,762 @@
+#include <stdio.h>      // Standard I/O functions
+#include <stdlib.h>     // Standard library functions (e.g., malloc, qsort)
+#include <string.h>     // String manipulation functions
+#include <fcntl.h>      // File control options for open()
+#include <unistd.h>     // UNIX standard functions (pread, sysconf)
+#include <errno.h>      // errno values (EINTR retries, EEXIST)
+#include <stdint.h>     // Fixed width integers for archive fields
+#include <dirent.h>     // Directory walking
+#include <pthread.h>    // Worker threads
+#include <time.h>       // Elapsed time of the batch
+#include <sys/stat.h>   // File status and mkdir()
+
+#include "batch.h"      // Batch mode interface
+
+#define ARCHIVE_HEADER_SIZE 8       // "HUFA", version, three reserved bytes
+#define ARCHIVE_TRAILER_SIZE 16     // Index offset (64 bits), member count (32 bits), "HAIX"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_ENTRY_SIZE 26       // Fixed part of an index entry: offset, sizes, name length
+#define MAX_NAME_LEN 4096           // Longest member or output name
+#define LARGE_FILE_BLOCKS 8         // Files of at least this many blocks are spread over all threads
+
+// One file (or archive member) of the batch
+typedef struct BatchEntry {
+    char* path;             // File to read (NULL for archive members)
+    char* name;             // Relative name of the output file or archive member
+    uint64_t size;          // Input size; for archive members the uncompressed size
+    uint64_t offset;        // Archive members: offset of the compressed data
+    uint64_t packed;        // Compressed size (archive members and archived files)
+    uint64_t produced;      // Bytes written for this entry
+    int done;               // 1 once the entry succeeded
+} BatchEntry;
+
+// Growable array of entries
+typedef struct EntryList {
+    BatchEntry* items;
+    size_t count;
+    size_t cap;
+} EntryList;
+
+// Work queue of one worker: the owner takes entries from the head, idle workers steal from the tail
+typedef struct WorkQueue {
+    pthread_mutex_t lock;   // Protects head and tail
+    size_t* items;          // Entry numbers
+    size_t head;            // Next entry for the owner
+    size_t tail;            // One past the entry a thief takes next
+} WorkQueue;
+
+// Reusable buffers of a worker (archive writing only)
+typedef struct BatchBuffers {
+    unsigned char* in;      // Whole input file
+    size_t inCap;
+    unsigned char* out;     // Its compressed form
+    size_t outCap;
+} BatchBuffers;
+
+// State shared by all workers
+typedef struct Batch {
+    int compressing;        // 1 to compress, 0 to decompress
+    const char* dest;       // Output directory (or archive being written)
+    EntryList entries;      // Everything to process
+    int archiveFd;          // Archive being written or read, -1 if there is none
+    int writing;            // 1 if archiveFd is being written
+    uint64_t archiveEnd;    // Offset where the next member goes
+    int archiveBroken;      // 1 if a failed member could not be dropped, so offsets are off
+    pthread_mutex_t archiveLock; // Serializes appends to the archive
+    WorkQueue* queues;      // One queue per worker
+    int workers;            // Number of worker threads
+    int failed;             // Entries that failed
+} Batch;
+
+// One worker thread and its single-threaded contexts
+typedef struct BatchWorker {
+    Batch* b;
+    int self;               // Number of the worker (and of its queue)
+    HuffEncoder* enc;
+    HuffDecoder* dec;
+    BatchBuffers buf;
+    pthread_t thread;
+} BatchWorker;
+
+// Byte range of an archive member, read with pread() so workers can share the descriptor
+typedef struct MemberSource {
+    int fd;
+    uint64_t offset;        // Next byte to read
+    uint64_t left;          // Bytes of the member still to read
+} MemberSource;
+
+// Function to store a 64-bit value in little-endian byte order
+static void putU64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// Function to load a 64-bit little-endian value
+static uint64_t getU64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+// Function to write all n bytes to a file descriptor, returns 0 on success
+static int writeAll(int fd, const void* buf, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = write(fd, (const char*)buf + done, n - done);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += (size_t)w;
+    }
+    return 0;
+}
+
+// Function to read exactly n bytes at offset, returns 0 on success
+static int preadAll(int fd, void* buf, size_t n, uint64_t offset) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = pread(fd, (char*)buf + done, n - done, (off_t)(offset + done));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        done += (size_t)r;
+    }
+    return 0;
+}
+
+// Input callback reading an archive member
+static long readMember(void* user, void* buf, size_t n) {
+    MemberSource* m = (MemberSource*)user;
+    ssize_t r;
+    if (n > m->left)
+        n = (size_t)m->left;
+    if (n == 0)
+        return 0;
+    do {
+        r = pread(m->fd, buf, n, (off_t)m->offset);
+    } while (r < 0 && errno == EINTR);
+    if (r <= 0)
+        return -1;
+    m->offset += (uint64_t)r;
+    m->left -= (uint64_t)r;
+    return (long)r;
+}
+
+// Output callback that writes to the file descriptor passed as user
+static int writeMember(void* user, const void* buf, size_t n) {
+    return writeAll(*(int*)user, buf, n);
+}
+
+// Function to join a directory and a relative name into a new string
+static char* joinPath(const char* dir, const char* name) {
+    size_t a = strlen(dir), b = strlen(name);
+    char* p = (char*)malloc(a + b + 2);
+    if (p == NULL)
+        return NULL;
+    memcpy(p, dir, a);
+    p[a] = '/';
+    memcpy(p + a + 1, name, b + 1);
+    return p;
+}
+
+// Function to check that a relative name stays inside the output directory
+static int safeName(const char* name) {
+    const char* p = name;
+    if (*name == '\0' || *name == '/' || strlen(name) > MAX_NAME_LEN)
+        return 0;
+    while (*p != '\0') {
+        size_t len = strcspn(p, "/");
+        if (len == 0 || (len == 1 && p[0] == '.') || (len == 2 && p[0] == '.' && p[1] == '.'))
+            return 0;
+        p += len;
+        if (*p == '/')
+            p++;
+    }
+    return 1;
+}
+
+// Function to create the directories above path (the last component is a file)
+static void makeParents(const char* path) {
+    char buf[MAX_NAME_LEN * 2];
+    size_t len = strlen(path);
+    if (len >= sizeof(buf))
+        return;
+    memcpy(buf, path, len + 1);
+    for (size_t i = 1; i < len; i++) {
+        if (buf[i] != '/')
+            continue;
+        buf[i] = '\0';
+        mkdir(buf, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+        buf[i] = '/';
+    }
+}
+
+// Function to add an entry to the list, taking ownership of path and name
+static int addEntry(EntryList* list, char* path, char* name, uint64_t size) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 256;
+        BatchEntry* grown = (BatchEntry*)realloc(list->items, cap * sizeof(BatchEntry));
+        if (grown == NULL) {
+            free(path);
+            free(name);
+            return 0;
+        }
+        list->items = grown;
+        list->cap = cap;
+    }
+    BatchEntry* e = &list->items[list->count++];
+    memset(e, 0, sizeof(BatchEntry));
+    e->path = path;
+    e->name = name;
+    e->size = size;
+    return 1;
+}
+
+// Function to add every regular file below dir (rel is its name relative to the source, "" at the top);
+// symbolic links are skipped so the walk cannot loop
+static int walkDirectory(EntryList* list, const char* dir, const char* rel) {
+    DIR* d = opendir(dir);
+    struct dirent* de;
+    int ok = 1;
+
+    if (d == NULL) {
+        perror(dir);
+        return 0;
+    }
+    while (ok && (de = readdir(d)) != NULL) {
+        struct stat st;
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        char* path = joinPath(dir, de->d_name);
+        char* name = *rel ? joinPath(rel, de->d_name) : strdup(de->d_name);
+        if (path == NULL || name == NULL) {
+            free(path);
+            free(name);
+            ok = 0;
+            break;
+        }
+        if (lstat(path, &st) != 0) {
+            perror(path);
+            free(path);
+            free(name);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            ok = walkDirectory(list, path, name);
+            free(path);
+            free(name);
+        }
+        else if (S_ISREG(st.st_mode)) {
+            ok = addEntry(list, path, name, (uint64_t)st.st_size);
+        }
+        else {
+            free(path);
+            free(name);
+        }
+    }
+    closedir(d);
+    return ok;
+}
+
+// Function to add the files named in a list, one path per line; the output name is the path
+// without leading "/" and "./"
+static int readFileList(EntryList* list, const char* listFile) {
+    FILE* f = strcmp(listFile, "-") == 0 ? stdin : fopen(listFile, "r");
+    char line[MAX_NAME_LEN + 2];
+    int ok = 1;
+
+    if (f == NULL) {
+        perror(listFile);
+        return 0;
+    }
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        struct stat st;
+        size_t len = strcspn(line, "\r\n");
+        const char* name = line;
+        line[len] = '\0';
+        if (len == 0)
+            continue;
+        if (stat(line, &st) != 0 || !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "%s: not a regular file, skipped.\n", line);
+            continue;
+        }
+        while (*name == '/' || (name[0] == '.' && name[1] == '/'))
+            name += *name == '/' ? 1 : 2;
+        ok = addEntry(list, strdup(line), strdup(name), (uint64_t)st.st_size) &&
+             list->items[list->count - 1].path != NULL && list->items[list->count - 1].name != NULL;
+    }
+    if (f != stdin)
+        fclose(f);
+    return ok;
+}
+
+// Function to load the member index of an archive; returns 0 if fd is not a valid archive
+static int readArchiveIndex(EntryList* list, int fd) {
+    unsigned char trailer[ARCHIVE_TRAILER_SIZE];
+    unsigned char* index;
+    struct stat st;
+    uint64_t size, at, count;
+    size_t pos = 0, len;
+
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < ARCHIVE_HEADER_SIZE + ARCHIVE_TRAILER_SIZE)
+        return 0;
+    size = (uint64_t)st.st_size;
+    if (preadAll(fd, trailer, ARCHIVE_TRAILER_SIZE, size - ARCHIVE_TRAILER_SIZE) != 0 ||
+        memcmp(trailer + 12, "HAIX", 4) != 0)
+        return 0;
+    at = getU64(trailer);
+    count = (uint64_t)trailer[8] | ((uint64_t)trailer[9] << 8) | ((uint64_t)trailer[10] << 16) | ((uint64_t)trailer[11] << 24);
+    if (at < ARCHIVE_HEADER_SIZE || at > size - ARCHIVE_TRAILER_SIZE)
+        return 0;
+    len = (size_t)(size - ARCHIVE_TRAILER_SIZE - at);
+    if ((index = (unsigned char*)malloc(len ? len : 1)) == NULL || preadAll(fd, index, len, at) != 0) {
+        free(index);
+        return 0;
+    }
+
+    // Offset, compressed size, uncompressed size, name length and name of every member
+    for (uint64_t i = 0; i < count; i++) {
+        if (len - pos < ARCHIVE_ENTRY_SIZE)
+            break;
+        uint64_t offset = getU64(index + pos), packed = getU64(index + pos + 8), raw = getU64(index + pos + 16);
+        size_t nameLen = index[pos + 24] | ((size_t)index[pos + 25] << 8);
+        pos += ARCHIVE_ENTRY_SIZE;
+        if (len - pos < nameLen || offset < ARCHIVE_HEADER_SIZE || offset > at || packed > at - offset)
+            break;
+        char* name = (char*)malloc(nameLen + 1);
+        if (name == NULL)
+            break;
+        memcpy(name, index + pos, nameLen);
+        name[nameLen] = '\0';
+        pos += nameLen;
+        if (strlen(name) != nameLen || !safeName(name)) {
+            free(name);
+            break;
+        }
+        if (!addEntry(list, NULL, name, raw))
+            break;
+        list->items[list->count - 1].offset = offset;
+        list->items[list->count - 1].packed = packed;
+    }
+    free(index);
+    return list->count == count;
+}
+
+// Function to append the index and trailer to an archive
+static int writeArchiveIndex(Batch* b) {
+    unsigned char fixed[ARCHIVE_ENTRY_SIZE], trailer[ARCHIVE_TRAILER_SIZE];
+    uint32_t count = 0;
+
+    for (size_t i = 0; i < b->entries.count; i++) {
+        const BatchEntry* e = &b->entries.items[i];
+        size_t nameLen = strlen(e->name);
+        if (!e->done)
+            continue;
+        putU64(fixed, e->offset);
+        putU64(fixed + 8, e->packed);
+        putU64(fixed + 16, e->size);
+        fixed[24] = (unsigned char)nameLen;
+        fixed[25] = (unsigned char)(nameLen >> 8);
+        if (writeAll(b->archiveFd, fixed, ARCHIVE_ENTRY_SIZE) != 0 || writeAll(b->archiveFd, e->name, nameLen) != 0)
+            return 0;
+        count++;
+    }
+    putU64(trailer, b->archiveEnd);
+    trailer[8] = (unsigned char)count;
+    trailer[9] = (unsigned char)(count >> 8);
+    trailer[10] = (unsigned char)(count >> 16);
+    trailer[11] = (unsigned char)(count >> 24);
+    memcpy(trailer + 12, "HAIX", 4);
+    return writeAll(b->archiveFd, trailer, ARCHIVE_TRAILER_SIZE) == 0;
+}
+
+// Function to read a whole file into the worker's input buffer, returns its size or -1
+static long long loadFile(int fd, BatchBuffers* buf) {
+    size_t n = 0;
+    for (;;) {
+        if (n == buf->inCap) {
+            size_t cap = buf->inCap ? buf->inCap * 2 : 65536;
+            unsigned char* grown = (unsigned char*)realloc(buf->in, cap);
+            if (grown == NULL)
+                return -1;
+            buf->in = grown;
+            buf->inCap = cap;
+        }
+        ssize_t r = read(fd, buf->in + n, buf->inCap - n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return -1;
+        if (r == 0)
+            return (long long)n;
+        n += (size_t)r;
+    }
+}
+
+// Function to compress one file into memory and append it to the archive
+static int archiveFile(Batch* b, BatchEntry* e, int in, HuffEncoder* enc, BatchBuffers* buf) {
+    long long n = loadFile(in, buf);
+    size_t packed;
+    int status;
+
+    if (n < 0)
+        return HUFF_ERR_IO;
+    size_t bound = huffCompressBound(enc, (size_t)n);
+    if (bound > buf->outCap) {
+        unsigned char* grown = (unsigned char*)realloc(buf->out, bound);
+        if (grown == NULL)
+            return HUFF_ERR_NOMEM;
+        buf->out = grown;
+        buf->outCap = bound;
+    }
+    if ((status = huffCompressBuffer(enc, buf->in, (size_t)n, buf->out, buf->outCap, &packed)) != HUFF_OK)
+        return status;
+
+    // Members are appended in the order they finish
+    pthread_mutex_lock(&b->archiveLock);
+    e->offset = b->archiveEnd;
+    if (writeAll(b->archiveFd, buf->out, packed) == 0)
+        b->archiveEnd += packed;
+    else {
+        // Drop the part written, so the next member starts at archiveEnd as the index says
+        status = HUFF_ERR_IO;
+        if (ftruncate(b->archiveFd, (off_t)b->archiveEnd) != 0 || lseek(b->archiveFd, (off_t)b->archiveEnd, SEEK_SET) < 0)
+            b->archiveBroken = 1;
+    }
+    pthread_mutex_unlock(&b->archiveLock);
+    e->size = (uint64_t)n;
+    e->packed = packed;
+    e->produced = packed;
+    return status;
+}
+
+// Function to compress a large file straight into the archive (no other thread writes to it then)
+static int archiveLargeFile(Batch* b, BatchEntry* e, int in, HuffEncoder* enc) {
+    struct stat st;
+    int status = huffCompressFd(enc, in, b->archiveFd);
+    off_t end = lseek(b->archiveFd, 0, SEEK_CUR);
+    if (status == HUFF_OK && (end < 0 || fstat(in, &st) != 0))
+        status = HUFF_ERR_IO;
+    if (status == HUFF_OK) {
+        e->offset = b->archiveEnd;
+        e->packed = (uint64_t)end - b->archiveEnd;
+        e->produced = e->packed;
+        e->size = (uint64_t)st.st_size;
+        b->archiveEnd = (uint64_t)end;
+    }
+    else if (end >= 0 && (uint64_t)end != b->archiveEnd) {
+        // Drop what the failed member left behind
+        if (ftruncate(b->archiveFd, (off_t)b->archiveEnd) != 0 || lseek(b->archiveFd, (off_t)b->archiveEnd, SEEK_SET) < 0) {
+            status = HUFF_ERR_IO;
+            b->archiveBroken = 1;
+        }
+    }
+    return status;
+}
+
+// Function to work out the output file of an entry: the name below dest, with ".huff" added when
+// compressing and removed (or ".out" added) when decompressing
+static char* outputPath(const Batch* b, const BatchEntry* e) {
+    size_t len = strlen(e->name);
+    char* rel = (char*)malloc(len + 6);
+    char* path;
+    if (rel == NULL)
+        return NULL;
+    memcpy(rel, e->name, len + 1);
+    if (b->compressing)
+        strcat(rel, ".huff");
+    else if (e->path == NULL)
+        ;   // Archive members keep their names
+    else if (len > 5 && strcmp(rel + len - 5, ".huff") == 0)
+        rel[len - 5] = '\0';
+    else
+        strcat(rel, ".out");
+    path = joinPath(b->dest, rel);
+    free(rel);
+    return path;
+}
+
+// Function to process one entry with the given contexts; large selects the path for files
+// handled on all threads
+static int processEntry(Batch* b, BatchEntry* e, HuffEncoder* enc, HuffDecoder* dec, BatchBuffers* buf, int large) {
+    int in = -1, out = -1, status = HUFF_OK;
+    char* path = NULL;
+
+    if (!safeName(e->name)) {
+        fprintf(stderr, "%s: name would leave the output directory, skipped.\n", e->name);
+        return HUFF_ERR_ARGUMENT;
+    }
+    if (e->path != NULL && (in = open(e->path, O_RDONLY)) < 0) {
+        perror(e->path);
+        return HUFF_ERR_IO;
+    }
+
+    if (b->writing) {
+        status = large ? archiveLargeFile(b, e, in, enc) : archiveFile(b, e, in, enc, buf);
+    }
+    else if ((path = outputPath(b, e)) == NULL) {
+        status = HUFF_ERR_NOMEM;
+    }
+    else {
+        makeParents(path);
+        if ((out = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) < 0) {
+            perror(path);
+            status = HUFF_ERR_IO;
+        }
+        else if (b->compressing) {
+            status = huffCompressFd(enc, in, out);
+        }
+        else if (e->path != NULL) {
+            status = huffDecompressFd(dec, in, out);
+        }
+        else {
+            MemberSource src = { b->archiveFd, e->offset, e->packed };
+            status = huffDecompressStream(dec, readMember, &src, writeMember, &out);
+        }
+        if (out >= 0) {
+            struct stat st;
+            if (fstat(out, &st) == 0)
+                e->produced = (uint64_t)st.st_size;
+            close(out);
+        }
+    }
+
+    if (status != HUFF_OK)
+        fprintf(stderr, "%s: %s.\n", e->path != NULL ? e->path : e->name, huffErrorString(status));
+    free(path);
+    if (in >= 0)
+        close(in);
+    e->done = status == HUFF_OK;
+    return status;
+}
+
+// Function to take the next entry for a worker: its own queue first (oldest entry), then the
+// newest entry of another worker's queue; returns 0 when all queues are empty
+static int takeEntry(Batch* b, int self, size_t* item) {
+    for (int k = 0; k < b->workers; k++) {
+        WorkQueue* q = &b->queues[(self + k) % b->workers];
+        int found;
+        pthread_mutex_lock(&q->lock);
+        found = q->head < q->tail;
+        if (found)
+            *item = k == 0 ? q->items[q->head++] : q->items[--q->tail];
+        pthread_mutex_unlock(&q->lock);
+        if (found)
+            return 1;
+    }
+    return 0;
+}
+
+// Worker thread: process entries until every queue is empty
+static void* batchWorker(void* arg) {
+    BatchWorker* w = (BatchWorker*)arg;
+    size_t i;
+    while (takeEntry(w->b, w->self, &i)) {
+        if (processEntry(w->b, &w->b->entries.items[i], w->enc, w->dec, &w->buf, 0) != HUFF_OK)
+            __atomic_add_fetch(&w->b->failed, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Function to order entries by decreasing size, so the big ones start first
+static int bySizeDescending(const void* a, const void* b) {
+    uint64_t x = (*(const BatchEntry* const*)a)->size, y = (*(const BatchEntry* const*)b)->size;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Function to create the contexts of one worker (threads is the thread count of each context)
+static int createContexts(Batch* b, const HuffOptions* opts, int threads, const HuffDictionary* dict,
+                          HuffEncoder** enc, HuffDecoder** dec) {
+    HuffOptions o = *opts;
+    o.threads = threads;
+    // Small files are already overlapped with each other, so only the all-threads context reads ahead
+    o.asyncIo = threads == 1 ? 0 : opts->asyncIo;
+    *enc = NULL;
+    *dec = NULL;
+    if (b->compressing) {
+        *enc = huffEncoderCreate(&o);
+        return *enc != NULL && huffEncoderSetDictionary(*enc, dict) == HUFF_OK;
+    }
+    *dec = huffDecoderCreate(&o);
+    return *dec != NULL && huffDecoderSetDictionary(*dec, dict) == HUFF_OK;
+}
+
+// Function to run the batch
+int batch(int compressing, const char* source, const char* dest, const HuffOptions* opts,
+          const HuffDictionary* dict, int archive) {
+    Batch b;
+    BatchEntry** order = NULL;
+    BatchWorker* workers = NULL;
+    struct stat st;
+    struct timespec t0, t1;
+    uint64_t totalIn = 0, totalOut = 0, large = 0;
+    size_t small = 0, done = 0, i;
+    int started = 0, ok = 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    memset(&b, 0, sizeof(b));
+    b.compressing = compressing;
+    b.dest = dest;
+    b.archiveFd = -1;
+    b.workers = opts->threads > 0 ? opts->threads : (cpus > 0 ? (int)(cpus < HUFF_MAX_THREADS ? cpus : HUFF_MAX_THREADS) : 1);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // Collect the entries: an archive, a directory or a list of files
+    if (stat(source, &st) == 0 && S_ISDIR(st.st_mode)) {
+        ok = walkDirectory(&b.entries, source, "");
+    }
+    else if (!compressing && stat(source, &st) == 0 && S_ISREG(st.st_mode) &&
+             (b.archiveFd = open(source, O_RDONLY)) >= 0) {
+        unsigned char magic[4];
+        if (preadAll(b.archiveFd, magic, 4, 0) == 0 && memcmp(magic, "HUFA", 4) == 0) {
+            if (!readArchiveIndex(&b.entries, b.archiveFd)) {
+                fprintf(stderr, "%s: damaged archive index.\n", source);
+                ok = 0;
+            }
+        }
+        else {
+            close(b.archiveFd);
+            b.archiveFd = -1;
+            ok = readFileList(&b.entries, source);
+        }
+    }
+    else {
+        ok = readFileList(&b.entries, source);
+    }
+
+    // Output: an archive, or a directory that is created if needed
+    if (ok && archive) {
+        unsigned char hdr[ARCHIVE_HEADER_SIZE] = { 'H', 'U', 'F', 'A', ARCHIVE_VERSION, 0, 0, 0 };
+        b.archiveFd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (b.archiveFd < 0 || writeAll(b.archiveFd, hdr, ARCHIVE_HEADER_SIZE) != 0) {
+            perror(dest);
+            ok = 0;
+        }
+        b.writing = 1;
+        b.archiveEnd = ARCHIVE_HEADER_SIZE;
+    }
+    else if (ok) {
+        mkdir(dest, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+        if (stat(dest, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "%s: not a directory.\n", dest);
+            ok = 0;
+        }
+    }
+
+    // Small entries go to the workers' queues, largest first and dealt round robin; entries of
+    // many blocks are left for the end, where each one gets every thread
+    if (ok) {
+        uint64_t threshold = (uint64_t)opts->blockSize * LARGE_FILE_BLOCKS;
+        order = (BatchEntry**)malloc((b.entries.count + 1) * sizeof(BatchEntry*));
+        b.queues = (WorkQueue*)calloc((size_t)b.workers, sizeof(WorkQueue));
+        workers = (BatchWorker*)calloc((size_t)b.workers, sizeof(BatchWorker));
+        ok = order != NULL && b.queues != NULL && workers != NULL;
+        for (i = 0; ok && i < b.entries.count; i++)
+            order[i] = &b.entries.items[i];
+        if (ok)
+            qsort(order, b.entries.count, sizeof(BatchEntry*), bySizeDescending);
+        for (i = 0; ok && i < b.entries.count; i++) {
+            if (b.workers > 1 && order[i]->size >= threshold)
+                large++;
+        }
+        small = b.entries.count - (size_t)large;
+        for (int w = 0; ok && w < b.workers; w++) {
+            pthread_mutex_init(&b.queues[w].lock, NULL);
+            b.queues[w].items = (size_t*)malloc((small / (size_t)b.workers + 1) * sizeof(size_t));
+            ok = b.queues[w].items != NULL;
+        }
+        for (i = 0; ok && i < small; i++) {
+            WorkQueue* q = &b.queues[i % (size_t)b.workers];
+            q->items[q->tail++] = (size_t)(order[large + i] - b.entries.items);
+        }
+    }
+
+    // Small entries: one single-threaded context per worker
+    if (ok) {
+        pthread_mutex_init(&b.archiveLock, NULL);
+        for (int w = 0; w < b.workers && ok; w++) {
+            workers[w].b = &b;
+            workers[w].self = w;
+            if (!createContexts(&b, opts, 1, dict, &workers[w].enc, &workers[w].dec) ||
+                pthread_create(&workers[w].thread, NULL, batchWorker, &workers[w]) != 0) {
+                ok = 0;
+                break;
+            }
+            started++;
+        }
+        for (int w = 0; w < started; w++)
+            pthread_join(workers[w].thread, NULL);
+        if (started < b.workers)
+            fprintf(stderr, "Could not start the worker threads.\n");
+
+        // Large entries, one at a time with all threads working on its blocks
+        if (ok && large > 0) {
+            HuffEncoder* enc;
+            HuffDecoder* dec;
+            if (createContexts(&b, opts, opts->threads, dict, &enc, &dec)) {
+                for (i = 0; i < (size_t)large; i++) {
+                    if (processEntry(&b, order[i], enc, dec, &workers[0].buf, 1) != HUFF_OK)
+                        b.failed++;
+                }
+            }
+            else {
+                ok = 0;
+            }
+            huffEncoderFree(enc);
+            huffDecoderFree(dec);
+        }
+        pthread_mutex_destroy(&b.archiveLock);
+    }
+
+    if (ok && b.writing && b.archiveBroken) {
+        fprintf(stderr, "%s: a failed member could not be removed from the archive.\n", dest);
+        ok = 0;
+    }
+    if (ok && b.writing && !writeArchiveIndex(&b)) {
+        perror(dest);
+        ok = 0;
+    }
+
+    // Summary
+    for (i = 0; i < b.entries.count; i++) {
+        const BatchEntry* e = &b.entries.items[i];
+        if (!e->done)
+            continue;
+        done++;
+        totalIn += compressing ? e->size : (e->path != NULL ? e->size : e->packed);
+        totalOut += e->produced;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (ok)
+        printf("%s %zu of %zu files, %llu -> %llu bytes in %.2f s.\n", compressing ? "Compressed" : "Decompressed",
+               done, b.entries.count, (unsigned long long)totalIn, (unsigned long long)totalOut,
+               (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9);
+
+    // Release everything
+    for (int w = 0; workers != NULL && w < b.workers; w++) {
+        huffEncoderFree(workers[w].enc);
+        huffDecoderFree(workers[w].dec);
+        free(workers[w].buf.in);
+        free(workers[w].buf.out);
+    }
+    for (int w = 0; b.queues != NULL && w < b.workers; w++) {
+        if (b.queues[w].items != NULL)
+            pthread_mutex_destroy(&b.queues[w].lock);
+        free(b.queues[w].items);
+    }
+    for (i = 0; i < b.entries.count; i++) {
+        free(b.entries.items[i].path);
+        free(b.entries.items[i].name);
+    }
+    free(b.entries.items);
+    free(b.queues);
+    free(workers);
+    free(order);
+    if (b.archiveFd >= 0)
+        close(b.archiveFd);
+    return ok && b.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "huffman.h"
+
+// Compress (compressing = 1) or decompress every file named by source into dest, spreading
+// the files over worker threads.
+// source is a directory (walked recursively) or a text file listing one path per line ("-" for
+// standard input); when decompressing it may also be an archive. dest is a directory, or with
+// archive set (compressing only) the archive file receiving every compressed file.
+// dict may be NULL. Returns the process exit status (0 when every file succeeded)
+int batch(int compressing, const char* source, const char* dest, const HuffOptions* opts,
+          const HuffDictionary* dict, int archive);
+
+#endif
@@ -0,0 +1,664 @@
+// Benchmark for the compression library. It is built from the library source itself so the
+// internal phases (histogram, tree build, encode, header parse, decode, checksum) can be timed one by one
+// on the same inputs, next to the public buffer calls that chain them together.
+#include "huffman.c"
+
+#include <math.h>       // pow() for the skewed distributions
+#include <time.h>       // clock_gettime() for wall time
+
+// Cycle counts come from the time stamp counter where there is one
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define HAVE_CYCLE_COUNTER 1
+#endif
+
+#define BENCH_SEED 0x2545F4914F6CDD1Dull   // Fixed seed, so every run sees the same corpora
+#define BENCH_MIN_TIME 0.02                // Seconds each timed sample runs for at least
+#define BENCH_DEFAULT_SIZE (16 << 20)      // Bytes per synthetic corpus
+#define BENCH_DEFAULT_REPEAT 5             // Samples per phase (the fastest one is reported)
+#define SMALL_RECORD_MIN 64                // Record sizes of the small-file batch
+#define SMALL_RECORD_MAX 4096
+#define SMALL_BATCH_SIZE (1 << 20)         // Largest total of the small-file batch
+#define PHASE_COUNT 8
+
+// Phases reported for every corpus, in output order
+static const char* phaseNames[PHASE_COUNT] = {
+    "histogram", "tree", "encode", "header", "decode", "checksum", "compress", "decompress"
+};
+
+// One input of a corpus; the large corpora are a single record, the small-file batch many
+typedef struct Record {
+    const unsigned char* in;        // Uncompressed bytes
+    size_t n;                       // Number of bytes
+    uint64_t freq[256];             // Byte counts
+    code table[256];                // Canonical codes built from freq
+    unsigned char* header;          // Compact (format 2) header, magic excluded
+    size_t headerSize;
+    unsigned char* bits;            // Encoded bitstream
+    size_t bitsSize;
+    DecodeTable dt;                 // Decode table built from the header
+    unsigned char* packed;          // Block format (format 3) output of the public call
+    size_t packedSize;
+} Record;
+
+// A named set of records with its buffers
+typedef struct Corpus {
+    char name[64];
+    unsigned char* data;            // All records back to back
+    size_t size;
+    Record* records;
+    size_t count;
+} Corpus;
+
+// State shared by the phase functions
+typedef struct Bench {
+    Corpus* corpus;
+    int maxLen;                     // Longest code for the tree phase
+    int tableBits;                  // Decode table size for the header and decode phases
+    Writer out;                     // Reused output of the encode phase
+    unsigned char* plain;           // Output of the decode phases
+    HuffEncoder* enc;               // Contexts of the public calls
+    HuffDecoder* dec;
+    int status;                     // First error hit by a phase (HUFF_OK if none)
+    uint32_t sink;                  // Checksums of the checksum phase, kept so the work is not optimized away
+} Bench;
+
+// Result of one phase
+typedef struct PhaseResult {
+    double seconds;                 // Fastest time for the whole corpus
+    double cycles;                  // Time stamp counter ticks for it (0 if there is no counter)
+} PhaseResult;
+
+// Function to return the next value of the xorshift64* generator
+static uint64_t nextRandom(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+// Function to build the cumulative distribution of a Zipf law with exponent s over n ranks
+static void zipfTable(double* cdf, int n, double s) {
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += cdf[i] = 1.0 / pow(i + 1, s);
+    double acc = 0;
+    for (int i = 0; i < n; i++)
+        cdf[i] = (acc += cdf[i]) / sum;
+}
+
+// Function to draw a rank from a cumulative distribution
+static int drawRank(const double* cdf, int n, uint64_t* state) {
+    double u = (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Function to fill p with uniformly random bytes
+static void fillRandom(unsigned char* p, size_t n, uint64_t* state) {
+    for (size_t i = 0; i < n; i++)
+        p[i] = (unsigned char)(nextRandom(state) >> 56);
+}
+
+// Function to fill p with bytes drawn from a Zipf law over all 256 values in shuffled order
+static void fillZipf(unsigned char* p, size_t n, uint64_t* state) {
+    double cdf[256];
+    unsigned char order[256];
+    zipfTable(cdf, 256, 1.1);
+    for (int i = 0; i < 256; i++)
+        order[i] = (unsigned char)i;
+    for (int i = 255; i > 0; i--) {
+        int j = (int)(nextRandom(state) % (uint64_t)(i + 1));
+        unsigned char t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (size_t i = 0; i < n; i++)
+        p[i] = order[drawRank(cdf, 256, state)];
+}
+
+// Function to fill p with English-like text: Zipf-distributed words, sentences and lines
+static void fillText(unsigned char* p, size_t n, uint64_t* state) {
+    static const char* words[] = {
+        "the", "of", "and", "to", "a", "in", "is", "it", "that", "for", "was", "on", "with", "as",
+        "be", "at", "by", "this", "from", "or", "have", "an", "they", "which", "one", "you",
+        "were", "all", "we", "there", "been", "file", "data", "block", "code", "table", "tree",
+        "length", "symbol", "stream", "input", "output", "buffer", "compression", "frequency",
+        "decoder", "encoder", "header", "bytes", "memory", "thread", "index", "format", "value",
+        "number", "between", "through", "without", "because", "however", "therefore", "system"
+    };
+    const int count = (int)(sizeof(words) / sizeof(words[0]));
+    double cdf[sizeof(words) / sizeof(words[0])];
+    size_t pos = 0, line = 0;
+    int sentence = 0, capital = 1;
+
+    zipfTable(cdf, count, 1.0);
+    while (pos < n) {
+        const char* w = words[drawRank(cdf, count, state)];
+        for (size_t k = 0; w[k] != '\0' && pos < n; k++, line++)
+            p[pos++] = (unsigned char)(k == 0 && capital ? w[k] - 'a' + 'A' : w[k]);
+        capital = 0;
+        if (pos < n && ++sentence > 6 && nextRandom(state) % 4 == 0) {
+            p[pos++] = '.';
+            sentence = 0;
+            capital = 1;
+            line++;
+        }
+        else if (pos < n && nextRandom(state) % 12 == 0) {
+            p[pos++] = ',';
+            line++;
+        }
+        if (pos < n) {
+            p[pos++] = line > 70 ? '\n' : ' ';
+            line = line > 70 ? 0 : line + 1;
+        }
+    }
+}
+
+// Function to allocate a corpus of n bytes split into count records
+static int allocCorpus(Corpus* c, const char* name, size_t n, size_t count) {
+    memset(c, 0, sizeof(Corpus));
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->data = (unsigned char*)malloc(n ? n : 1);
+    c->records = (Record*)calloc(count ? count : 1, sizeof(Record));
+    c->size = n;
+    c->count = c->records != NULL ? count : 0;
+    return c->data != NULL && c->records != NULL;
+}
+
+// Function to generate one of the synthetic corpora; returns 0 for an unknown name
+static int generateCorpus(Corpus* c, const char* name, size_t size) {
+    uint64_t state = BENCH_SEED;
+
+    if (strcmp(name, "small") == 0) {
+        // Batch of small text records with sizes spread over [SMALL_RECORD_MIN, SMALL_RECORD_MAX]
+        size_t sizes = 0, count = 0;
+        uint64_t probe = BENCH_SEED;
+        if (size > SMALL_BATCH_SIZE)
+            size = SMALL_BATCH_SIZE;
+        while (sizes < size) {
+            sizes += SMALL_RECORD_MIN + nextRandom(&probe) % (SMALL_RECORD_MAX - SMALL_RECORD_MIN + 1);
+            count++;
+        }
+        if (!allocCorpus(c, name, sizes, count))
+            return -1;
+        probe = BENCH_SEED;
+        fillText(c->data, sizes, &state);
+        for (size_t i = 0, pos = 0; i < count; i++) {
+            c->records[i].in = c->data + pos;
+            c->records[i].n = SMALL_RECORD_MIN + nextRandom(&probe) % (SMALL_RECORD_MAX - SMALL_RECORD_MIN + 1);
+            pos += c->records[i].n;
+        }
+        return 1;
+    }
+
+    if (!allocCorpus(c, name, size, 1))
+        return -1;
+    c->records[0].in = c->data;
+    c->records[0].n = size;
+    if (strcmp(name, "random") == 0)
+        fillRandom(c->data, size, &state);
+    else if (strcmp(name, "zipf") == 0)
+        fillZipf(c->data, size, &state);
+    else if (strcmp(name, "text") == 0)
+        fillText(c->data, size, &state);
+    else if (strcmp(name, "single") == 0)
+        memset(c->data, 'a', size);
+    else
+        return 0;
+    return 1;
+}
+
+// Function to load a file as a corpus of one record
+static int loadCorpus(Corpus* c, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+        return 0;
+    size_t cap = 1 << 20, n = 0, got;
+    unsigned char* buf = (unsigned char*)malloc(cap);
+    while (buf != NULL && (got = fread(buf + n, 1, cap - n, f)) > 0) {
+        n += got;
+        if (n == cap) {
+            unsigned char* grown = (unsigned char*)realloc(buf, cap * 2);
+            if (grown == NULL)
+                free(buf);
+            buf = grown;
+            cap *= 2;
+        }
+    }
+    int ok = buf != NULL && !ferror(f);
+    fclose(f);
+    if (!ok || !allocCorpus(c, path, 0, 1)) {
+        free(buf);
+        return 0;
+    }
+    free(c->data);
+    c->data = buf;
+    c->size = n;
+    c->records[0].in = buf;
+    c->records[0].n = n;
+    return 1;
+}
+
+// Function to release a corpus and everything prepared for its records
+static void freeCorpus(Corpus* c) {
+    for (size_t i = 0; i < c->count; i++) {
+        free(c->records[i].header);
+        free(c->records[i].bits);
+        free(c->records[i].packed);
+        freeDecodeTable(&c->records[i].dt);
+    }
+    free(c->records);
+    free(c->data);
+}
+
+// Function to copy what a memory writer holds into a new buffer
+static unsigned char* takeOutput(const Writer* wr, size_t skip, size_t* size) {
+    *size = wr->pos - skip;
+    unsigned char* copy = (unsigned char*)malloc(*size ? *size : 1);
+    if (copy != NULL)
+        memcpy(copy, wr->buf + skip, *size);
+    return copy;
+}
+
+// Function to run every phase once per record, keeping the inputs the next phase needs and
+// checking that everything round-trips
+static int prepareCorpus(Bench* b) {
+    Corpus* c = b->corpus;
+    size_t largest = 1;
+    for (size_t i = 0; i < c->count; i++)
+        largest = c->records[i].n > largest ? c->records[i].n : largest;
+
+    // Output buffers sized for the largest record, so no phase has to grow them
+    free(b->plain);
+    closeWriter(&b->out);
+    b->plain = (unsigned char*)malloc(largest);
+    if (b->plain == NULL || openMemoryWriter(&b->out, largest / 8 * MAX_CODE_LEN + 1024, NULL) != HUFF_OK)
+        return HUFF_ERR_NOMEM;
+
+    for (size_t i = 0; i < c->count; i++) {
+        Record* r = &c->records[i];
+        int lengths[256];
+        uint64_t total;
+        int maxLen, status;
+        Reader rd;
+        Writer plain;
+
+        memset(r->freq, 0, sizeof(r->freq));
+        countBytes(r->in, r->n, r->freq);
+        buildLimitedCodeLengths(r->freq, b->maxLen, lengths);
+        assignCanonicalCodes(lengths, r->table);
+
+        rewindWriter(&b->out);
+        writeCompactHeader(&b->out, r->n, b->maxLen, r->table);
+        r->header = takeOutput(&b->out, 4, &r->headerSize);
+        openMemoryReader(&rd, r->in, r->n);
+        rewindWriter(&b->out);
+        if ((status = compressFile(&rd, &b->out, r->table)) != HUFF_OK)
+            return status;
+        r->bits = takeOutput(&b->out, 0, &r->bitsSize);
+
+        openMemoryReader(&rd, r->header, r->headerSize);
+        if ((status = readCompactHeader(&rd, &total, &maxLen, r->table)) != HUFF_OK ||
+            (status = buildDecodeTable(&r->dt, r->table, b->tableBits, NULL)) != HUFF_OK)
+            return status;
+        openMemoryReader(&rd, r->bits, r->bitsSize);
+        openFixedWriter(&plain, b->plain, largest);
+        if ((status = decompressFile(&rd, &plain, &r->dt, r->n)) != HUFF_OK)
+            return status;
+        if (plain.pos != r->n || memcmp(b->plain, r->in, r->n) != 0)
+            return HUFF_ERR_CORRUPT;
+
+        r->packed = (unsigned char*)malloc(huffCompressBound(b->enc, r->n));
+        if (r->packed == NULL)
+            return HUFF_ERR_NOMEM;
+        if ((status = huffCompressBuffer(b->enc, r->in, r->n, r->packed, huffCompressBound(b->enc, r->n), &r->packedSize)) != HUFF_OK)
+            return status;
+        size_t size;
+        if ((status = huffDecompressBuffer(b->dec, r->packed, r->packedSize, b->plain, largest, &size)) != HUFF_OK)
+            return status;
+        if (size != r->n || memcmp(b->plain, r->in, r->n) != 0)
+            return HUFF_ERR_CORRUPT;
+    }
+    return HUFF_OK;
+}
+
+// Phase: count the bytes of every record
+static void phaseHistogram(Bench* b) {
+    for (size_t i = 0; i < b->corpus->count; i++) {
+        Record* r = &b->corpus->records[i];
+        memset(r->freq, 0, sizeof(r->freq));
+        countBytes(r->in, r->n, r->freq);
+    }
+}
+
+// Phase: build the length-limited code lengths and canonical codes from the counts
+static void phaseTree(Bench* b) {
+    for (size_t i = 0; i < b->corpus->count; i++) {
+        Record* r = &b->corpus->records[i];
+        int lengths[256];
+        buildLimitedCodeLengths(r->freq, b->maxLen, lengths);
+        assignCanonicalCodes(lengths, r->table);
+    }
+}
+
+// Phase: encode every record with its table
+static void phaseEncode(Bench* b) {
+    for (size_t i = 0; i < b->corpus->count; i++) {
+        Record* r = &b->corpus->records[i];
+        Reader rd;
+        openMemoryReader(&rd, r->in, r->n);
+        rewindWriter(&b->out);
+        int status = compressFile(&rd, &b->out, r->table);
+        if (status != HUFF_OK && b->status == HUFF_OK)
+            b->status = status;
+    }
+}
+
+// Phase: parse the compact header and build the decode table
+static void phaseHeader(Bench* b) {
+    for (size_t i = 0; i < b->corpus->count; i++) {
+        Record* r = &b->corpus->records[i];
+        uint64_t total;
+        int maxLen;
+        Reader rd;
+        openMemoryReader(&rd, r->header, r->headerSize);
+        int status = readCompactHeader(&rd, &total, &maxLen, r->table);
+        if (status == HUFF_OK)
+            status = buildDecodeTable(&r->dt, r->table, b->tableBits, NULL);
+        if (status != HUFF_OK && b->status == HUFF_OK)
+            b->status = status;
+    }
+}
+
+// Phase: decode every bitstream
+static void phaseDecode(Bench* b) {
+    for (size_t i = 0; i < b->corpus->count; i++) {
+        Record* r = &b->corpus->records[i];
+        Reader rd;
+        Writer wr;
+        openMemoryReader(&rd, r->bits, r->bitsSize);
+        openFixedWriter(&wr, b->plain, r->n ? r->n : 1);
+        int status = decompressFile(&rd, &wr, &r->dt, r->n);
+        if (status != HUFF_OK && b->status == HUFF_OK)
+            b->status = status;
+    }
+}
+
+// Phase: CRC32C of every record, as taken for each block of the block format
+static void phaseChecksum(Bench* b) {
+    uint32_t crc = 0;
+    for (size_t i = 0; i < b->corpus->count; i++)
+        crc ^= crc32c(0, b->corpus->records[i].in, b->corpus->records[i].n);
+    b->sink ^= crc;
+}
+
+// Phase: public buffer compression with the block format (all phases chained)
+static void phaseCompress(Bench* b) {
+    for (size_t i = 0; i < b->corpus->count; i++) {
+        Record* r = &b->corpus->records[i];
+        int status = huffCompressBuffer(b->enc, r->in, r->n, r->packed, huffCompressBound(b->enc, r->n), &r->packedSize);
+        if (status != HUFF_OK && b->status == HUFF_OK)
+            b->status = status;
+    }
+}
+
+// Phase: public buffer decompression of the block format
+static void phaseDecompress(Bench* b) {
+    for (size_t i = 0; i < b->corpus->count; i++) {
+        Record* r = &b->corpus->records[i];
+        size_t size;
+        int status = huffDecompressBuffer(b->dec, r->packed, r->packedSize, b->plain, r->n ? r->n : 1, &size);
+        if (status != HUFF_OK && b->status == HUFF_OK)
+            b->status = status;
+    }
+}
+
+// Function to read the wall clock in seconds
+static double wallTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Function to read the cycle counter (0 where there is none)
+static uint64_t cycleCount(void) {
+#ifdef HAVE_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Function to time a phase: each sample repeats it until BENCH_MIN_TIME has passed, and the
+// fastest per-run time of `repeat` samples is kept, which filters out scheduling noise
+static PhaseResult timePhase(Bench* b, void (*phase)(Bench*), int repeat) {
+    PhaseResult best = { 0, 0 };
+    for (int s = 0; s < repeat; s++) {
+        long runs = 0;
+        double start = wallTime(), elapsed;
+        uint64_t ticks = cycleCount();
+        do {
+            phase(b);
+            runs++;
+        } while ((elapsed = wallTime() - start) < BENCH_MIN_TIME);
+        ticks = cycleCount() - ticks;
+        if (s == 0 || elapsed / runs < best.seconds) {
+            best.seconds = elapsed / runs;
+            best.cycles = (double)ticks / runs;
+        }
+    }
+    return best;
+}
+
+// Function to print one corpus as a table
+static void printText(const Corpus* c, const PhaseResult* res, double ratio, double blockRatio) {
+    printf("%s: %zu bytes in %zu record%s, ratio %.4f (single table), %.4f (blocks)\n",
+           c->name, c->size, c->count, c->count == 1 ? "" : "s", ratio, blockRatio);
+    printf("  %-12s %12s %12s %12s\n", "phase", "MB/s", "cycles/byte", "us/record");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double mbps = res[p].seconds > 0 ? c->size / res[p].seconds / 1e6 : 0;
+        printf("  %-12s %12.1f ", phaseNames[p], mbps);
+        if (res[p].cycles > 0 && c->size > 0)
+            printf("%12.3f ", res[p].cycles / c->size);
+        else
+            printf("%12s ", "-");
+        printf("%12.3f\n", res[p].seconds * 1e6 / c->count);
+    }
+}
+
+// Function to print a string as a JSON string literal
+static void printJsonString(const char* s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", (unsigned char)*s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+// Function to print one corpus as a JSON object on a single line (one line per corpus keeps
+// diffs between runs readable)
+static void printJson(const Corpus* c, const PhaseResult* res, double ratio, double blockRatio, int first) {
+    printf("%s{\"corpus\":", first ? "" : ",\n");
+    printJsonString(c->name);
+    printf(",\"bytes\":%zu,\"records\":%zu,\"ratio\":%.6f,\"block_ratio\":%.6f,\"phases\":{",
+           c->size, c->count, ratio, blockRatio);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double mbps = res[p].seconds > 0 ? c->size / res[p].seconds / 1e6 : 0;
+        printf("%s\"%s\":{\"mb_per_s\":%.2f,\"cycles_per_byte\":", p ? "," : "", phaseNames[p], mbps);
+        if (res[p].cycles > 0 && c->size > 0)
+            printf("%.4f", res[p].cycles / c->size);
+        else
+            printf("null");
+        printf(",\"us_per_record\":%.4f}", res[p].seconds * 1e6 / c->count);
+    }
+    printf("}}");
+}
+
+// Function to prepare and time one corpus, then print it
+static int benchCorpus(Bench* b, Corpus* c, int repeat, int json, int first) {
+    void (*phases[PHASE_COUNT])(Bench*) = {
+        phaseHistogram, phaseTree, phaseEncode, phaseHeader, phaseDecode, phaseChecksum, phaseCompress, phaseDecompress
+    };
+    PhaseResult res[PHASE_COUNT];
+    size_t packed = 0, blocks = 0;
+
+    b->corpus = c;
+    b->status = prepareCorpus(b);
+    if (b->status != HUFF_OK)
+        return b->status;
+    for (size_t i = 0; i < c->count; i++) {
+        packed += 4 + c->records[i].headerSize + c->records[i].bitsSize;
+        blocks += c->records[i].packedSize;
+    }
+    for (int p = 0; p < PHASE_COUNT && b->status == HUFF_OK; p++)
+        res[p] = timePhase(b, phases[p], repeat);
+    if (b->status != HUFF_OK)
+        return b->status;
+
+    double ratio = c->size ? (double)packed / c->size : 0;
+    double blockRatio = c->size ? (double)blocks / c->size : 0;
+    if (json)
+        printJson(c, res, ratio, blockRatio, first);
+    else
+        printText(c, res, ratio, blockRatio);
+    fflush(stdout);
+    return HUFF_OK;
+}
+
+// Function to parse a size such as 65536, 512K or 4M
+static size_t parseBenchSize(const char* s) {
+    char* end;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*end == 'K' || *end == 'k')
+        v <<= 10, end++;
+    else if (*end == 'M' || *end == 'm')
+        v <<= 20, end++;
+    return *end == '\0' ? (size_t)v : 0;
+}
+
+// Main function
+int main(int argc, char* argv[]) {
+    const char* corpora = NULL;
+    size_t size = BENCH_DEFAULT_SIZE;
+    int repeat = BENCH_DEFAULT_REPEAT, json = 0, files = 0, first = 1, failed = 0;
+    HuffOptions opts;
+    Bench b;
+
+    huffDefaultOptions(&opts);
+    opts.threads = 1;   // One thread by default, so phases and public calls compare directly
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--size=", 7) == 0)
+            size = parseBenchSize(argv[i] + 7);
+        else if (strncmp(argv[i], "--repeat=", 9) == 0)
+            repeat = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "--corpus=", 9) == 0)
+            corpora = argv[i] + 9;
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+            opts.threads = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "--max-code-len=", 15) == 0)
+            opts.maxCodeLen = atoi(argv[i] + 15);
+        else if (strncmp(argv[i], "--table-bits=", 13) == 0)
+            opts.tableBits = atoi(argv[i] + 13);
+        else if (strcmp(argv[i], "--json") == 0)
+            json = 1;
+        else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Usage: %s [options] [files...]\n"
+                            "  --corpus=LIST  Synthetic corpora: random,zipf,text,single,small (default all;\n"
+                            "                 none when files are given, unless listed)\n"
+                            "  --size=N       Bytes per synthetic corpus, K/M suffixes allowed (default 16M,\n"
+                            "                 at most 1M for the small-file batch)\n"
+                            "  --repeat=N     Timed samples per phase, fastest is reported (default 5)\n"
+                            "  --threads=N    Threads of the public calls (default 1)\n"
+                            "  --max-code-len=N, --table-bits=N  Codec settings (defaults as in huffman)\n"
+                            "  --json         One JSON object per corpus instead of tables\n", argv[0]);
+            return 1;
+        }
+        else
+            files++;
+    }
+    if (size == 0 || repeat < 1) {
+        fprintf(stderr, "Invalid size or repeat count\n");
+        return 1;
+    }
+    // All synthetic corpora unless files are given
+    if (corpora == NULL)
+        corpora = files > 0 ? "" : "random,zipf,text,single,small";
+
+    memset(&b, 0, sizeof(b));
+    b.maxLen = opts.maxCodeLen;
+    b.tableBits = opts.tableBits;
+    b.enc = huffEncoderCreate(&opts);
+    b.dec = huffDecoderCreate(&opts);
+    if (b.enc == NULL || b.dec == NULL) {
+        fprintf(stderr, "Invalid options\n");
+        return 1;
+    }
+
+    if (json)
+        printf("[\n");
+
+    // Synthetic corpora named in the list
+    while (*corpora != '\0') {
+        char name[32];
+        size_t len = strcspn(corpora, ",");
+        Corpus c;
+        snprintf(name, sizeof(name), "%.*s", (int)len, corpora);
+        corpora += corpora[len] == ',' ? len + 1 : len;
+        int status = generateCorpus(&c, name, size);
+        if (status == 0) {
+            fprintf(stderr, "Unknown corpus: %s\n", name);
+            freeCorpus(&c);
+            failed = 1;
+            continue;
+        }
+        status = status > 0 ? benchCorpus(&b, &c, repeat, json, first) : HUFF_ERR_NOMEM;
+        if (status != HUFF_OK) {
+            fprintf(stderr, "%s: %s\n", name, huffErrorString(status));
+            failed = 1;
+        }
+        else
+            first = 0;
+        freeCorpus(&c);
+    }
+
+    // Real files, one record each
+    for (int i = 1; i < argc; i++) {
+        Corpus c;
+        if (strncmp(argv[i], "--", 2) == 0)
+            continue;
+        if (!loadCorpus(&c, argv[i])) {
+            perror(argv[i]);
+            failed = 1;
+            continue;
+        }
+        int status = benchCorpus(&b, &c, repeat, json, first);
+        if (status != HUFF_OK) {
+            fprintf(stderr, "%s: %s\n", argv[i], huffErrorString(status));
+            failed = 1;
+        }
+        else
+            first = 0;
+        freeCorpus(&c);
+    }
+
+    if (json)
+        printf("\n]\n");
+    closeWriter(&b.out);
+    free(b.plain);
+    huffEncoderFree(b.enc);
+    huffDecoderFree(b.dec);
+    return failed;
+}
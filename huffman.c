@@ -0,0 +1,5551 @@
+#include <stdio.h>      // Standard I/O functions
+#include <stdlib.h>     // Standard library functions (e.g., malloc, free)
+#include <string.h>     // String manipulation functions
+#include <fcntl.h>      // File control options
+#include <unistd.h>     // UNIX standard functions
+#include <errno.h>      // errno values (EINTR retries in the I/O layer)
+#include <stdint.h>     // Fixed width integers for the bit accumulators
+#include <pthread.h>    // Worker threads for block compression
+#include <sys/stat.h>   // File status (used to detect regular files for mmap)
+#include <time.h>       // Clocks for the call statistics
+
+#ifndef _WIN32
+    #include <sys/mman.h>   // Memory-mapped input for regular files
+    #include <poll.h>       // Cancellable waits of the read-ahead on pipes
+#endif
+
+// On Linux, reads ahead and writes behind go through io_uring when the kernel offers it (5.6 or
+// later, driven with the raw system calls); the I/O threads remain the fallback
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #include <sys/syscall.h>
+        #if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+            #define HAVE_IO_URING 1
+        #endif
+    #endif
+#endif
+
+// The AVX2 histogram kernel and the SSE4.2 CRC32C are compiled in on x86-64 and chosen at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #include <immintrin.h>
+    #define HAVE_AVX2_HISTOGRAM 1
+    #define HAVE_SSE42_CRC 1
+#endif
+
+#include "huffman.h"
+
+// Define constants
+#define MAX 100         // Maximum size for arrays (used for binary code representation)
+#define IO_BUFFER_SIZE (1 << 20)  // Size of the buffered reader/writer buffers (1 MiB)
+#define DEFAULT_TABLE_BITS 11     // Bits resolved per decode table lookup (2^11 entries = 8 KiB)
+#define MIN_TABLE_BITS HUFF_MIN_TABLE_BITS
+#define MAX_TABLE_BITS HUFF_MAX_TABLE_BITS
+#define MAX_CODE_LEN HUFF_MAX_CODE_LEN  // Longest canonical code (lengths are stored as nibbles)
+#define MIN_CODE_LEN HUFF_MIN_CODE_LEN  // Shortest limit that still fits all 256 symbols
+#define DEFAULT_MAX_CODE_LEN 11   // Default limit, so every code fits the default decode table
+#define FORMAT_LEGACY HUFF_FORMAT_LEGACY
+#define FORMAT_CANONICAL HUFF_FORMAT_CANONICAL
+#define FORMAT_BLOCKS HUFF_FORMAT_BLOCKS
+#define FORMAT_DICTIONARY HUFF_FORMAT_DICTIONARY
+#define FORMAT_ADAPTIVE HUFF_FORMAT_ADAPTIVE
+#define COMPACT_TOTAL64 0x80      // Format 2: set in the length limit byte when a 64-bit total follows
+#define TABLE_SPARSE 0            // Code table stored as a symbol list
+#define TABLE_BITMAP 1            // Code table stored as a 256-bit presence map
+#define MAX_TABLE_SIZE (1 + 32 + 128)  // Largest serialized code table (type, bitmap, nibbles)
+#define BLOCK_HUFFMAN 0           // Block holds a code table and a Huffman bitstream
+#define BLOCK_STORED 1            // Block holds its bytes unchanged (incompressible data)
+#define BLOCK_RLE 2               // Block repeats the single byte held in its payload
+#define HUFFMAN_MIN_GAIN_SHIFT 6  // Huffman coding must save 1/64 of a block, or the block is stored
+#define BLOCK_END 0xFF            // Marks the end of the block sequence
+#define BLOCK_HEADER_SIZE 9       // Mode, raw size and payload size of a block
+#define FILE_HEADER_SIZE 10       // Magic, version, flags, code length limit, block size
+#define FLAG_INDEX 0x01           // Block container ends with a block index
+#define INDEX_ENTRY_SIZE 16       // Block offset (u64), payload size and raw size (u32 each)
+#define INDEX_TRAILER_SIZE 16     // Block count (u32), total raw size (u64), "HIDX"
+#define FLAG_SYNC 0x02            // Index is preceded by intra-block sync points
+#define FLAG_STREAMS 0x04         // Block payloads are split into interleaved bitstreams
+#define FLAG_CHECKSUM 0x08        // Every payload and the end marker are followed by a CRC32C
+#define CHECKSUM_SIZE 4           // CRC32C of a block's data (after its payload) or of all data (after the end marker)
+#define CRC32C_POLY 0x82F63B78u   // Castagnoli polynomial, bit reversed
+#define CRC_LANES_MIN 4096        // Shortest input split over three hardware CRC chains
+#define MAX_STREAMS HUFF_MAX_STREAMS
+#define DEFAULT_STREAMS 4         // Bitstreams per block written by default
+#define DICTIONARY_HEADER_SIZE 9  // "HUFD", code length limit and ID of a saved dictionary
+#define MAX_DICTIONARY_STREAM (64 << 20)  // Largest format 4 input read from a pipe (it is buffered whole)
+#define MAX_VARINT_SIZE 10        // Longest variable-length encoding of a 64-bit value
+#define DEFAULT_ADAPT_INTERVAL (16 << 10)  // Format 5: bytes coded between rebuilds once the model has settled
+#define MIN_ADAPT_INTERVAL HUFF_MIN_ADAPT_INTERVAL
+#define MAX_ADAPT_INTERVAL HUFF_MAX_ADAPT_INTERVAL
+#define ADAPT_FIRST_STEP 256      // Format 5: bytes before the first rebuild; the gap doubles up to the interval
+#define ADAPT_WINDOW (1 << 16)    // Format 5: counts are halved whenever they add up to more than this
+#define ADAPT_MAX_CHUNK (1 << 20) // Format 5: most bytes coded into one chunk
+#define MAX_JUMP_TABLE_SIZE (1 + 4 * (MAX_STREAMS - 1))  // Stream count and all but the last stream size
+#define DEFAULT_SYNC_INTERVAL (64 << 10)  // Uncompressed bytes between sync points
+#define MIN_SYNC_INTERVAL HUFF_MIN_SYNC_INTERVAL
+#define DEFAULT_BLOCK_SIZE (1 << 20)   // Uncompressed bytes per block (1 MiB)
+#define MIN_BLOCK_SIZE HUFF_MIN_BLOCK_SIZE
+#define MAX_BLOCK_SIZE HUFF_MAX_BLOCK_SIZE
+#define MAX_THREADS HUFF_MAX_THREADS
+#define MAX_TABLE_CACHE HUFF_MAX_TABLE_CACHE
+#define MAX_TREE_NODES (2 * 256 - 1)   // Nodes of a Huffman tree over 256 symbols
+#define MAX_LEGACY_CODE_LEN 31         // Longest code the original format can store
+#define MAX_DECODE_TREE_NODES (256 * MAX_LEGACY_CODE_LEN + 1)  // Worst case legacy decode tree
+#define HISTOGRAM_SPAN (1u << 30)      // Bytes counted per pass, so sub-histogram counters cannot overflow
+#define PARALLEL_HISTOGRAM_MIN (4 << 20)  // Smallest input counted on several threads
+#define HISTOGRAM_SLICE (16 << 20)  // Bytes per worker and round of a parallel frequency count
+#define MAPPED_WINDOW (16 << 20)  // Bytes of a file mapping read sequentially before the pages behind are dropped
+#define IO_THREADS 2              // One read and one write in flight per context, so neither waits behind the other
+#define READ_AHEAD_POLL_MS 10     // How often a read-ahead waiting on a pipe checks whether it was cancelled
+#define RING_ENTRIES 4            // io_uring queue size: a read, a write and a cancel in flight at most
+#define SEARCH_FILTER_BITS 57     // Pattern code bits matched per stream byte by the shift-and filter (64 - 7)
+#define ENCODE_SLICE (4 << 20)    // Bytes per worker and round when one bitstream is encoded in parallel
+#define PARALLEL_ENCODE_MIN (8 << 20)  // Smallest single-table input encoded on several threads
+#define isLeaf(node) ((node->l == NULL) && (node->r == NULL))  // Macro to check if a node is a leaf node
+#define isroot(node) ((node->f == NULL) && (node->r == NULL) && (node->g != '\0'))  // Macro to check if a node is a root node
+
+// Structure for Huffman Tree nodes used during compression
+struct Node {
+    char character;     // Character stored in this node
+    int freq;           // Frequency of the character
+    struct Node *l, *r; // Left and right child pointers
+};
+
+// Structure for Min Heap (Priority Queue)
+struct Min_Heap {
+    int size;           // Current size of the heap
+    int capacity;       // Maximum capacity of the heap
+    struct Node* array[256]; // Array of node pointers
+};
+
+// Flat storage for the nodes of one compression tree
+typedef struct NodePool {
+    struct Node nodes[MAX_TREE_NODES]; // Leaves first, then internal nodes
+    int used;           // Number of nodes handed out
+} NodePool;
+
+// Structure to store the packed Huffman code of one symbol
+typedef struct code {
+    uint64_t bits;      // Code bits, right aligned (first bit is the most significant)
+    int l;              // Length of the code (0 if the symbol does not occur)
+} code;
+
+// Shared code table of the dictionary format
+struct HuffDictionary {
+    uint32_t id;            // Hash of the code lengths, written in place of the table
+    int maxLen;             // Code length limit the table was built with
+    code table[256];        // Canonical codes, one for every byte value
+};
+
+// Structure for rebuilding Huffman tree during decompression
+typedef struct Tree {
+    char g;             // Character stored in this node
+    int len;            // Length of code for this character
+    int dec;            // Decimal representation of the code
+    struct Tree* f;     // Left child (represents 0 in code)
+    struct Tree* r;     // Right child (represents 1 in code)
+} Tree;
+
+// Heap allocation counters of one context
+typedef struct AllocStats {
+    uint64_t count;         // Allocations and reallocations
+    uint64_t bytes;         // Total bytes requested
+    uint64_t processed;     // Uncompressed bytes compressed or produced
+    uint64_t reused;        // Decode tables taken from a table cache instead of being built
+} AllocStats;
+
+// Buffered input stream; regular files are memory mapped when possible
+typedef struct Reader {
+    int fd;                 // Underlying file descriptor (-1 for memory buffers and callbacks)
+    HuffReadFn source;      // Callback supplying the bytes, or NULL
+    void* user;             // Argument passed to source
+    unsigned char* buf;     // Read buffer, or base of the mapping
+    size_t pos;             // Current position inside buf
+    size_t len;             // Number of valid bytes in buf
+    int mapped;             // 1 if buf holds the whole input (mapping or memory buffer)
+    int owned;              // 1 if buf is a mapping that must be released
+    size_t released;        // Mapped bytes before this offset have been dropped from memory
+    uint64_t loaded;        // Bytes read into buf so far (inputs that are not mapped)
+    int error;              // First error hit while reading (HUFF_OK if none)
+    struct ThreadPool* io;  // I/O thread reading the next buffer ahead, or NULL
+    struct IoRing* ring;    // io_uring reading the next buffer ahead instead, or NULL
+    int64_t at;             // File offset of the next read ahead, -1 for pipes (read at the current position)
+    unsigned char* ahead;   // Buffer filled ahead while buf is consumed
+    struct Task* fill;      // Read in flight (valid while pending is set)
+    long got;               // Bytes that read returned (0 at end of file, -1 on error)
+    int pending;            // 1 while a read-ahead has been queued and not waited for
+    int cancel;             // Set to make a read-ahead waiting on a pipe give up
+} Reader;
+
+// Buffered output stream
+typedef struct Writer {
+    int fd;                 // Underlying file descriptor (-1 for memory buffers and callbacks)
+    HuffWriteFn sink;       // Callback consuming the bytes, or NULL
+    void* user;             // Argument passed to sink
+    unsigned char* buf;     // Write buffer
+    size_t pos;             // Number of bytes pending in buf
+    size_t cap;             // Size of buf
+    uint64_t written;       // Bytes already flushed
+    int growable;           // 1 if buf grows instead of being flushed
+    AllocStats* stats;      // Counters charged when buf grows
+    int owned;              // 1 if buf was allocated by the writer (memory writers)
+    int discard;            // 1 if the output is dropped (verification only decodes)
+    int error;              // First error hit while writing (HUFF_OK if none)
+    struct ThreadPool* io;  // I/O thread writing full buffers, or NULL
+    struct IoRing* ring;    // io_uring writing full buffers instead, or NULL
+    int64_t at;             // File offset of the next write behind, -1 for pipes (written at the current position)
+    unsigned char* spare;   // Buffer filled while the other one is written
+    struct Task* drain;     // Write in flight (valid while pending is set)
+    size_t outLen;          // Bytes of spare being written
+    int outError;           // Set by the I/O thread if the write failed
+    int pending;            // 1 while a write has been queued and not waited for
+} Writer;
+
+// 64-bit bit reader used by the decoder
+typedef struct BitReader {
+    uint64_t acc;           // Buffered bits, left aligned (next bit is the MSB)
+    int count;              // Number of valid bits in acc
+    Reader* rd;             // Source of the compressed bytes
+    int pad;                // Zero bits added past the end of the input (decoding them means it was cut short)
+} BitReader;
+
+// Entry of the multi-symbol decode table, indexed by the next tableBits bits
+typedef struct DecodeEntry {
+    unsigned char sym[2];   // Up to two decoded characters
+    unsigned char len1;     // Code length of sym[0] (0 means the code is longer than the table)
+    unsigned char nbits;    // Bits consumed when both symbols are used (== len1 for one symbol)
+} DecodeEntry;
+
+// Everything needed to decode with one code table
+typedef struct TableCache TableCache;
+
+typedef struct DecodeTable {
+    DecodeEntry* entries;   // 2^bits lookup entries
+    int bits;               // Number of bits resolved per lookup
+    Tree* root;             // Decode tree for non-canonical (legacy) codes, NULL otherwise
+    int maxLen;             // Longest canonical code
+    uint32_t firstCode[MAX_CODE_LEN + 1];   // First canonical code of each length
+    int firstIndex[MAX_CODE_LEN + 1];       // Position of that code's symbol in sorted[]
+    int count[MAX_CODE_LEN + 1];            // Number of codes of each length
+    unsigned char sorted[256];              // Symbols in canonical order
+    AllocStats* stats;      // Counters charged when entries are allocated
+    TableCache* cache;      // Tables this thread built recently (NULL = build every table)
+} DecodeTable;
+
+// A decode table kept by a table cache, with the code lengths it was built from
+typedef struct CachedTable {
+    DecodeTable dt;
+    uint32_t hash;              // hashCodeLengths() of the table bits and lengths
+    unsigned char lengths[256];
+    uint64_t used;              // Cache clock when the table was last in use
+} CachedTable;
+
+// Least recently used decode tables of one decoding thread; the table in use stays in the
+// owning DecodeTable and trades places with a slot when another one is loaded
+struct TableCache {
+    CachedTable* slots;
+    int count;                  // Slots holding a table
+    int cap;
+    int hasCurrent;             // 1 if the owner's table was built from the lengths below
+    uint32_t hash;
+    unsigned char lengths[256];
+    uint64_t clock;
+};
+
+// Where the bitstreams of one block payload start and which bytes each one holds
+typedef struct StreamLayout {
+    int count;              // Number of streams (1 for payloads without a jump table)
+    size_t segment;         // Uncompressed bytes per stream (the last may hold fewer)
+    size_t begin[MAX_STREAMS + 1]; // Payload offset of each stream, then the payload size
+} StreamLayout;
+
+// One bitstream of a block while several are decoded together
+typedef struct Lane {
+    uint64_t acc;           // Buffered bits, left aligned (next bit is the MSB)
+    int count;              // Number of valid bits in acc
+    const unsigned char* in; // Next stream byte not yet in acc
+    const unsigned char* end; // End of the stream
+    unsigned char* out;     // Next output byte
+    unsigned char* stop;    // End of this stream's share of the output
+} Lane;
+
+// 64-bit bit accumulator used by the encoder, emits whole 32-bit words
+typedef struct BitWriter {
+    uint64_t acc;           // Pending bits, right aligned
+    int count;              // Number of pending bits in acc (always < 32 between calls)
+    Writer* wr;             // Destination of the completed words
+} BitWriter;
+
+// Running model of the adaptive format, updated in lockstep by the encoder and the decoder
+typedef struct AdaptiveModel {
+    uint64_t freq[256];     // Counts of the bytes coded so far (aged), at least 1 for every value
+    code table[256];        // Codes in use until the next rebuild
+    int maxLen;             // Code length limit
+    size_t interval;        // Longest gap between rebuilds
+    size_t step;            // Gap between the last rebuild and the next
+    size_t left;            // Bytes still to code before the next rebuild
+} AdaptiveModel;
+
+// Unit of work executed by the thread pool
+typedef struct Task {
+    void (*run)(void* arg); // Function executed by a worker
+    void* arg;              // Argument passed to run
+    int done;               // Set once run() has returned
+    struct Task* next;      // Next task in the pool queue
+} Task;
+
+// Fixed set of worker threads consuming a FIFO of tasks
+typedef struct ThreadPool {
+    pthread_t* threads;     // Worker thread handles
+    int count;              // Number of workers
+    pthread_mutex_t lock;   // Protects the queue and the done flags
+    pthread_cond_t wake;    // Signalled when a task is queued or the pool stops
+    pthread_cond_t finished; // Broadcast whenever a task completes
+    Task* head;             // Oldest queued task
+    Task* tail;             // Newest queued task
+    int stop;               // Set to make the workers exit
+} ThreadPool;
+
+// Operations a context has in flight on its io_uring, identified by their user_data
+enum { RING_READ, RING_WRITE, RING_CANCEL, RING_SLOTS };
+
+// io_uring instance of a context, used from the context's calling thread only
+typedef struct IoRing {
+    int fd;                 // Ring file descriptor
+    unsigned char* sq;      // Submission ring mapping
+    size_t sqSize;
+    unsigned char* cq;      // Completion ring mapping
+    size_t cqSize;
+    void* sqes;             // Submission entries mapping
+    size_t sqesSize;
+    unsigned* sqTail;       // Submission ring fields inside sq
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;       // Completion ring fields inside cq
+    unsigned* cqTail;
+    unsigned* cqMask;
+    void* cqes;             // Completion entries inside cq
+    int done[RING_SLOTS];   // Set once the operation of a slot has completed
+    int res[RING_SLOTS];    // Its result: bytes transferred or -errno
+} IoRing;
+
+// Worker threads owned by a codec context, started by the first call that needs them
+typedef struct Workers {
+    ThreadPool pool;        // The threads, valid once started is set
+    int started;            // 1 while the pool is running
+    int count;              // Number of threads to use (1 = run everything on the caller)
+} Workers;
+
+// Counters of the call in progress, shared by all threads of a context that collects statistics
+typedef struct CallStats {
+    uint64_t phaseWall[HUFF_PHASE_COUNT]; // Nanoseconds of each phase, summed over threads
+    uint64_t phaseCpu[HUFF_PHASE_COUNT];  // Thread CPU nanoseconds of each phase
+    uint64_t symbols[4];    // Bit set of the byte values seen
+    uint64_t codedBits;     // Bitstream bits of the Huffman coded bytes
+    uint64_t codedBytes;    // Bytes those bits hold
+    uint64_t blocks;        // Blocks (1 for the single-table formats)
+    uint64_t storedBlocks;  // Blocks kept unchanged
+    uint64_t rleBlocks;     // Blocks of one repeated byte
+    int maxCodeLen;         // Longest code used
+} CallStats;
+
+// Start of the phase being timed
+typedef struct PhaseMark {
+    uint64_t wall;          // Monotonic clock
+    uint64_t cpu;           // CPU clock of the thread
+} PhaseMark;
+
+// One block in flight through the compression pipeline
+typedef struct BlockJob {
+    Task task;              // Pool task running compressBlockTask
+    const HuffOptions* opts; // Encoder settings
+    const unsigned char* in; // Uncompressed block (points into the mapping or into copy)
+    unsigned char* copy;    // Private buffer for inputs that are not mapped
+    size_t n;               // Uncompressed size
+    Writer out;             // Compressed payload (code lengths and bitstream)
+    uint32_t* sync;         // Bit offsets of the sync points inside the payload
+    size_t syncCount;       // Number of sync points recorded for this block
+    int mode;               // BLOCK_HUFFMAN, BLOCK_STORED or BLOCK_RLE
+    uint32_t crc;           // CRC32C of the block (when the encoder writes checksums)
+    CallStats* cs;          // Statistics of the call, or NULL when they are off
+} BlockJob;
+
+// One slice of a parallel frequency count
+typedef struct HistogramJob {
+    Task task;              // Pool task running countBytesTask
+    const unsigned char* in; // Bytes to count
+    size_t n;               // Number of bytes
+    uint64_t freq[256];     // Counts of this slice
+    CallStats* cs;          // Statistics of the call, or NULL when they are off
+} HistogramJob;
+
+// One slice of a single bitstream encoded in parallel
+typedef struct EncodeJob {
+    Task task;              // Pool task (measureSliceTask, then encodeSliceTask)
+    const code* table;      // Code table shared by all slices
+    const unsigned char* in; // Bytes of this slice
+    size_t n;               // Number of bytes
+    uint64_t bits;          // Encoded size of the slice in bits
+    int align;              // Bit position inside its first byte where the slice starts
+    Writer out;             // Encoded slice; partial first and last bytes are zero padded
+    CallStats* cs;          // Statistics of the call, or NULL when they are off
+} EncodeJob;
+
+// Location of one block inside a block container
+typedef struct BlockIndexEntry {
+    uint64_t offset;        // File offset of the block header
+    uint64_t rawOffset;     // Offset of the block's data in the uncompressed output
+    uint32_t compSize;      // Payload size (code lengths and bitstream)
+    uint32_t rawSize;       // Uncompressed size
+    size_t firstSync;       // Position of the block's first sync point in BlockIndex.sync
+} BlockIndexEntry;
+
+// Index of all blocks, written after the end marker
+typedef struct BlockIndex {
+    BlockIndexEntry* entries; // One entry per block, in file order
+    size_t count;           // Number of blocks
+    size_t cap;             // Allocated entries
+    uint64_t totalRaw;      // Total uncompressed size
+    uint32_t checksum;      // CRC32C of the data of all blocks added so far (written with checksums)
+    uint32_t syncInterval;  // Uncompressed bytes between sync points (0 if there are none)
+    uint32_t* sync;         // Payload bit offset of every sync point, block after block
+    size_t syncCount;       // Number of sync points
+    size_t syncCap;         // Allocated sync points
+    AllocStats* stats;      // Counters charged when the arrays grow
+} BlockIndex;
+
+// State shared by the workers of a parallel decompression
+typedef struct ParallelDecode {
+    const unsigned char* base; // Mapped compressed file
+    size_t size;            // Size of the compressed file
+    const BlockIndex* index; // Blocks to decode
+    int maxLen;             // Code length limit from the file header
+    int flags;              // File header flags
+    int tableBits;          // Decode table size
+    int release;            // 1 if base is a file mapping whose pages are dropped once decoded
+    int fd;                 // Output file, written with pwrite() (-1 when decoding into target)
+    unsigned char* target;  // Output buffer holding the whole result, or NULL
+    size_t next;            // Next block to be claimed by a worker
+    pthread_mutex_t lock;   // Protects next
+} ParallelDecode;
+
+// One decoding worker (or one block in flight when output must be written in order)
+typedef struct DecodeJob {
+    Task task;              // Pool task
+    ParallelDecode* shared; // Shared decompression state
+    size_t block;           // Block decoded by this job (ordered mode)
+    DecodeTable dt;         // Private decode table
+    Writer out;             // Decoded bytes
+    const unsigned char* payload; // Block payload (streaming mode)
+    unsigned char* copy;    // Private payload buffer for inputs that are not mapped
+    size_t copyCap;         // Size of copy
+    size_t compSize;        // Payload size (streaming mode)
+    size_t rawSize;         // Uncompressed size (streaming mode)
+    int maxLen;             // Code length limit (streaming mode)
+    int flags;              // File header flags (streaming mode)
+    int tableBits;          // Decode table size (streaming mode)
+    int mode;               // Block mode (streaming mode)
+    uint32_t crc;           // CRC32C stored after the payload (streaming mode, checksummed files)
+    int status;             // Result of the last block decoded by this job
+    CallStats* cs;          // Statistics of the call, or NULL when they are off
+} DecodeJob;
+
+// Search state shared by the workers scanning the blocks of an indexed container
+typedef struct ParallelSearch {
+    const unsigned char* base; // Mapped compressed file
+    const BlockIndex* index; // Blocks to search
+    int maxLen;             // Code length limit from the file header
+    int flags;              // File header flags
+    int tableBits;          // Decode table size
+    int release;            // 1 if base is a file mapping whose pages are dropped once searched
+    const unsigned char* pattern; // Bytes searched for
+    size_t len;             // Pattern length (1 to HUFF_MAX_PATTERN)
+} ParallelSearch;
+
+// One block being searched
+typedef struct SearchJob {
+    Task task;              // Pool task
+    ParallelSearch* shared; // Shared search state
+    size_t block;           // Block searched by this job
+    DecodeTable dt;         // Private decode table
+    Writer out;             // Decoded block, followed by the bytes after it
+    uint64_t masks[256];    // Shift-and masks of the pattern under the block's code table
+    uint64_t* hits;         // Offsets (inside the block) of the matches starting in it
+    size_t hitCount;        // Matches in hits
+    size_t hitCap;          // Room in hits
+    AllocStats* stats;      // Counters charged when hits grows
+    int status;             // Result of the search of the block
+} SearchJob;
+
+// Matches found while a decoded stream is handed over chunk by chunk
+typedef struct SearchSink {
+    const unsigned char* pattern; // Bytes searched for
+    size_t len;             // Pattern length
+    unsigned char carry[2 * HUFF_MAX_PATTERN]; // Last bytes seen, where a match may begin
+    size_t carryLen;        // Bytes in carry (less than len once a chunk has been scanned)
+    uint64_t offset;        // Uncompressed offset of carry[0]
+    HuffMatchFn match;      // Callback receiving the matches
+    void* user;             // Argument passed to match
+    int stopped;            // Set once match asked to stop
+} SearchSink;
+
+// Everything a context allocates, kept between calls so the steady state does not allocate
+typedef struct Workspace {
+    AllocStats stats;       // Allocation counters
+    unsigned char* inBuf;   // Read buffer for inputs that are not mapped
+    unsigned char* outBuf;  // Write buffer for file and callback outputs
+    BlockIndex index;       // Block index, emptied before each use
+    BlockJob* blockJobs;    // Compression ring
+    int blockJobCount;      // Jobs in blockJobs
+    DecodeJob* decodeJobs;  // Decompression jobs
+    int decodeJobCount;     // Jobs in decodeJobs
+    DecodeTable dt;         // Table for single-table files and range extraction
+    Writer scratch;         // Decoded prefix of a range extraction, a dictionary format input, or
+                            // one chunk of an adaptive format file
+    Tree* treeNodes;        // Node pool of the legacy decode tree
+    int treeUsed;           // Nodes handed out from treeNodes
+    HistogramJob* histJobs; // Slices of a parallel frequency count (one per worker)
+    EncodeJob* encodeJobs;  // Slices of a bitstream encoded in parallel (one per worker)
+    int encodeJobCount;     // Jobs in encodeJobs
+    DecodeTable dictDt;     // Decode table of the dictionary attached to a decoder
+    CallStats call;         // Counters of the call in progress
+    CallStats* cs;          // &call when the context collects statistics, otherwise NULL
+    HuffStats last;         // Statistics of the last finished call
+    int asyncIo;            // HuffOptions.asyncIo: 0 synchronous, 1 io_uring or I/O threads, 2 I/O threads
+    IoRing ring;            // The io_uring, valid while ringState is 1
+    int ringState;          // 0 not tried yet, 1 running, -1 unavailable
+    ThreadPool io;          // The I/O threads, valid once ioStarted is set
+    int ioStarted;          // 1 while the I/O threads are running
+    unsigned char* inAhead; // Second read buffer, filled by an I/O thread
+    unsigned char* outSpare; // Second write buffer, written by an I/O thread
+    Task readTask;          // Read-ahead of the reader in use
+    Task writeTask;         // Write of the writer in use
+    SearchJob* searchJobs;  // Blocks of a search in flight
+    int searchJobCount;     // Jobs in searchJobs
+    int checked;            // 1 if the last decompression verified checksums
+} Workspace;
+
+// Encoder context: settings, worker threads and buffers reused across calls
+struct HuffEncoder {
+    HuffOptions opts;       // Settings given at creation
+    Workers workers;        // Block compression threads
+    Workspace ws;           // Buffers and counters
+    HuffDictionary dict;    // Copy of the attached dictionary
+    int hasDict;            // 1 if dict is set
+};
+
+// Decoder context: settings, worker threads and buffers reused across calls
+struct HuffDecoder {
+    HuffOptions opts;       // Settings given at creation
+    Workers workers;        // Block decompression threads
+    Workspace ws;           // Buffers and counters
+    HuffDictionary dict;    // Copy of the attached dictionary (its decode table is ws.dictDt)
+    int hasDict;            // 1 if dict is set
+};
+
+// Function to allocate or resize a buffer, charging the allocation to stats (if not NULL)
+static void* allocBuffer(AllocStats* stats, void* old, size_t size) {
+    void* p = realloc(old, size);
+    if (p != NULL && stats != NULL) {
+        // Decode workers may allocate at the same time
+        __atomic_fetch_add(&stats->count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats->bytes, (uint64_t)size, __ATOMIC_RELAXED);
+    }
+    return p;
+}
+
+// Function to get one of the context's I/O buffers, allocating it on first use
+static unsigned char* ioBuffer(Workspace* ws, unsigned char** slot) {
+    if (*slot == NULL)
+        *slot = (unsigned char*)allocBuffer(&ws->stats, NULL, IO_BUFFER_SIZE);
+    return *slot;
+}
+
+// Thread pool functions used by the I/O layer (defined with the pool below)
+static int startPool(ThreadPool* pool, int count, AllocStats* stats);
+static void submitTask(ThreadPool* pool, Task* task);
+static void waitTask(ThreadPool* pool, Task* task);
+
+#ifdef HAVE_IO_URING
+// Function to release an io_uring set up by openRing()
+static void closeRing(IoRing* r) {
+    if (r->sqes != NULL && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqesSize);
+    if (r->cq != NULL && r->cq != MAP_FAILED)
+        munmap(r->cq, r->cqSize);
+    if (r->sq != NULL && r->sq != MAP_FAILED)
+        munmap(r->sq, r->sqSize);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(IoRing));
+    r->fd = -1;
+}
+
+// Function to set up an io_uring and map its rings, fails on kernels without io_uring (or
+// before 5.6, which lack reads and writes at the current file position) and where it is blocked
+static int openRing(IoRing* r) {
+    struct io_uring_params p;
+    memset(r, 0, sizeof(IoRing));
+    memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+    if (r->fd < 0 || !(p.features & IORING_FEAT_RW_CUR_POS)) {
+        closeRing(r);
+        return HUFF_ERR_UNSUPPORTED;
+    }
+    r->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sq = (unsigned char*)mmap(NULL, r->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                                 IORING_OFF_SQ_RING);
+    r->cq = (unsigned char*)mmap(NULL, r->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                                 IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sq == MAP_FAILED || r->cq == MAP_FAILED || r->sqes == MAP_FAILED) {
+        closeRing(r);
+        return HUFF_ERR_NOMEM;
+    }
+    r->sqTail = (unsigned*)(r->sq + p.sq_off.tail);
+    r->sqMask = (unsigned*)(r->sq + p.sq_off.ring_mask);
+    r->sqArray = (unsigned*)(r->sq + p.sq_off.array);
+    r->cqHead = (unsigned*)(r->cq + p.cq_off.head);
+    r->cqTail = (unsigned*)(r->cq + p.cq_off.tail);
+    r->cqMask = (unsigned*)(r->cq + p.cq_off.ring_mask);
+    r->cqes = r->cq + p.cq_off.cqes;
+    return HUFF_OK;
+}
+
+// Function to queue one operation on the ring and submit it; a submission the kernel refuses
+// completes at once with its error
+static void ringSubmit(IoRing* r, int slot, int op, int fd, const void* buf, size_t len, int64_t offset,
+                       uint64_t target) {
+    unsigned tail = *r->sqTail;
+    unsigned i = tail & *r->sqMask;
+    struct io_uring_sqe* sqe = (struct io_uring_sqe*)r->sqes + i;
+    long ret;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)op;
+    sqe->fd = fd;
+    sqe->addr = op == IORING_OP_ASYNC_CANCEL ? target : (uint64_t)(uintptr_t)buf;
+    sqe->len = (unsigned)len;
+    sqe->off = (uint64_t)offset;      // -1 reads or writes at the current file position
+    sqe->user_data = (uint64_t)slot;
+    r->sqArray[i] = i;
+    r->done[slot] = 0;
+    __atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+    do {
+        ret = syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 1) {
+        // Take the entry back so a later submission does not send it
+        __atomic_store_n(r->sqTail, tail, __ATOMIC_RELEASE);
+        r->res[slot] = ret < 0 ? -errno : -EIO;
+        r->done[slot] = 1;
+    }
+}
+
+// Function to wait until the operation of a slot completes, returns its result
+static int ringWait(IoRing* r, int slot) {
+    while (!r->done[slot]) {
+        unsigned head = *r->cqHead;
+        if (head == __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE)) {
+            if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+                r->res[slot] = -errno;
+                break;
+            }
+            continue;
+        }
+        const struct io_uring_cqe* cqe = (const struct io_uring_cqe*)r->cqes + (head & *r->cqMask);
+        if (cqe->user_data < RING_SLOTS) {
+            r->res[cqe->user_data] = cqe->res;
+            r->done[cqe->user_data] = 1;
+        }
+        __atomic_store_n(r->cqHead, head + 1, __ATOMIC_RELEASE);
+    }
+    return r->res[slot];
+}
+#endif
+
+// Function to get the context's io_uring, setting it up on first use; returns NULL when the
+// kernel does not offer it or the context uses the I/O threads
+static IoRing* ioRing(Workspace* ws) {
+#ifdef HAVE_IO_URING
+    if (ws->asyncIo != 1)
+        return NULL;
+    if (ws->ringState == 0)
+        ws->ringState = openRing(&ws->ring) == HUFF_OK ? 1 : -1;
+    return ws->ringState == 1 ? &ws->ring : NULL;
+#else
+    (void)ws;
+    return NULL;
+#endif
+}
+
+// Function to get the context's I/O threads, starting them on first use; returns NULL when
+// I/O stays on the calling thread
+static ThreadPool* ioThreads(Workspace* ws) {
+    if (!ws->asyncIo)
+        return NULL;
+    if (!ws->ioStarted) {
+        // Without threads, I/O simply stays synchronous
+        if (startPool(&ws->io, IO_THREADS, &ws->stats) != HUFF_OK) {
+            ws->asyncIo = 0;
+            return NULL;
+        }
+        ws->ioStarted = 1;
+    }
+    return &ws->io;
+}
+
+// Function to get the file offset where positional reads or writes of fd start, -1 for pipes
+// and other descriptors without one
+static int64_t fileOffset(int fd) {
+    struct stat st;
+    off_t at;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (at = lseek(fd, 0, SEEK_CUR)) < 0)
+        return -1;
+    return (int64_t)at;
+}
+
+// I/O thread task: read the next buffer of a reader into rd->ahead. The descriptor is polled first
+// so that a read-ahead left waiting on a pipe whose writer has gone quiet can be cancelled
+static void readAheadTask(void* arg) {
+    Reader* rd = (Reader*)arg;
+    long n;
+#ifndef _WIN32
+    struct pollfd pfd;
+    int ready;
+    pfd.fd = rd->fd;
+    pfd.events = POLLIN;
+    do {
+        if (__atomic_load_n(&rd->cancel, __ATOMIC_ACQUIRE)) {
+            rd->got = 0;
+            return;
+        }
+        ready = poll(&pfd, 1, READ_AHEAD_POLL_MS);
+    } while (ready == 0 || (ready < 0 && errno == EINTR));
+#endif
+    do {
+        if (rd->at >= 0)
+            n = (long)pread(rd->fd, rd->ahead, IO_BUFFER_SIZE, (off_t)rd->at);
+        else
+            n = (long)read(rd->fd, rd->ahead, IO_BUFFER_SIZE);
+    } while (n < 0 && errno == EINTR);
+    rd->got = n;
+}
+
+// Function to start reading the next buffer ahead, on the io_uring or the I/O thread
+static void startReadAhead(Reader* rd) {
+    rd->pending = 1;
+#ifdef HAVE_IO_URING
+    if (rd->ring != NULL) {
+        ringSubmit(rd->ring, RING_READ, IORING_OP_READ, rd->fd, rd->ahead, IO_BUFFER_SIZE, rd->at, 0);
+        return;
+    }
+#endif
+    rd->fill->run = readAheadTask;
+    rd->fill->arg = rd;
+    submitTask(rd->io, rd->fill);
+}
+
+// Function to wait for the read started by startReadAhead(), returns its byte count (-1 on error)
+static long finishReadAhead(Reader* rd) {
+    long n;
+    rd->pending = 0;
+#ifdef HAVE_IO_URING
+    if (rd->ring != NULL) {
+        while ((n = ringWait(rd->ring, RING_READ)) == -EINTR || n == -EAGAIN)
+            ringSubmit(rd->ring, RING_READ, IORING_OP_READ, rd->fd, rd->ahead, IO_BUFFER_SIZE, rd->at, 0);
+        if (n < 0)
+            n = -1;
+    }
+    else
+#endif
+    {
+        waitTask(rd->io, rd->fill);
+        n = rd->got;
+    }
+    if (n > 0 && rd->at >= 0)
+        rd->at += n;
+    return n;
+}
+
+// Function to wait for a queued read-ahead and throw its bytes away (rewind and close)
+static void cancelReadAhead(Reader* rd) {
+    if (!rd->pending)
+        return;
+    rd->pending = 0;
+#ifdef HAVE_IO_URING
+    if (rd->ring != NULL) {
+        // A read of a quiet pipe would never complete on its own
+        ringSubmit(rd->ring, RING_CANCEL, IORING_OP_ASYNC_CANCEL, -1, NULL, 0, 0, RING_READ);
+        ringWait(rd->ring, RING_READ);
+        ringWait(rd->ring, RING_CANCEL);
+        return;
+    }
+#endif
+    __atomic_store_n(&rd->cancel, 1, __ATOMIC_RELEASE);
+    waitTask(rd->io, rd->fill);
+    rd->cancel = 0;
+}
+
+// I/O thread task: write out the buffer a writer handed over
+static void writeBehindTask(void* arg) {
+    Writer* wr = (Writer*)arg;
+    size_t done = 0;
+    while (done < wr->outLen) {
+        ssize_t n;
+        if (wr->at >= 0)
+            n = pwrite(wr->fd, wr->spare + done, wr->outLen - done, (off_t)(wr->at + (int64_t)done));
+        else
+            n = write(wr->fd, wr->spare + done, wr->outLen - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            wr->outError = 1;
+            break;
+        }
+        done += (size_t)n;
+    }
+}
+
+// Function to start writing out the spare buffer (outLen bytes), on the io_uring or the I/O thread
+static void startWriteBehind(Writer* wr) {
+    wr->outError = 0;
+    wr->pending = 1;
+#ifdef HAVE_IO_URING
+    if (wr->ring != NULL) {
+        ringSubmit(wr->ring, RING_WRITE, IORING_OP_WRITE, wr->fd, wr->spare, wr->outLen, wr->at, 0);
+        return;
+    }
+#endif
+    wr->drain->run = writeBehindTask;
+    wr->drain->arg = wr;
+    submitTask(wr->io, wr->drain);
+}
+
+// Function to wait until the writer's previous buffer is written, recording a failure
+static void finishWrite(Writer* wr) {
+    if (!wr->pending)
+        return;
+    wr->pending = 0;
+#ifdef HAVE_IO_URING
+    if (wr->ring != NULL) {
+        // Short writes (pipes) are continued from where they stopped
+        size_t done = 0;
+        for (;;) {
+            int n = ringWait(wr->ring, RING_WRITE);
+            if (n >= 0)
+                done += (size_t)n;
+            else if (n != -EINTR && n != -EAGAIN) {
+                wr->outError = 1;
+                break;
+            }
+            if (done >= wr->outLen)
+                break;
+            if (n == 0) {
+                wr->outError = 1;
+                break;
+            }
+            ringSubmit(wr->ring, RING_WRITE, IORING_OP_WRITE, wr->fd, wr->spare + done, wr->outLen - done,
+                       wr->at >= 0 ? wr->at + (int64_t)done : -1, 0);
+        }
+    }
+    else
+#endif
+        waitTask(wr->io, wr->drain);
+    if (wr->outError && wr->error == HUFF_OK)
+        wr->error = HUFF_ERR_IO;
+    if (wr->at >= 0)
+        wr->at += (int64_t)wr->outLen;
+}
+
+// Function to open a buffered reader on an already opened file descriptor
+static int openReader(Reader* rd, int fd, Workspace* ws) {
+    memset(rd, 0, sizeof(Reader));
+    rd->fd = fd;
+
+#ifndef _WIN32
+    // Map regular files so the data is read straight from the page cache
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+            rd->buf = (unsigned char*)p;
+            rd->len = (size_t)st.st_size;
+            rd->mapped = 1;
+            rd->owned = 1;
+            return HUFF_OK;
+        }
+    }
+#endif
+
+    // Fall back to the context's read buffer (pipes, empty files, failed mmap); with io_uring or
+    // the I/O thread the next buffer is read while this one is consumed
+    rd->buf = ioBuffer(ws, &ws->inBuf);
+    if (rd->buf == NULL)
+        return HUFF_ERR_NOMEM;
+    if (ws->asyncIo && ioBuffer(ws, &ws->inAhead) != NULL) {
+        rd->ring = ioRing(ws);
+        rd->io = rd->ring == NULL ? ioThreads(ws) : NULL;
+        rd->ahead = ws->inAhead;
+        rd->fill = &ws->readTask;
+        rd->at = fileOffset(fd);
+    }
+    return HUFF_OK;
+}
+
+// Function to open a buffered reader that pulls its bytes from a callback
+static int openSourceReader(Reader* rd, HuffReadFn source, void* user, Workspace* ws) {
+    memset(rd, 0, sizeof(Reader));
+    rd->fd = -1;
+    rd->source = source;
+    rd->user = user;
+    rd->buf = ioBuffer(ws, &ws->inBuf);
+    return rd->buf != NULL ? HUFF_OK : HUFF_ERR_NOMEM;
+}
+
+// Function to open a reader over bytes that are already in memory
+static void openMemoryReader(Reader* rd, const unsigned char* data, size_t len) {
+    memset(rd, 0, sizeof(Reader));
+    rd->fd = -1;
+    rd->buf = (unsigned char*)data;
+    rd->len = len;
+    rd->mapped = 1;
+}
+
+// Function to drop the pages holding mapped input bytes [p, p + n) from the process once they
+// have been used, so memory use does not grow with the input; the mapping is read-only and
+// the file stays in the page cache, so touching the pages again simply maps them back
+static void releaseMapped(const unsigned char* p, size_t n) {
+#if !defined(_WIN32) && defined(MADV_DONTNEED)
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t lo = (uintptr_t)p & ~(page - 1);
+    if (n > 0)
+        madvise((void*)lo, (size_t)((uintptr_t)p + n - lo), MADV_DONTNEED);
+#else
+    (void)p;
+    (void)n;
+#endif
+}
+
+// Function to ask the kernel to start reading mapped bytes [p, p + n) from the device now, so
+// they are in memory by the time they are used
+static void prefetchMapped(const unsigned char* p, size_t n) {
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t lo = (uintptr_t)p & ~(page - 1);
+    if (n > 0)
+        madvise((void*)lo, (size_t)((uintptr_t)p + n - lo), MADV_WILLNEED);
+#else
+    (void)p;
+    (void)n;
+#endif
+}
+
+// Function to drop input bytes [p, p + n) if the reader holds a file mapping (memory buffers
+// belong to the caller and are left alone)
+static void releaseInput(const Reader* rd, const unsigned char* p, size_t n) {
+    if (rd->owned)
+        releaseMapped(p, n);
+}
+
+// Function to drop the mapped input before the read position
+static void releaseConsumed(Reader* rd) {
+    if (rd->owned && rd->pos > rd->released) {
+        releaseMapped(rd->buf + rd->released, rd->pos - rd->released);
+        rd->released = rd->pos;
+    }
+}
+
+// Function to refill the reader buffer, returns number of bytes available
+static size_t fillReader(Reader* rd) {
+    long n;
+    if (rd->pos < rd->len)
+        return rd->len - rd->pos;
+    // A mapping holds the whole file, so running out means end of file
+    if (rd->mapped || rd->error != HUFF_OK)
+        return 0;
+
+    if (rd->source != NULL) {
+        n = rd->source(rd->user, rd->buf, IO_BUFFER_SIZE);
+    }
+    else if (rd->ring != NULL || rd->io != NULL) {
+        // Take the buffer read ahead, and start reading into the one just consumed
+        unsigned char* used = rd->buf;
+        if (!rd->pending)
+            startReadAhead(rd);
+        n = finishReadAhead(rd);
+        rd->buf = rd->ahead;
+        rd->ahead = used;
+        if (n > 0)
+            startReadAhead(rd);
+    }
+    else {
+        // Retry reads interrupted by signals
+        do {
+            n = (long)read(rd->fd, rd->buf, IO_BUFFER_SIZE);
+        } while (n < 0 && errno == EINTR);
+    }
+
+    if (n < 0 || n > IO_BUFFER_SIZE) {
+        rd->error = HUFF_ERR_IO;
+        n = 0;
+    }
+    rd->pos = 0;
+    rd->len = (size_t)n;
+    rd->loaded += (size_t)n;
+    return rd->len;
+}
+
+// Function to get the next contiguous chunk of input, returns its length (0 at end of file)
+static size_t readChunk(Reader* rd, const unsigned char** chunk) {
+    size_t n = fillReader(rd);
+    // A file mapping is handed out a window at a time, dropping the windows already used and
+    // starting the device reads of the next one
+    if (rd->owned) {
+        releaseConsumed(rd);
+        if (n > MAPPED_WINDOW) {
+            size_t next = n - MAPPED_WINDOW;
+            n = MAPPED_WINDOW;
+            prefetchMapped(rd->buf + rd->pos + n, next < MAPPED_WINDOW ? next : MAPPED_WINDOW);
+        }
+    }
+    *chunk = rd->buf + rd->pos;
+    rd->pos += n;
+    return n;
+}
+
+// Function to read a single byte, returns -1 at end of file
+static inline int readByte(Reader* rd) {
+    if (rd->pos == rd->len && fillReader(rd) == 0)
+        return -1;
+    return rd->buf[rd->pos++];
+}
+
+// Function to read exactly n bytes, returns the number of bytes actually read
+static size_t readBytes(Reader* rd, void* dst, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        size_t avail = fillReader(rd);
+        if (avail == 0)
+            break;
+        if (avail > n - done)
+            avail = n - done;
+        memcpy((unsigned char*)dst + done, rd->buf + rd->pos, avail);
+        rd->pos += avail;
+        done += avail;
+    }
+    return done;
+}
+
+// Function to take the next n bytes as one contiguous span, copying into scratch only
+// when the input is not already in memory; returns the number of bytes available
+static size_t readSpan(Reader* rd, size_t n, const unsigned char** span, unsigned char* scratch) {
+    if (rd->mapped) {
+        size_t avail = rd->len - rd->pos;
+        if (avail > n)
+            avail = n;
+        *span = rd->buf + rd->pos;
+        rd->pos += avail;
+        return avail;
+    }
+    *span = scratch;
+    return readBytes(rd, scratch, n);
+}
+
+// Function to get the number of input bytes consumed so far
+static uint64_t readerOffset(const Reader* rd) {
+    return rd->mapped ? rd->pos : rd->loaded - (rd->len - rd->pos);
+}
+
+// Function to restart reading from the beginning of the input, fails on pipes and callbacks
+static int rewindReader(Reader* rd) {
+    if (!rd->mapped) {
+        cancelReadAhead(rd);
+        if (rd->fd < 0 || lseek(rd->fd, 0, SEEK_SET) == -1)
+            return HUFF_ERR_UNSUPPORTED;
+        if (rd->at > 0)
+            rd->at = 0;
+        rd->len = 0;
+    }
+    rd->pos = 0;
+    rd->released = 0;
+    return HUFF_OK;
+}
+
+// Function to release the reader's mapping (buffers belong to the context or the caller)
+static void closeReader(Reader* rd) {
+    cancelReadAhead(rd);
+#ifndef _WIN32
+    if (rd->owned)
+        munmap(rd->buf, rd->len);
+#endif
+    rd->buf = NULL;
+}
+
+// Function to open a buffered writer on an already opened file descriptor
+static int openWriter(Writer* wr, int fd, Workspace* ws) {
+    memset(wr, 0, sizeof(Writer));
+    wr->fd = fd;
+    wr->cap = IO_BUFFER_SIZE;
+    wr->buf = ioBuffer(ws, &ws->outBuf);
+    if (wr->buf == NULL)
+        return HUFF_ERR_NOMEM;
+    // Full buffers of a file are written by io_uring or the I/O thread while the next one is filled
+    if (fd >= 0 && ws->asyncIo && ioBuffer(ws, &ws->outSpare) != NULL) {
+        wr->ring = ioRing(ws);
+        wr->io = wr->ring == NULL ? ioThreads(ws) : NULL;
+        wr->spare = ws->outSpare;
+        wr->drain = &ws->writeTask;
+        wr->at = fileOffset(fd);
+    }
+    return HUFF_OK;
+}
+
+// Function to open a buffered writer that hands its output to a callback
+static int openSinkWriter(Writer* wr, HuffWriteFn sink, void* user, Workspace* ws) {
+    int status = openWriter(wr, -1, ws);
+    wr->sink = sink;
+    wr->user = user;
+    return status;
+}
+
+// Function to open a writer that drops its output, for decoding that only checks the data
+static int openDiscardWriter(Writer* wr, Workspace* ws) {
+    int status = openWriter(wr, -1, ws);
+    wr->discard = 1;
+    return status;
+}
+
+// Function to open a writer that collects its output in a growable memory buffer
+static int openMemoryWriter(Writer* wr, size_t cap, AllocStats* stats) {
+    memset(wr, 0, sizeof(Writer));
+    wr->fd = -1;
+    wr->cap = cap > IO_BUFFER_SIZE ? cap : IO_BUFFER_SIZE;
+    wr->buf = (unsigned char*)allocBuffer(stats, NULL, wr->cap);
+    if (wr->buf == NULL)
+        return HUFF_ERR_NOMEM;
+    wr->growable = 1;
+    wr->owned = 1;
+    wr->stats = stats;
+    return HUFF_OK;
+}
+
+// Function to open a writer over a caller-owned buffer of fixed size (cap must be at least 1)
+static void openFixedWriter(Writer* wr, unsigned char* dst, size_t cap) {
+    memset(wr, 0, sizeof(Writer));
+    wr->fd = -1;
+    wr->buf = dst;
+    wr->cap = cap;
+}
+
+// Function to empty a memory writer for reuse, keeping its buffer
+static void rewindWriter(Writer* wr) {
+    wr->pos = 0;
+    wr->written = 0;
+    wr->error = HUFF_OK;
+}
+
+// Function to write out all pending bytes of the writer (memory writers grow instead)
+static void flushWriter(Writer* wr) {
+    size_t done = 0;
+    if (wr->discard) {
+        // Nothing to do, the bytes were only produced to be checked
+    }
+    else if (wr->growable) {
+        unsigned char* grown = (unsigned char*)allocBuffer(wr->stats, wr->buf, wr->cap * 2);
+        if (grown != NULL) {
+            wr->buf = grown;
+            wr->cap *= 2;
+            return;
+        }
+        wr->error = HUFF_ERR_NOMEM;
+    }
+    else if (wr->error != HUFF_OK) {
+        // Output already failed, so pending bytes are dropped
+    }
+    else if (wr->sink != NULL) {
+        if (wr->sink(wr->user, wr->buf, wr->pos) != 0)
+            wr->error = HUFF_ERR_IO;
+    }
+    else if (wr->ring != NULL || wr->io != NULL) {
+        // Start writing the full buffer once the previous one is written
+        finishWrite(wr);
+        if (wr->error == HUFF_OK) {
+            unsigned char* full = wr->buf;
+            wr->buf = wr->spare;
+            wr->spare = full;
+            wr->outLen = wr->pos;
+            startWriteBehind(wr);
+        }
+    }
+    else if (wr->fd >= 0) {
+        while (done < wr->pos) {
+            ssize_t n = write(wr->fd, wr->buf + done, wr->pos - done);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                wr->error = HUFF_ERR_IO;
+                break;
+            }
+            done += (size_t)n;
+        }
+    }
+    else {
+        // A fixed buffer ran out of room
+        wr->error = HUFF_ERR_SPACE;
+    }
+    // After an error the buffer is reused so callers can keep writing until they check
+    wr->written += wr->pos;
+    wr->pos = 0;
+}
+
+// Function to append a single byte to the writer
+static inline void writeByte(Writer* wr, unsigned char b) {
+    if (wr->pos == wr->cap)
+        flushWriter(wr);
+    wr->buf[wr->pos++] = b;
+}
+
+// Function to append n bytes to the writer
+static void writeBytes(Writer* wr, const void* src, size_t n) {
+    const unsigned char* s = (const unsigned char*)src;
+    while (n > 0) {
+        size_t room = wr->cap - wr->pos;
+        if (room == 0) {
+            flushWriter(wr);
+            room = wr->cap - wr->pos;
+            if (room == 0)
+                return;
+        }
+        if (room > n)
+            room = n;
+        memcpy(wr->buf + wr->pos, s, room);
+        wr->pos += room;
+        s += room;
+        n -= room;
+    }
+}
+
+// Function to flush and release the writer buffer, returns the first error seen
+static int closeWriter(Writer* wr) {
+    if (wr->buf != NULL && (wr->fd >= 0 || wr->sink != NULL))
+        flushWriter(wr);
+    finishWrite(wr);
+    // Positional writes leave the descriptor's offset alone; put it where plain writes would have
+    if (wr->at >= 0 && (wr->ring != NULL || wr->io != NULL) && lseek(wr->fd, (off_t)wr->at, SEEK_SET) < 0 &&
+        wr->error == HUFF_OK)
+        wr->error = HUFF_ERR_IO;
+    if (wr->owned)
+        free(wr->buf);
+    wr->buf = NULL;
+    return wr->error;
+}
+
+// Function to append up to 32 bits to the bit accumulator
+static inline void putBits(BitWriter* bw, uint32_t bits, int len) {
+    bw->acc = (bw->acc << len) | bits;
+    bw->count += len;
+    // Emit a full 32-bit word, most significant byte first
+    if (bw->count >= 32) {
+        Writer* wr = bw->wr;
+        uint32_t word;
+        bw->count -= 32;
+        word = (uint32_t)(bw->acc >> bw->count);
+        if (wr->pos + 4 > wr->cap)
+            flushWriter(wr);
+        wr->buf[wr->pos++] = (unsigned char)(word >> 24);
+        wr->buf[wr->pos++] = (unsigned char)(word >> 16);
+        wr->buf[wr->pos++] = (unsigned char)(word >> 8);
+        wr->buf[wr->pos++] = (unsigned char)word;
+    }
+}
+
+// Function to append a complete code of any length to the bit accumulator
+static inline void putCode(BitWriter* bw, const code* c) {
+    // Codes longer than 32 bits only occur on very skewed inputs
+    if (c->l > 32) {
+        putBits(bw, (uint32_t)(c->bits >> 32), c->l - 32);
+        putBits(bw, (uint32_t)c->bits, 32);
+    }
+    else {
+        putBits(bw, (uint32_t)c->bits, c->l);
+    }
+}
+
+// Function to write the remaining bits, zero padded to a whole byte
+static void flushBits(BitWriter* bw) {
+    int h = bw->count;
+    // Emit every complete byte still pending
+    while (h >= 8) {
+        h -= 8;
+        writeByte(bw->wr, (unsigned char)(bw->acc >> h));
+    }
+    // Then the partial byte, left aligned
+    if (h > 0)
+        writeByte(bw->wr, (unsigned char)((bw->acc << (8 - h)) & 0xFF));
+    bw->acc = 0;
+    bw->count = 0;
+}
+
+// Function to load 8 bytes as a big-endian 64-bit value
+static inline uint64_t loadBE64(const unsigned char* p) {
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) |
+           ((uint64_t)p[3] << 32) | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+           ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+// Function to top up the bit reader to at least 57 valid bits
+static inline void refillBits(BitReader* br) {
+    Reader* rd = br->rd;
+    if (br->count > 56)
+        return;
+    // Fast path: load a whole word; bytes past the new count are reloaded later
+    if (rd->len - rd->pos >= 8) {
+        int bytes = (63 - br->count) >> 3;
+        br->acc |= loadBE64(rd->buf + rd->pos) >> br->count;
+        rd->pos += bytes;
+        br->count += bytes << 3;
+        return;
+    }
+    // Slow path near the end of a buffer; missing bytes past end of file read as zero
+    while (br->count <= 56) {
+        int c = readByte(rd);
+        if (c < 0) {
+            c = 0;
+            br->pad += 8;
+        }
+        br->acc |= (uint64_t)c << (56 - br->count);
+        br->count += 8;
+    }
+}
+
+// Function to look at the next n bits without consuming them (1 <= n <= count)
+static inline uint32_t peekBits(const BitReader* br, int n) {
+    return (uint32_t)(br->acc >> (64 - n));
+}
+
+// Function to consume n bits from the bit reader
+static inline void skipBits(BitReader* br, int n) {
+    br->acc <<= n;
+    br->count -= n;
+}
+
+// Function to store a 32-bit value in little-endian byte order
+static inline void writeU32LE(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+// Function to load a 32-bit value stored in little-endian byte order
+static inline uint32_t readU32LE(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Function to store a 64-bit value in little-endian byte order
+static inline void writeU64LE(unsigned char* p, uint64_t v) {
+    writeU32LE(p, (uint32_t)v);
+    writeU32LE(p + 4, (uint32_t)(v >> 32));
+}
+
+// Function to load a 64-bit value stored in little-endian byte order
+static inline uint64_t readU64LE(const unsigned char* p) {
+    return (uint64_t)readU32LE(p) | ((uint64_t)readU32LE(p + 4) << 32);
+}
+
+// Function to store a value in 7-bit groups, lowest first, returns the number of bytes used
+static inline int writeVarint(unsigned char* p, uint64_t v) {
+    int n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+// Function to load a value stored by writeVarint(), returns the bytes used or 0 if p[0..avail) is cut short
+static inline int readVarint(const unsigned char* p, size_t avail, uint64_t* v) {
+    uint64_t x = 0;
+    for (int n = 0; n < MAX_VARINT_SIZE && (size_t)n < avail; n++) {
+        x |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+        if (!(p[n] & 0x80)) {
+            *v = x;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+// Function to read a value stored by writeVarint() from a stream, returns 0 if it is cut short
+static int readStreamVarint(Reader* rd, uint64_t* v) {
+    unsigned char buf[MAX_VARINT_SIZE];
+    int n = 0, c;
+    do {
+        if ((c = readByte(rd)) < 0)
+            return 0;
+        buf[n++] = (unsigned char)c;
+    } while ((c & 0x80) && n < MAX_VARINT_SIZE);
+    return readVarint(buf, (size_t)n, v) != 0;
+}
+
+// Lookup tables of the CRC32C, built once per process and only read afterwards
+typedef struct CrcTables {
+    uint32_t slice[8][256]; // slice[k][b]: CRC of byte b followed by k zero bytes
+    uint32_t power[64];     // power[k]: x^(2^k) modulo the polynomial, for joining CRCs
+    int hardware;           // 1 if the CPU has the SSE4.2 CRC32 instruction
+} CrcTables;
+
+static CrcTables crcTables;
+static pthread_once_t crcTablesOnce = PTHREAD_ONCE_INIT;
+
+// Function to multiply two polynomials modulo the CRC32C polynomial (bit 31 holds x^0; a != 0)
+static uint32_t crcMultiply(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// Function to fill the CRC tables
+static void initCrcTables(void) {
+    uint32_t b, c;
+    int k;
+    for (b = 0; b < 256; b++) {
+        c = b;
+        for (k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crcTables.slice[0][b] = c;
+    }
+    for (k = 1; k < 8; k++) {
+        for (b = 0; b < 256; b++) {
+            c = crcTables.slice[k - 1][b];
+            crcTables.slice[k][b] = (c >> 8) ^ crcTables.slice[0][c & 0xFF];
+        }
+    }
+    c = 1u << 30;   // x^1
+    for (k = 0; k < 64; k++) {
+        crcTables.power[k] = c;
+        c = crcMultiply(c, c);
+    }
+#ifdef HAVE_SSE42_CRC
+    crcTables.hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+// Function to advance a CRC register over n zero bytes (multiply it by x^(8n))
+static uint32_t crcShift(uint32_t crc, uint64_t n) {
+    for (int k = 3; n != 0; n >>= 1, k++) {
+        if (n & 1)
+            crc = crcMultiply(crcTables.power[k & 63], crc);
+    }
+    return crc;
+}
+
+// Function to run the CRC register over p[0..n), eight bytes per step with the sliced tables
+static uint32_t crcPortable(uint32_t crc, const unsigned char* p, size_t n) {
+    const uint32_t (*t)[256] = crcTables.slice;
+    for (; n >= 8; n -= 8, p += 8) {
+        crc ^= (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        crc = t[7][crc & 0xFF] ^ t[6][(crc >> 8) & 0xFF] ^ t[5][(crc >> 16) & 0xFF] ^ t[4][crc >> 24] ^
+              t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    for (; n > 0; n--, p++)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    return crc;
+}
+
+#ifdef HAVE_SSE42_CRC
+// SSE4.2 variant: large inputs run as three independent chains, which hides the latency of
+// the instruction, and the chains are joined by shifting
+__attribute__((target("sse4.2")))
+static uint32_t crcHardware(uint32_t crc, const unsigned char* p, size_t n) {
+    uint64_t a = crc, b = 0, c = 0, w0, w1, w2;
+    if (n >= CRC_LANES_MIN) {
+        size_t third = n / 3 & ~(size_t)7;
+        for (size_t i = 0; i < third; i += 8) {
+            memcpy(&w0, p + i, 8);
+            memcpy(&w1, p + third + i, 8);
+            memcpy(&w2, p + 2 * third + i, 8);
+            a = _mm_crc32_u64(a, w0);
+            b = _mm_crc32_u64(b, w1);
+            c = _mm_crc32_u64(c, w2);
+        }
+        a = crcShift((uint32_t)a, third) ^ (uint32_t)b;
+        a = crcShift((uint32_t)a, third) ^ (uint32_t)c;
+        p += 3 * third;
+        n -= 3 * third;
+    }
+    for (; n >= 8; n -= 8, p += 8) {
+        memcpy(&w0, p, 8);
+        a = _mm_crc32_u64(a, w0);
+    }
+    for (; n > 0; n--, p++)
+        a = _mm_crc32_u8((uint32_t)a, *p);
+    return (uint32_t)a;
+}
+#endif
+
+// Function to extend the CRC32C of some data (0 for none) with the next n bytes
+static uint32_t crc32c(uint32_t crc, const void* data, size_t n) {
+    pthread_once(&crcTablesOnce, initCrcTables);
+#ifdef HAVE_SSE42_CRC
+    if (crcTables.hardware)
+        return ~crcHardware(~crc, (const unsigned char*)data, n);
+#endif
+    return ~crcPortable(~crc, (const unsigned char*)data, n);
+}
+
+// Function to get the CRC32C of data A followed by data B from the CRCs of both (B is n bytes)
+static uint32_t crc32cCombine(uint32_t a, uint32_t b, uint64_t n) {
+    pthread_once(&crcTablesOnce, initCrcTables);
+    return crcShift(a, n) ^ b;
+}
+
+// Function to read a clock in nanoseconds
+static uint64_t clockNs(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Function to start timing a phase on the calling thread (no clock is read when statistics are off)
+static inline void markPhase(const CallStats* cs, PhaseMark* m) {
+    m->wall = cs != NULL ? clockNs(CLOCK_MONOTONIC) : 0;
+    m->cpu = cs != NULL ? clockNs(CLOCK_THREAD_CPUTIME_ID) : 0;
+}
+
+// Function to charge the time since the mark to a phase, moving the mark to now
+static inline void endPhase(CallStats* cs, int phase, PhaseMark* m) {
+    if (cs != NULL) {
+        PhaseMark now;
+        markPhase(cs, &now);
+        __atomic_add_fetch(&cs->phaseWall[phase], now.wall - m->wall, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&cs->phaseCpu[phase], now.cpu - m->cpu, __ATOMIC_RELAXED);
+        *m = now;
+    }
+}
+
+// Function to count a block of the given mode
+static void noteBlock(CallStats* cs, int mode) {
+    if (cs == NULL)
+        return;
+    __atomic_add_fetch(&cs->blocks, 1, __ATOMIC_RELAXED);
+    if (mode == BLOCK_STORED)
+        __atomic_add_fetch(&cs->storedBlocks, 1, __ATOMIC_RELAXED);
+    else if (mode == BLOCK_RLE)
+        __atomic_add_fetch(&cs->rleBlocks, 1, __ATOMIC_RELAXED);
+}
+
+// Function to add byte values, the longest code and coded bits and bytes to the call counters
+static void noteCoding(CallStats* cs, const uint64_t symbols[4], int maxLen, uint64_t bits, uint64_t bytes) {
+    int cur = __atomic_load_n(&cs->maxCodeLen, __ATOMIC_RELAXED);
+    for (int k = 0; k < 4; k++)
+        __atomic_or_fetch(&cs->symbols[k], symbols[k], __ATOMIC_RELAXED);
+    __atomic_add_fetch(&cs->codedBits, bits, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&cs->codedBytes, bytes, __ATOMIC_RELAXED);
+    while (cur < maxLen && !__atomic_compare_exchange_n(&cs->maxCodeLen, &cur, maxLen, 1,
+                                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Function to record the byte values of a histogram and, when table is not NULL, the exact
+// size of their codes
+static void noteHistogram(CallStats* cs, const uint64_t freq[256], const code* table) {
+    uint64_t symbols[4] = {0}, bits = 0, bytes = 0;
+    int maxLen = 0;
+    if (cs == NULL)
+        return;
+    for (int s = 0; s < 256; s++) {
+        if (freq[s] == 0)
+            continue;
+        symbols[s >> 6] |= (uint64_t)1 << (s & 63);
+        if (table != NULL) {
+            bits += freq[s] * (uint64_t)table[s].l;
+            bytes += freq[s];
+            maxLen = table[s].l > maxLen ? table[s].l : maxLen;
+        }
+    }
+    noteCoding(cs, symbols, maxLen, bits, bytes);
+}
+
+// Function to record a code table and the size of the bitstream that holds bytes coded with it
+static void noteCodeTable(CallStats* cs, const code table[256], uint64_t bits, uint64_t bytes) {
+    uint64_t symbols[4] = {0};
+    int maxLen = 0;
+    if (cs == NULL)
+        return;
+    for (int s = 0; s < 256; s++) {
+        if (table[s].l == 0)
+            continue;
+        symbols[s >> 6] |= (uint64_t)1 << (s & 63);
+        maxLen = table[s].l > maxLen ? table[s].l : maxLen;
+    }
+    noteCoding(cs, symbols, maxLen, bits, bytes);
+}
+
+// Function to start the statistics of a call (nothing happens when they are off)
+static void beginCall(Workspace* ws, PhaseMark* start, AllocStats* mem) {
+    if (ws->cs == NULL)
+        return;
+    memset(&ws->call, 0, sizeof(CallStats));
+    start->wall = clockNs(CLOCK_MONOTONIC);
+    start->cpu = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+    *mem = ws->stats;
+}
+
+// Function to finish the statistics of a call, once all of its threads are done
+static void endCall(Workspace* ws, const PhaseMark* start, const AllocStats* mem, uint64_t in, uint64_t out) {
+    const CallStats* cs = ws->cs;
+    HuffStats* st = &ws->last;
+    if (cs == NULL)
+        return;
+    memset(st, 0, sizeof(HuffStats));
+    st->bytesIn = in;
+    st->bytesOut = out;
+    st->blocks = cs->blocks;
+    st->storedBlocks = cs->storedBlocks;
+    st->rleBlocks = cs->rleBlocks;
+    for (int k = 0; k < 4; k++)
+        st->symbols += __builtin_popcountll(cs->symbols[k]);
+    st->maxCodeLen = cs->maxCodeLen;
+    st->avgCodeLen = cs->codedBytes ? (double)cs->codedBits / (double)cs->codedBytes : 0.0;
+    st->wallSeconds = (double)(clockNs(CLOCK_MONOTONIC) - start->wall) * 1e-9;
+    st->cpuSeconds = (double)(clockNs(CLOCK_PROCESS_CPUTIME_ID) - start->cpu) * 1e-9;
+    for (int p = 0; p < HUFF_PHASE_COUNT; p++) {
+        st->phaseWall[p] = (double)cs->phaseWall[p] * 1e-9;
+        st->phaseCpu[p] = (double)cs->phaseCpu[p] * 1e-9;
+    }
+    st->memory.allocations = ws->stats.count - mem->count;
+    st->memory.bytesAllocated = ws->stats.bytes - mem->bytes;
+    st->memory.bytesProcessed = ws->stats.processed - mem->processed;
+    st->memory.tablesReused = ws->stats.reused - mem->reused;
+}
+
+// Worker loop: run queued tasks until the pool is stopped
+static void* poolWorker(void* arg) {
+    ThreadPool* pool = (ThreadPool*)arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->head == NULL && !pool->stop)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->head == NULL)
+            break;
+        // Take the oldest task and run it outside the lock
+        Task* task = pool->head;
+        pool->head = task->next;
+        if (pool->head == NULL)
+            pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+        task->run(task->arg);
+        pthread_mutex_lock(&pool->lock);
+        task->done = 1;
+        pthread_cond_broadcast(&pool->finished);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Function to let the workers drain the queue, then join them
+static void stopPool(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->count; i++)
+        pthread_join(pool->threads[i], NULL);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->finished);
+}
+
+// Function to start a pool with the given number of worker threads
+static int startPool(ThreadPool* pool, int count, AllocStats* stats) {
+    pool->count = 0;
+    pool->head = pool->tail = NULL;
+    pool->stop = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    pool->threads = (pthread_t*)allocBuffer(stats, NULL, count * sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        stopPool(pool);
+        return HUFF_ERR_NOMEM;
+    }
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, poolWorker, pool) != 0) {
+            // Join the threads that did start
+            stopPool(pool);
+            return HUFF_ERR_NOMEM;
+        }
+        pool->count++;
+    }
+    return HUFF_OK;
+}
+
+// Function to queue a task for execution by the pool (a NULL pool runs it right away)
+static void submitTask(ThreadPool* pool, Task* task) {
+    task->done = 0;
+    task->next = NULL;
+    if (pool == NULL) {
+        task->run(task->arg);
+        task->done = 1;
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail)
+        pool->tail->next = task;
+    else
+        pool->head = task;
+    pool->tail = task;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Function to block until the given task has completed
+static void waitTask(ThreadPool* pool, Task* task) {
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    while (!task->done)
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Function to resolve the number of worker threads to use (0 = one per online CPU)
+static int workerCount(int threads) {
+    long n;
+    if (threads > 0)
+        return threads;
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+        n = 1;
+    if (n > MAX_THREADS)
+        n = MAX_THREADS;
+    return (int)n;
+}
+
+// Function to get the context's pool, starting it on first use; *pool is NULL when
+// the context runs single-threaded
+static int getPool(Workers* w, ThreadPool** pool, AllocStats* stats) {
+    *pool = NULL;
+    if (w->count <= 1)
+        return HUFF_OK;
+    if (!w->started) {
+        int status = startPool(&w->pool, w->count, stats);
+        if (status != HUFF_OK)
+            return status;
+        w->started = 1;
+    }
+    *pool = &w->pool;
+    return HUFF_OK;
+}
+
+// Function to stop the context's pool if it was started
+static void releaseWorkers(Workers* w) {
+    if (w->started)
+        stopPool(&w->pool);
+    w->started = 0;
+}
+
+// Function to create a new Huffman Tree node
+static struct Node* newNode(NodePool* pool, char character, int freq) {
+    // Take the next node from the flat pool (a tree over 256 symbols never needs more)
+    struct Node* temp = &pool->nodes[pool->used++];
+    // Initialize left and right children as NULL
+    temp->l = temp->r = NULL;
+    // Set character and frequency values
+    temp->character = character;
+    temp->freq = freq;
+    return temp;
+}
+
+// Function to create a min heap with given capacity
+static void createMinHeap(struct Min_Heap* minHeap, int capacity) {
+    // Initialize size to 0
+    minHeap->size = 0;
+    // Set the capacity (the node pointer array is part of the heap)
+    minHeap->capacity = capacity;
+}
+
+// Function to swap two min heap nodes (needed for heap operations)
+static void swapMinHeapNode(struct Node** a, struct Node** b) {
+    struct Node* t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// Standard min heapify function to maintain min heap property
+static void Heapify(struct Min_Heap* minHeap, int idx) {
+    // Initialize smallest as the current index
+    int smallest = idx;
+    // Calculate indices of left and right children
+    int left = 2 * idx + 1;
+    int right = 2 * idx + 2;
+
+    // If left child exists and has smaller frequency than current smallest
+    if (left < minHeap->size &&
+        minHeap->array[left]->freq < minHeap->array[smallest]->freq)
+        smallest = left;
+
+    // If right child exists and has smaller frequency than current smallest
+    if (right < minHeap->size &&
+        minHeap->array[right]->freq < minHeap->array[smallest]->freq)
+        smallest = right;
+
+    // If smallest is not the current index, swap and recursively heapify
+    if (smallest != idx) {
+        swapMinHeapNode(&minHeap->array[smallest], &minHeap->array[idx]);
+        Heapify(minHeap, smallest);
+    }
+}
+
+// Function to check if size of heap is 1
+static int isSizeOne(struct Min_Heap* minHeap) {
+    return (minHeap->size == 1);
+}
+
+// Function to extract the minimum value node from heap
+static struct Node* extractMinFromMin_Heap(struct Min_Heap* minHeap) {
+    // Store the root node (minimum frequency node)
+    struct Node* temp = minHeap->array[0];
+    // Replace root with the last node
+    minHeap->array[0] = minHeap->array[minHeap->size - 1];
+    // Decrease the size of the heap
+    --minHeap->size;
+    // Heapify the root to maintain min heap property
+    Heapify(minHeap, 0);
+    // Return the extracted node
+    return temp;
+}
+
+// Function to insert a new node into the Min Heap
+static void insertIntoMin_Heap(struct Min_Heap* minHeap, struct Node* minHeapNode) {
+    // Increase heap size
+    ++minHeap->size;
+    // Start from the last position
+    int i = minHeap->size - 1;
+
+    // Move up the tree until finding the right position (upheap)
+    while (i && minHeapNode->freq < minHeap->array[(i - 1) / 2]->freq) {
+        minHeap->array[i] = minHeap->array[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    // Place the new node at the found position
+    minHeap->array[i] = minHeapNode;
+}
+
+// Function to build a min heap from an array of nodes
+static void buildMinHeap(struct Min_Heap* minHeap) {
+    int n = minHeap->size - 1;
+    int i;
+    // Start from last non-leaf node and heapify each node
+    for (i = (n - 1) / 2; i >= 0; --i)
+        Heapify(minHeap, i);
+}
+
+// Function to create and build min heap from character array and frequency array
+static void createAndBuildMin_Heap(struct Min_Heap* minHeap, NodePool* pool, char arr[], int freq[], int unique_size) {
+    // Create a min heap with capacity equal to unique character count
+    createMinHeap(minHeap, unique_size);
+
+    // Add all characters and their frequencies to the heap
+    for (int i = 0; i < unique_size; ++i)
+        minHeap->array[i] = newNode(pool, arr[i], freq[i]);
+
+    // Set the size of the heap
+    minHeap->size = unique_size;
+
+    // Build the min heap
+    buildMinHeap(minHeap);
+}
+
+// Function to build Huffman Tree from character and frequency arrays; the nodes come from pool
+static struct Node* buildHuffmanTree(NodePool* pool, char arr[], int freq[], int unique_size) {
+    struct Node *left, *right, *top;
+    struct Min_Heap minHeap;
+
+    // Start from an empty pool, then fill a min heap with unique characters and their frequencies
+    pool->used = 0;
+    createAndBuildMin_Heap(&minHeap, pool, arr, freq, unique_size);
+
+    // Iterate until there is only one node in the heap
+    while (!isSizeOne(&minHeap)) {
+        // Extract two nodes with minimum frequency
+        left = extractMinFromMin_Heap(&minHeap);
+        right = extractMinFromMin_Heap(&minHeap);
+
+        // Create a new internal node with '$' as character and sum of frequencies
+        top = newNode(pool, '$', left->freq + right->freq);
+
+        // Connect the two nodes as children of the new node
+        top->l = left;
+        top->r = right;
+
+        // Add the new node back to the heap
+        insertIntoMin_Heap(&minHeap, top);
+    }
+
+    // The remaining node is the root of the Huffman tree
+    return extractMinFromMin_Heap(&minHeap);
+}
+
+// Function to convert binary array to decimal
+static int convertBinaryToDecimal(int arr[], int n) {
+    int decimal = 0;
+    // Convert binary representation to decimal
+    for (int i = 0; i < n; i++)
+        decimal = decimal * 2 + arr[i];
+    return decimal;
+}
+
+// Function to convert decimal to binary representation
+static void convertDecimalToBinary(int bin[], int decimal, int size) {
+    // Convert decimal to binary and store in array
+    for (int i = size - 1; i >= 0; i--) {
+        bin[i] = decimal % 2;
+        decimal = decimal / 2;
+    }
+}
+
+// Function to generate and store Huffman codes in file
+static void printCodesIntoFile(Writer* wr, struct Node* root, int arr[], int top, code table[256]) {
+    // If there is a left child, add 0 to the code and recur
+    if (root->l) {
+        arr[top] = 0;
+        printCodesIntoFile(wr, root->l, arr, top + 1, table);
+    }
+
+    // If there is a right child, add 1 to the code and recur
+    if (root->r) {
+        arr[top] = 1;
+        printCodesIntoFile(wr, root->r, arr, top + 1, table);
+    }
+
+    // If this is a leaf node, store the character and its code
+    if (isLeaf(root)) {
+        // Entry of the code table for this character
+        code* data = &table[(unsigned char)root->character];
+        // Record for the file entry
+        Tree t;
+
+        // Initialize tree node
+        t.g = root->character;
+        // Write character to file
+        writeBytes(wr, &t.g, sizeof(char));
+
+        // Pack the binary code into the code table
+        data->bits = 0;
+        for (int i = 0; i < top; i++) {
+            data->bits = (data->bits << 1) | (uint64_t)arr[i];
+        }
+        data->l = top;
+
+        // Store code length
+        t.len = top;
+        // Write code length to file
+        writeBytes(wr, &t.len, sizeof(int));
+
+        // Convert binary code to decimal
+        t.dec = convertBinaryToDecimal(arr, top);
+        // Write decimal representation to file
+        writeBytes(wr, &t.dec, sizeof(int));
+    }
+}
+
+// Function to compute Huffman code lengths limited to maxLen bits (package-merge)
+static void buildLimitedCodeLengths(const uint64_t freq[256], int maxLen, int lengths[256]) {
+    int sym[256], n = 0, i, j, level;
+    // Item lists of every level: weight, and whether the item is a leaf (1) or a package (0)
+    uint64_t weight[MAX_CODE_LEN][512];
+    unsigned char leaf[MAX_CODE_LEN][512];
+    int size[MAX_CODE_LEN];
+
+    memset(lengths, 0, 256 * sizeof(int));
+
+    // Collect the used symbols sorted by ascending frequency (insertion sort, n <= 256)
+    for (i = 0; i < 256; i++) {
+        if (freq[i] == 0)
+            continue;
+        for (j = n; j > 0 && freq[sym[j - 1]] > freq[i]; j--)
+            sym[j] = sym[j - 1];
+        sym[j] = i;
+        n++;
+    }
+    if (n == 0)
+        return;
+    if (n == 1) {
+        // A lone symbol still needs a one-bit code
+        lengths[sym[0]] = 1;
+        return;
+    }
+    // 2^maxLen must be able to hold every symbol
+    while ((1 << maxLen) < n)
+        maxLen++;
+
+    // Deepest level holds only the leaves
+    for (i = 0; i < n; i++) {
+        weight[0][i] = freq[sym[i]];
+        leaf[0][i] = 1;
+    }
+    size[0] = n;
+
+    // Each shallower level merges the leaves with pairs packaged from the level below
+    for (level = 1; level < maxLen; level++) {
+        int a = 0, b = 0, m = 0, pairs = size[level - 1] / 2;
+        while (a < n || b < pairs) {
+            uint64_t pw = (b < pairs) ? weight[level - 1][2 * b] + weight[level - 1][2 * b + 1] : 0;
+            if (b >= pairs || (a < n && freq[sym[a]] <= pw)) {
+                weight[level][m] = freq[sym[a++]];
+                leaf[level][m++] = 1;
+            }
+            else {
+                weight[level][m] = pw;
+                leaf[level][m++] = 0;
+                b++;
+            }
+        }
+        size[level] = m;
+    }
+
+    // Select 2n-2 items at the top level and follow the packages down; every
+    // selected leaf adds one bit to the length of one of the lightest symbols
+    int take = 2 * n - 2;
+    for (level = maxLen - 1; level >= 0 && take > 0; level--) {
+        int leaves = 0;
+        for (i = 0; i < take; i++)
+            leaves += leaf[level][i];
+        for (i = 0; i < leaves; i++)
+            lengths[sym[i]]++;
+        take = 2 * (take - leaves);
+    }
+}
+
+// Function to assign canonical codes from code lengths, returns 0 if the lengths are invalid
+static int assignCanonicalCodes(const int lengths[256], code table[256]) {
+    int count[MAX_CODE_LEN + 1] = {0};
+    uint64_t next[MAX_CODE_LEN + 2];
+    uint64_t kraft = 0;
+    int len, s;
+
+    for (s = 0; s < 256; s++) {
+        if (lengths[s] < 0 || lengths[s] > MAX_CODE_LEN)
+            return 0;
+        if (lengths[s] > 0) {
+            count[lengths[s]]++;
+            kraft += (uint64_t)1 << (MAX_CODE_LEN - lengths[s]);
+        }
+    }
+    // The lengths must describe a prefix code (Kraft sum at most 1)
+    if (kraft > ((uint64_t)1 << MAX_CODE_LEN))
+        return 0;
+
+    // First code of each length: shorter codes come first, ties broken by symbol value
+    next[1] = 0;
+    for (len = 1; len <= MAX_CODE_LEN; len++)
+        next[len + 1] = (next[len] + (uint64_t)count[len]) << 1;
+
+    for (s = 0; s < 256; s++) {
+        table[s].l = lengths[s];
+        table[s].bits = lengths[s] > 0 ? next[lengths[s]]++ : 0;
+    }
+    return 1;
+}
+
+// Function to write the code lengths of a canonical table (type byte, symbols, nibbles)
+static void writeCodeLengths(Writer* wr, const code table[256]) {
+    unsigned char nib[128] = {0};
+    int n = 0, s;
+
+    // Lengths of the used symbols, packed two per byte
+    for (s = 0; s < 256; s++) {
+        if (table[s].l > 0) {
+            nib[n >> 1] |= (unsigned char)(table[s].l << ((n & 1) ? 0 : 4));
+            n++;
+        }
+    }
+
+    // A symbol list is smaller than the 32-byte bitmap for small alphabets
+    if (n < 32) {
+        writeByte(wr, TABLE_SPARSE);
+        writeByte(wr, (unsigned char)n);
+        for (s = 0; s < 256; s++) {
+            if (table[s].l > 0)
+                writeByte(wr, (unsigned char)s);
+        }
+    }
+    else {
+        unsigned char bitmap[32] = {0};
+        writeByte(wr, TABLE_BITMAP);
+        for (s = 0; s < 256; s++) {
+            if (table[s].l > 0)
+                bitmap[s >> 3] |= (unsigned char)(0x80 >> (s & 7));
+        }
+        writeBytes(wr, bitmap, 32);
+    }
+    writeBytes(wr, nib, (n + 1) / 2);
+}
+
+// Function to read code lengths written by writeCodeLengths(), returns 0 if they are corrupt
+static int readCodeLengths(Reader* rd, int maxLen, int lengths[256]) {
+    unsigned char bitmap[32], syms[256], nib[128];
+    int type = readByte(rd);
+    int n = 0, i;
+
+    memset(lengths, 0, 256 * sizeof(int));
+    if (type == TABLE_SPARSE) {
+        // Symbol count, the symbols, then their lengths as nibbles
+        int count = readByte(rd);
+        if (count < 0 || readBytes(rd, syms, (size_t)count) != (size_t)count)
+            return 0;
+        n = count;
+    }
+    else if (type == TABLE_BITMAP) {
+        // 256-bit presence map, then the lengths of the present symbols as nibbles
+        if (readBytes(rd, bitmap, 32) != 32)
+            return 0;
+        for (i = 0; i < 256; i++) {
+            if (bitmap[i >> 3] & (0x80 >> (i & 7)))
+                syms[n++] = (unsigned char)i;
+        }
+    }
+    else {
+        return 0;
+    }
+    if (readBytes(rd, nib, (size_t)(n + 1) / 2) != (size_t)(n + 1) / 2)
+        return 0;
+    for (i = 0; i < n; i++) {
+        int len = (i & 1) ? (nib[i >> 1] & 0x0F) : (nib[i >> 1] >> 4);
+        if (len < 1 || len > maxLen)
+            return 0;
+        lengths[syms[i]] = len;
+    }
+    return 1;
+}
+
+// Function to write the compact canonical header (format version 2)
+static void writeCompactHeader(Writer* wr, uint64_t totalChars, int maxLen, const code table[256]) {
+    unsigned char hdr[13];
+
+    // Magic, format version, maximum code length and total characters; totals of 4 GiB
+    // or more are flagged in the length byte and take 64 bits
+    hdr[0] = 'H';
+    hdr[1] = 'U';
+    hdr[2] = 'F';
+    hdr[3] = FORMAT_CANONICAL;
+    hdr[4] = (unsigned char)maxLen;
+    if (totalChars > 0xFFFFFFFFu) {
+        hdr[4] |= COMPACT_TOTAL64;
+        writeU64LE(hdr + 5, totalChars);
+        writeBytes(wr, hdr, 13);
+    }
+    else {
+        writeU32LE(hdr + 5, (uint32_t)totalChars);
+        writeBytes(wr, hdr, 9);
+    }
+
+    // Followed by the code lengths
+    writeCodeLengths(wr, table);
+}
+
+// Function to compress file using Huffman coding; finalByte keeps the original format's last
+// byte, written even when the codes end on a byte boundary (it is then zero)
+static int compressFile(Reader* rd, Writer* wr, const code table[256], int finalByte) {
+    const unsigned char* chunk;
+    size_t len, pos;
+    BitWriter bw = { 0, 0, wr };
+    // Reset reader to the beginning of the input
+    int status = rewindReader(rd);
+    if (status != HUFF_OK)
+        return status;
+
+    // Encode each buffered chunk with one table lookup per character
+    while ((len = readChunk(rd, &chunk)) != 0) {
+        for (pos = 0; pos < len; pos++)
+            putCode(&bw, &table[chunk[pos]]);
+    }
+
+    // Pad the last byte with zeros and write it
+    finalByte = finalByte && bw.count % 8 == 0;
+    flushBits(&bw);
+    if (finalByte)
+        writeByte(wr, 0);
+    return rd->error;
+}
+
+// Function to count 16 bytes into the four sub-histograms, spreading neighbouring bytes
+// over different tables so repeated bytes do not wait on the same counter
+static inline void count16(const unsigned char* p, uint32_t sub[4][256]) {
+    for (int k = 0; k < 16; k += 4) {
+        sub[0][p[k]]++;
+        sub[1][p[k + 1]]++;
+        sub[2][p[k + 2]]++;
+        sub[3][p[k + 3]]++;
+    }
+}
+
+// Function to count a span 64 bytes per iteration into the sub-histograms
+static void countSpan(const unsigned char* p, size_t n, uint32_t sub[4][256]) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        count16(p + i, sub);
+        count16(p + i + 16, sub);
+        count16(p + i + 32, sub);
+        count16(p + i + 48, sub);
+    }
+    for (; i + 16 <= n; i += 16)
+        count16(p + i, sub);
+    for (; i < n; i++)
+        sub[0][p[i]]++;
+}
+
+#ifdef HAVE_AVX2_HISTOGRAM
+// AVX2 variant: 32-byte runs of a single value (common in sparse and binary data) are
+// detected with one compare and counted with a single add
+__attribute__((target("avx2")))
+static void countSpanAvx2(const unsigned char* p, size_t n, uint32_t sub[4][256]) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i first = _mm256_set1_epi8((char)p[i]);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, first)) == -1) {
+            sub[0][p[i]] += 32;
+        }
+        else {
+            count16(p + i, sub);
+            count16(p + i + 16, sub);
+        }
+    }
+    for (; i < n; i++)
+        sub[0][p[i]]++;
+}
+#endif
+
+// Function to add the byte counts of p[0..n) to freq
+static void countBytes(const unsigned char* p, size_t n, uint64_t freq[256]) {
+    uint32_t sub[4][256];
+#ifdef HAVE_AVX2_HISTOGRAM
+    int avx2 = __builtin_cpu_supports("avx2");
+#endif
+    while (n > 0) {
+        size_t span = n < HISTOGRAM_SPAN ? n : HISTOGRAM_SPAN;
+        memset(sub, 0, sizeof(sub));
+#ifdef HAVE_AVX2_HISTOGRAM
+        if (avx2)
+            countSpanAvx2(p, span, sub);
+        else
+#endif
+            countSpan(p, span, sub);
+        // Merge the sub-histograms
+        for (int s = 0; s < 256; s++)
+            freq[s] += (uint64_t)sub[0][s] + sub[1][s] + sub[2][s] + sub[3][s];
+        p += span;
+        n -= span;
+    }
+}
+
+// Pool task: count one slice of a parallel frequency count
+static void countBytesTask(void* arg) {
+    HistogramJob* job = (HistogramJob*)arg;
+    PhaseMark mark;
+    markPhase(job->cs, &mark);
+    memset(job->freq, 0, sizeof(job->freq));
+    countBytes(job->in, job->n, job->freq);
+    endPhase(job->cs, HUFF_PHASE_HISTOGRAM, &mark);
+}
+
+// Function to get the number of bytes in each segment of a block split into streams
+// (the last segment may be shorter, or even empty)
+static inline size_t segmentSize(size_t rawSize, int streams) {
+    return (rawSize + (size_t)streams - 1) / (size_t)streams;
+}
+
+// Function to get the number of sync points inside a block of the given size
+static inline size_t syncPointsInBlock(uint32_t rawSize, uint32_t interval) {
+    return (interval && rawSize) ? (rawSize - 1) / interval : 0;
+}
+
+// Function to choose how a block is written from its histogram, before anything is encoded:
+// a single repeated byte, Huffman codes (their lengths are left in lengths), or the bytes
+// unchanged when the codes, counted with their table and jump table, would not save enough
+static int chooseBlockMode(const uint64_t freq[256], size_t n, int maxLen, int streams, int lengths[256]) {
+    uint64_t bits = 0;
+    size_t used = 0, cost;
+    int s;
+
+    for (s = 0; s < 256; s++)
+        used += freq[s] != 0;
+    if (used == 1)
+        return BLOCK_RLE;
+    if (used == 0)
+        return BLOCK_STORED;
+
+    // Exact size of the bitstreams, plus the code lengths, jump table and padding
+    buildLimitedCodeLengths(freq, maxLen, lengths);
+    for (s = 0; s < 256; s++)
+        bits += freq[s] * (uint64_t)lengths[s];
+    cost = (used < 32 ? 2 + used : 1 + 32) + (used + 1) / 2 +
+           (streams > 1 ? 1 + 4 * (size_t)(streams - 1) : 0) + (size_t)streams + (size_t)(bits / 8);
+    return cost + (n >> HUFFMAN_MIN_GAIN_SHIFT) < n ? BLOCK_HUFFMAN : BLOCK_STORED;
+}
+
+// Function to encode one block, returning its mode in *mode. A Huffman block holds the code
+// lengths followed by the bitstream; when interval is non-zero, the payload bit offset of
+// every interval-th byte is stored in sync. With more than one stream, the block is cut into
+// that many segments, each coded as its own byte-aligned bitstream behind a jump table
+// (stream count, then the sizes of all streams but the last). A single-symbol block holds
+// the symbol, and a stored block writes nothing here (its bytes are copied by writeBlock).
+// Phase times and code statistics go to cs unless it is NULL
+static size_t encodeBlock(const unsigned char* in, size_t n, int maxLen, int streams, Writer* out,
+                          size_t interval, uint32_t* sync, int* mode, CallStats* cs) {
+    uint64_t freq[256] = {0};
+    int lengths[256];
+    code table[256];
+    size_t i = 0, next, syncs = 0, jump = 0, seg = segmentSize(n, streams);
+    PhaseMark mark;
+
+    // Every block gets its own histogram, which decides how the block is written
+    markPhase(cs, &mark);
+    countBytes(in, n, freq);
+    endPhase(cs, HUFF_PHASE_HISTOGRAM, &mark);
+    *mode = chooseBlockMode(freq, n, maxLen, streams, lengths);
+    noteBlock(cs, *mode);
+    if (*mode != BLOCK_HUFFMAN) {
+        noteHistogram(cs, freq, NULL);
+        endPhase(cs, HUFF_PHASE_TREE, &mark);
+        // Stored and single-symbol blocks are seekable without sync points; the slots are kept
+        // so that every block has the number the index expects
+        syncs = syncPointsInBlock((uint32_t)n, (uint32_t)interval);
+        memset(sync, 0, syncs * sizeof(uint32_t));
+        if (*mode == BLOCK_RLE)
+            writeByte(out, in[0]);
+        return syncs;
+    }
+    assignCanonicalCodes(lengths, table);
+    noteHistogram(cs, freq, table);
+    writeCodeLengths(out, table);
+    if (streams > 1) {
+        // Room for the jump table, filled in once the stream sizes are known
+        writeByte(out, (unsigned char)streams);
+        jump = out->pos;
+        for (int k = 0; k < 4 * (streams - 1); k++)
+            writeByte(out, 0);
+    }
+
+    endPhase(cs, HUFF_PHASE_TREE, &mark);
+
+    // Encode run by run, noting where each sync point starts in the payload
+    next = interval ? interval : n;
+    for (int k = 0; k < streams; k++) {
+        BitWriter bw = { 0, 0, out };
+        size_t start = out->pos, end = (size_t)(k + 1) * seg < n ? (size_t)(k + 1) * seg : n;
+        while (i < end) {
+            if (i == next) {
+                sync[syncs++] = (uint32_t)(out->pos * 8 + (size_t)bw.count);
+                next += interval;
+            }
+            size_t stop = next < end ? next : end;
+            for (; i < stop; i++)
+                putCode(&bw, &table[in[i]]);
+        }
+        flushBits(&bw);
+        if (k < streams - 1)
+            writeU32LE(out->buf + jump + 4 * k, (uint32_t)(out->pos - start));
+    }
+    endPhase(cs, HUFF_PHASE_ENCODE, &mark);
+    return syncs;
+}
+
+// Function to read Huffman codes from a compressed file, returns 0 if the file ends early
+static int ExtractCodesFromFile(Reader* rd, Tree* t) {
+    // Read character
+    if (readBytes(rd, &t->g, sizeof(char)) != sizeof(char))
+        return 0;
+    // Read code length
+    if (readBytes(rd, &t->len, sizeof(int)) != sizeof(int))
+        return 0;
+    // Read decimal representation of code
+    return readBytes(rd, &t->dec, sizeof(int)) == sizeof(int);
+}
+
+// Function to take an empty node of the decode tree from the context's node pool
+static Tree* createTreeRoot(Workspace* ws) {
+    Tree* node = &ws->treeNodes[ws->treeUsed++];
+    node->f = NULL;
+    node->r = NULL;
+    return node;
+}
+
+// Function to add one character code to the decode tree and the code table
+static void insertCodeIntoTree(Workspace* ws, Tree* tree, char g, int len, int dec, code table[256]) {
+    int i, j;
+    // Start from the root
+    Tree* tree_temp = tree;
+
+    // Arrays for binary representation
+    int bin[MAX], bin_con[MAX];
+
+    // Initialize arrays
+    for (i = 0; i < MAX; i++) {
+        bin[i] = bin_con[i] = 0;
+    }
+
+    // Convert decimal code to binary
+    convertDecimalToBinary(bin, dec, len);
+
+    // Copy binary code
+    for (i = 0; i < len; i++) {
+        bin_con[i] = bin[i];
+    }
+
+    // Traverse the tree according to the code
+    for (j = 0; j < len; j++) {
+        if (bin_con[j] == 0) {
+            // If bit is 0, go left
+            if (tree_temp->f == NULL) {
+                // Create left child if it doesn't exist
+                tree_temp->f = createTreeRoot(ws);
+            }
+            tree_temp = tree_temp->f;
+        }
+        else if (bin_con[j] == 1) {
+            // If bit is 1, go right
+            if (tree_temp->r == NULL) {
+                // Create right child if it doesn't exist
+                tree_temp->r = createTreeRoot(ws);
+            }
+            tree_temp = tree_temp->r;
+        }
+    }
+
+    // At leaf node, store character and code information
+    tree_temp->g = g;
+    tree_temp->len = len;
+    tree_temp->dec = dec;
+
+    // Remember the code so the decode table can be built from it
+    table[(unsigned char)g].bits = (uint64_t)(unsigned int)dec;
+    table[(unsigned char)g].l = len;
+}
+
+// Function to rebuild the Huffman tree from the codes in the compressed file (size <= 256);
+// the nodes come from the context's pool, which is emptied first
+static int ReBuildHuffmanTree(Reader* rd, int size, Workspace* ws, Tree** root, code table[256]) {
+    Tree t;
+    int k;
+
+    // Every code adds at most MAX_LEGACY_CODE_LEN nodes below the root
+    if (ws->treeNodes == NULL) {
+        ws->treeNodes = (Tree*)allocBuffer(&ws->stats, NULL, MAX_DECODE_TREE_NODES * sizeof(Tree));
+        if (ws->treeNodes == NULL)
+            return HUFF_ERR_NOMEM;
+    }
+    ws->treeUsed = 0;
+    *root = createTreeRoot(ws);
+    memset(table, 0, 256 * sizeof(code));
+
+    // Process each character code
+    for (k = 0; k < size; k++) {
+        // Extract code for current character
+        if (!ExtractCodesFromFile(rd, &t))
+            return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+        // Legacy codes are stored as an int, so longer codes cannot be valid
+        if (t.len < 0 || t.len > MAX_LEGACY_CODE_LEN || t.dec < 0 ||
+            (t.len < MAX_LEGACY_CODE_LEN && t.dec >= (1 << t.len)))
+            return HUFF_ERR_CORRUPT;
+        // Add it to the tree and the code table
+        insertCodeIntoTree(ws, *root, t.g, t.len, t.dec, table);
+    }
+    return HUFF_OK;
+}
+
+// Function to read the compact canonical header (format version 2)
+static int readCompactHeader(Reader* rd, uint64_t* totalChars, int* maxLen, code table[256]) {
+    unsigned char hdr[9];
+    int lengths[256];
+
+    // Maximum code length, then the total characters in 32 or 64 bits
+    if (readBytes(rd, hdr, 1) != 1)
+        return HUFF_ERR_CORRUPT;
+    *maxLen = hdr[0] & ~COMPACT_TOTAL64;
+    if (*maxLen < 1 || *maxLen > MAX_CODE_LEN)
+        return HUFF_ERR_CORRUPT;
+    if (hdr[0] & COMPACT_TOTAL64) {
+        if (readBytes(rd, hdr + 1, 8) != 8)
+            return HUFF_ERR_CORRUPT;
+        *totalChars = readU64LE(hdr + 1);
+    }
+    else {
+        if (readBytes(rd, hdr + 1, 4) != 4)
+            return HUFF_ERR_CORRUPT;
+        *totalChars = readU32LE(hdr + 1);
+    }
+
+    // Code lengths, then the canonical codes derived from them
+    if (!readCodeLengths(rd, *maxLen, lengths) || !assignCanonicalCodes(lengths, table))
+        return HUFF_ERR_CORRUPT;
+    return HUFF_OK;
+}
+
+// Function to build the decode table for a code table; root is the decode tree
+// for non-canonical codes and NULL for canonical ones
+static int buildDecodeTable(DecodeTable* dt, const code table[256], int bits, Tree* root) {
+    int size = 1 << bits;
+    int mask = size - 1;
+    int i, s, len;
+
+    if (dt->entries == NULL || dt->bits != bits) {
+        DecodeEntry* entries = (DecodeEntry*)allocBuffer(dt->stats, dt->entries, size * sizeof(DecodeEntry));
+        if (entries == NULL)
+            return HUFF_ERR_NOMEM;
+        dt->entries = entries;
+    }
+    dt->bits = bits;
+    dt->root = root;
+    // Entries not covered by a short code fall back to the slow path
+    memset(dt->entries, 0, size * sizeof(DecodeEntry));
+
+    // First pass: every code that fits in the table owns a range of entries
+    for (s = 0; s < 256; s++) {
+        len = table[s].l;
+        if (len == 0 || len > bits)
+            continue;
+        int first = (int)table[s].bits << (bits - len);
+        int count = 1 << (bits - len);
+        for (i = first; i < first + count; i++) {
+            dt->entries[i].sym[0] = (unsigned char)s;
+            dt->entries[i].len1 = (unsigned char)len;
+            dt->entries[i].nbits = (unsigned char)len;
+        }
+    }
+
+    // Second pass: append a second symbol when its code fits in the remaining bits
+    for (i = 0; i < size; i++) {
+        int len1 = dt->entries[i].len1;
+        if (len1 == 0 || len1 == bits)
+            continue;
+        const DecodeEntry* next = &dt->entries[(i << len1) & mask];
+        if (next->len1 != 0 && next->len1 <= bits - len1) {
+            dt->entries[i].sym[1] = next->sym[0];
+            dt->entries[i].nbits = (unsigned char)(len1 + next->len1);
+        }
+    }
+
+    // Canonical codes longer than the table are resolved per length
+    if (root == NULL) {
+        int pos = 0;
+        dt->maxLen = 0;
+        for (len = 1; len <= MAX_CODE_LEN; len++) {
+            dt->count[len] = 0;
+            dt->firstIndex[len] = pos;
+            dt->firstCode[len] = 0;
+            for (s = 0; s < 256; s++) {
+                if (table[s].l != len)
+                    continue;
+                if (dt->count[len] == 0)
+                    dt->firstCode[len] = (uint32_t)table[s].bits;
+                dt->count[len]++;
+                dt->sorted[pos++] = (unsigned char)s;
+                dt->maxLen = len;
+            }
+        }
+    }
+    return HUFF_OK;
+}
+
+// Function to hash a code table: FNV-1a over a limit (the length limit for dictionary IDs,
+// the table bits for the table cache) and the code lengths
+static uint32_t hashCodeLengths(int limit, const code table[256]) {
+    uint32_t h = 2166136261u;
+    h = (h ^ (uint32_t)limit) * 16777619u;
+    for (int s = 0; s < 256; s++)
+        h = (h ^ (uint32_t)table[s].l) * 16777619u;
+    return h;
+}
+
+// Function to give a decode table a cache of cap tables
+static int attachTableCache(DecodeTable* dt, int cap) {
+    TableCache* tc = (TableCache*)allocBuffer(dt->stats, NULL, sizeof(TableCache));
+    if (tc == NULL)
+        return HUFF_ERR_NOMEM;
+    memset(tc, 0, sizeof(TableCache));
+    tc->slots = (CachedTable*)allocBuffer(dt->stats, NULL, cap * sizeof(CachedTable));
+    if (tc->slots == NULL) {
+        free(tc);
+        return HUFF_ERR_NOMEM;
+    }
+    memset(tc->slots, 0, cap * sizeof(CachedTable));
+    tc->cap = cap;
+    dt->cache = tc;
+    return HUFF_OK;
+}
+
+// Function to exchange the table in use with a cached one (the owner keeps its counters and cache)
+static void swapCachedTable(DecodeTable* dt, CachedTable* slot) {
+    DecodeTable t = *dt;
+    *dt = slot->dt;
+    slot->dt = t;
+    dt->stats = t.stats;
+    dt->cache = t.cache;
+}
+
+// Function to load the decode table for a code table into dt, taking it from dt's cache when a
+// table with the same lengths was built recently; root is as for buildDecodeTable()
+static int loadDecodeTable(DecodeTable* dt, const code table[256], int bits, Tree* root) {
+    TableCache* tc = dt->cache;
+    unsigned char lengths[256];
+    CachedTable* slot = NULL;
+    uint32_t hash;
+    int i, status;
+
+    if (tc == NULL || root != NULL) {
+        if (tc != NULL)
+            tc->hasCurrent = 0;
+        return buildDecodeTable(dt, table, bits, root);
+    }
+    hash = hashCodeLengths(bits, table);
+    for (i = 0; i < 256; i++)
+        lengths[i] = (unsigned char)table[i].l;
+    if (tc->hasCurrent && tc->hash == hash && memcmp(tc->lengths, lengths, 256) == 0) {
+        __atomic_fetch_add(&dt->stats->reused, 1, __ATOMIC_RELAXED);
+        return HUFF_OK;
+    }
+    for (i = 0; i < tc->count && slot == NULL; i++) {
+        if (tc->slots[i].hash == hash && memcmp(tc->slots[i].lengths, lengths, 256) == 0)
+            slot = &tc->slots[i];
+    }
+
+    if (slot != NULL) {
+        // Hit: the table in use takes the slot, or the slot is dropped if that table has no key
+        swapCachedTable(dt, slot);
+        if (tc->hasCurrent) {
+            slot->hash = tc->hash;
+            memcpy(slot->lengths, tc->lengths, 256);
+            slot->used = ++tc->clock;
+        }
+        else {
+            free(slot->dt.entries);
+            *slot = tc->slots[--tc->count];
+            memset(&tc->slots[tc->count], 0, sizeof(CachedTable));
+        }
+        __atomic_fetch_add(&dt->stats->reused, 1, __ATOMIC_RELAXED);
+        status = HUFF_OK;
+    }
+    else {
+        // Miss: keep the table in use in a free slot or in place of the least recently used
+        // one, whose entries are then rebuilt for the new table
+        if (tc->hasCurrent) {
+            if (tc->count < tc->cap)
+                slot = &tc->slots[tc->count++];
+            else {
+                slot = &tc->slots[0];
+                for (i = 1; i < tc->count; i++) {
+                    if (tc->slots[i].used < slot->used)
+                        slot = &tc->slots[i];
+                }
+            }
+            swapCachedTable(dt, slot);
+            slot->hash = tc->hash;
+            memcpy(slot->lengths, tc->lengths, 256);
+            slot->used = ++tc->clock;
+        }
+        status = buildDecodeTable(dt, table, bits, NULL);
+    }
+    tc->hasCurrent = status == HUFF_OK;
+    tc->hash = hash;
+    memcpy(tc->lengths, lengths, 256);
+    return status;
+}
+
+// Function to release the decode table entries and its cache
+static void freeDecodeTable(DecodeTable* dt) {
+    free(dt->entries);
+    dt->entries = NULL;
+    if (dt->cache != NULL) {
+        for (int i = 0; i < dt->cache->count; i++)
+            free(dt->cache->slots[i].dt.entries);
+        free(dt->cache->slots);
+        free(dt->cache);
+        dt->cache = NULL;
+    }
+}
+
+// Function to decode one symbol whose code is longer than the table, returns -1 on corrupt data
+static int decodeSlow(BitReader* br, const DecodeTable* dt) {
+    int used = 0;
+
+    // Canonical codes: the codes of each length form one contiguous range
+    if (dt->root == NULL) {
+        for (int len = dt->bits + 1; len <= dt->maxLen; len++) {
+            uint32_t c = peekBits(br, len) - dt->firstCode[len];
+            if (c < (uint32_t)dt->count[len]) {
+                skipBits(br, len);
+                return dt->sorted[dt->firstIndex[len] + (int)c];
+            }
+        }
+        return -1;
+    }
+
+    // Other codes: walk the decode tree bit by bit
+    Tree* node = dt->root;
+    while (node->f != NULL || node->r != NULL) {
+        // Bits are consumed from the most significant end of the accumulator
+        node = ((br->acc >> (63 - used)) & 1) ? node->r : node->f;
+        used++;
+        if (node == NULL || used > br->count)
+            return -1;
+    }
+    skipBits(br, used);
+    return (unsigned char)node->g;
+}
+
+// Function to decode count characters from the bit reader
+static int decodeSymbols(BitReader* bitReader, Writer* wr, const DecodeTable* dt, size_t totalChars) {
+    BitReader br = *bitReader;
+    const DecodeEntry* entries = dt->entries;
+    size_t remaining = totalChars;
+    int shift = 64 - dt->bits;
+    int c;
+
+    // Two symbols may be produced per lookup, so stop one short of the end
+    while (remaining >= 2) {
+        refillBits(&br);
+        const DecodeEntry* e = &entries[br.acc >> shift];
+        if (e->len1 == 0) {
+            // Code longer than the table
+            if ((c = decodeSlow(&br, dt)) < 0)
+                return HUFF_ERR_CORRUPT;
+            writeByte(wr, (unsigned char)c);
+            remaining--;
+        }
+        else if (e->nbits != e->len1) {
+            writeByte(wr, e->sym[0]);
+            writeByte(wr, e->sym[1]);
+            skipBits(&br, e->nbits);
+            remaining -= 2;
+        }
+        else {
+            writeByte(wr, e->sym[0]);
+            skipBits(&br, e->len1);
+            remaining--;
+        }
+    }
+
+    // Last character, if any, only takes the first symbol of its entry
+    if (remaining == 1) {
+        refillBits(&br);
+        const DecodeEntry* e = &entries[br.acc >> shift];
+        if (e->len1 == 0) {
+            if ((c = decodeSlow(&br, dt)) < 0)
+                return HUFF_ERR_CORRUPT;
+            writeByte(wr, (unsigned char)c);
+        }
+        else {
+            writeByte(wr, e->sym[0]);
+            skipBits(&br, e->len1);
+        }
+    }
+    *bitReader = br;
+    // The padding sits behind the real bits, so fewer bits left than were padded means some was decoded
+    return br.count < br.pad ? HUFF_ERR_CORRUPT : HUFF_OK;
+}
+
+// Function to top up a lane to at least 57 valid bits; the caller guarantees that at
+// least 8 bytes of the stream are left
+static inline void refillLane(Lane* l) {
+    int bytes = (63 - l->count) >> 3;
+    l->acc |= loadBE64(l->in) >> l->count;
+    l->in += bytes;
+    l->count += bytes << 3;
+}
+
+// Function to decode the next table entry (one or two bytes) of a lane; returns 0 on corrupt data
+static inline int stepLane(Lane* l, const DecodeEntry* entries, int shift, const DecodeTable* dt) {
+    refillLane(l);
+    const DecodeEntry* d = &entries[l->acc >> shift];
+    if (d->len1 == 0) {
+        // Code longer than the table
+        BitReader br = { l->acc, l->count, NULL };
+        int c = decodeSlow(&br, dt);
+        l->acc = br.acc;
+        l->count = br.count;
+        *l->out++ = (unsigned char)c;
+        return c >= 0;
+    }
+    // Both bytes are stored, the second one is kept only if it was decoded
+    l->out[0] = d->sym[0];
+    l->out[1] = d->sym[1];
+    l->out += d->nbits != d->len1 ? 2 : 1;
+    l->acc <<= d->nbits;
+    l->count -= d->nbits;
+    return 1;
+}
+
+// Function to get how many lock-step passes a lane can take without bounds checks: a pass
+// writes at most two bytes and consumes at most 16 bits, and a refill reads 8 bytes ahead
+static inline size_t laneRounds(const Lane* l) {
+    size_t out = (size_t)(l->stop - l->out) / 2;
+    size_t in = l->end - l->in >= 16 ? (size_t)(l->end - l->in - 16) / 2 : 0;
+    return out < in ? out : in;
+}
+
+// Function to decode four lanes in lock step while all of them are far from their ends.
+// Each pass takes one lookup from every lane; the lookups do not depend on each other, so
+// they overlap in the CPU instead of forming one long chain. The lanes are copied into
+// locals so they stay in registers
+static int decodeLanes4(Lane* lanes, const DecodeTable* dt) {
+    Lane a = lanes[0], b = lanes[1], c = lanes[2], d = lanes[3];
+    const DecodeEntry* entries = dt->entries;   // Local, as output stores may alias dt
+    int shift = 64 - dt->bits, ok = 1;
+    size_t rounds, r;
+
+    while (ok) {
+        rounds = laneRounds(&a);
+        if ((r = laneRounds(&b)) < rounds)
+            rounds = r;
+        if ((r = laneRounds(&c)) < rounds)
+            rounds = r;
+        if ((r = laneRounds(&d)) < rounds)
+            rounds = r;
+        if (rounds == 0)
+            break;
+        while (rounds-- > 0) {
+            ok &= stepLane(&a, entries, shift, dt);
+            ok &= stepLane(&b, entries, shift, dt);
+            ok &= stepLane(&c, entries, shift, dt);
+            ok &= stepLane(&d, entries, shift, dt);
+        }
+    }
+    lanes[0] = a;
+    lanes[1] = b;
+    lanes[2] = c;
+    lanes[3] = d;
+    return ok ? HUFF_OK : HUFF_ERR_CORRUPT;
+}
+
+// Function to decode two lanes in lock step, as decodeLanes4 does for four
+static int decodeLanes2(Lane* lanes, const DecodeTable* dt) {
+    Lane a = lanes[0], b = lanes[1];
+    const DecodeEntry* entries = dt->entries;   // Local, as output stores may alias dt
+    int shift = 64 - dt->bits, ok = 1;
+    size_t rounds, r;
+
+    while (ok) {
+        rounds = laneRounds(&a);
+        if ((r = laneRounds(&b)) < rounds)
+            rounds = r;
+        if (rounds == 0)
+            break;
+        while (rounds-- > 0) {
+            ok &= stepLane(&a, entries, shift, dt);
+            ok &= stepLane(&b, entries, shift, dt);
+        }
+    }
+    lanes[0] = a;
+    lanes[1] = b;
+    return ok ? HUFF_OK : HUFF_ERR_CORRUPT;
+}
+
+// Function to decode the streams of a block side by side into dst, which receives rawSize bytes
+static int decodeInterleaved(const unsigned char* payload, const StreamLayout* ly,
+                             const DecodeTable* dt, unsigned char* dst, size_t rawSize) {
+    Lane lanes[MAX_STREAMS];
+    int n = ly->count, k, status = HUFF_OK;
+
+    for (k = 0; k < n; k++) {
+        size_t first = (size_t)k * ly->segment, last = first + ly->segment;
+        lanes[k].acc = 0;
+        lanes[k].count = 0;
+        lanes[k].in = payload + ly->begin[k];
+        lanes[k].end = payload + ly->begin[k + 1];
+        lanes[k].out = dst + (first < rawSize ? first : rawSize);
+        lanes[k].stop = dst + (last < rawSize ? last : rawSize);
+    }
+
+    // Groups of four lanes, then a pair; a single leftover lane is decoded below
+    for (k = 0; k + 1 < n && status == HUFF_OK;) {
+        if (n - k >= 4) {
+            status = decodeLanes4(lanes + k, dt);
+            k += 4;
+        }
+        else {
+            status = decodeLanes2(lanes + k, dt);
+            k += 2;
+        }
+    }
+
+    // Finish each stream on its own
+    for (k = 0; k < n && status == HUFF_OK; k++) {
+        Lane* l = &lanes[k];
+        if (l->out < l->stop) {
+            Reader rd;
+            Writer tail;
+            openMemoryReader(&rd, l->in, (size_t)(l->end - l->in));
+            BitReader br = { l->acc, l->count, &rd };
+            openFixedWriter(&tail, l->out, (size_t)(l->stop - l->out));
+            status = decodeSymbols(&br, &tail, dt, (size_t)(l->stop - l->out));
+            if (status == HUFF_OK && tail.error != HUFF_OK)
+                status = HUFF_ERR_CORRUPT;
+        }
+    }
+    return status;
+}
+
+// Function to decompress the compressed file
+static int decompressFile(Reader* rd, Writer* wr, const DecodeTable* dt, size_t totalChars) {
+    BitReader br = { 0, 0, rd };
+    // A file mapping is decoded a window at a time, dropping the input behind it
+    while (rd->owned && totalChars > MAPPED_WINDOW) {
+        int status = decodeSymbols(&br, wr, dt, MAPPED_WINDOW);
+        if (status != HUFF_OK)
+            return status;
+        releaseConsumed(rd);
+        totalChars -= MAPPED_WINDOW;
+    }
+    return decodeSymbols(&br, wr, dt, totalChars);
+}
+
+// Pool task: compress one block into its job's memory writer; the checksum is taken first,
+// so the histogram that follows finds the block in cache
+static void compressBlockTask(void* arg) {
+    BlockJob* job = (BlockJob*)arg;
+    rewindWriter(&job->out);
+    if (job->opts->checksum) {
+        PhaseMark mark;
+        markPhase(job->cs, &mark);
+        job->crc = crc32c(0, job->in, job->n);
+        endPhase(job->cs, HUFF_PHASE_CHECKSUM, &mark);
+    }
+    job->syncCount = encodeBlock(job->in, job->n, job->opts->maxCodeLen, job->opts->streams, &job->out,
+                                 job->opts->syncInterval, job->sync, &job->mode, job->cs);
+}
+
+// Function to make room for at least the given numbers of entries and sync points
+static int reserveBlockIndex(BlockIndex* index, size_t entries, size_t syncs) {
+    if (entries > index->cap) {
+        size_t cap = index->cap ? index->cap : 64;
+        while (cap < entries)
+            cap *= 2;
+        BlockIndexEntry* grown = (BlockIndexEntry*)allocBuffer(index->stats, index->entries, cap * sizeof(BlockIndexEntry));
+        if (grown == NULL)
+            return HUFF_ERR_NOMEM;
+        index->entries = grown;
+        index->cap = cap;
+    }
+    if (syncs > index->syncCap) {
+        size_t cap = index->syncCap ? index->syncCap : 256;
+        while (cap < syncs)
+            cap *= 2;
+        uint32_t* grown = (uint32_t*)allocBuffer(index->stats, index->sync, cap * sizeof(uint32_t));
+        if (grown == NULL)
+            return HUFF_ERR_NOMEM;
+        index->sync = grown;
+        index->syncCap = cap;
+    }
+    return HUFF_OK;
+}
+
+// Function to empty the index, keeping its arrays for reuse
+static void resetBlockIndex(BlockIndex* index) {
+    index->count = 0;
+    index->totalRaw = 0;
+    index->checksum = 0;
+    index->syncInterval = 0;
+    index->syncCount = 0;
+}
+
+// Function to append a block to the index
+static int addIndexEntry(BlockIndex* index, uint64_t offset, uint32_t compSize, uint32_t rawSize) {
+    if (index->count == index->cap && reserveBlockIndex(index, index->count + 1, 0) != HUFF_OK)
+        return HUFF_ERR_NOMEM;
+    BlockIndexEntry* e = &index->entries[index->count++];
+    e->offset = offset;
+    e->rawOffset = index->totalRaw;
+    e->compSize = compSize;
+    e->rawSize = rawSize;
+    e->firstSync = index->syncCount;
+    index->totalRaw += rawSize;
+    return HUFF_OK;
+}
+
+// Function to append the sync points of the most recently added block
+static int addSyncPoints(BlockIndex* index, const uint32_t* sync, size_t count) {
+    if (count == 0)
+        return HUFF_OK;
+    if (reserveBlockIndex(index, 0, index->syncCount + count) != HUFF_OK)
+        return HUFF_ERR_NOMEM;
+    memcpy(index->sync + index->syncCount, sync, count * sizeof(uint32_t));
+    index->syncCount += count;
+    return HUFF_OK;
+}
+
+// Function to release the memory held by a block index
+static void freeBlockIndex(BlockIndex* index) {
+    free(index->entries);
+    free(index->sync);
+    index->entries = NULL;
+    index->sync = NULL;
+    index->cap = index->syncCap = 0;
+    resetBlockIndex(index);
+}
+
+// Function to write the sync points (if any), the block index and its trailer after the end marker
+static void writeBlockIndex(Writer* wr, const BlockIndex* index) {
+    unsigned char e[INDEX_ENTRY_SIZE];
+    if (index->syncInterval) {
+        // Sync section: bit offsets, then the interval and its own tag
+        for (size_t i = 0; i < index->syncCount; i++) {
+            writeU32LE(e, index->sync[i]);
+            writeBytes(wr, e, 4);
+        }
+        writeU32LE(e, index->syncInterval);
+        memcpy(e + 4, "HSYN", 4);
+        writeBytes(wr, e, 8);
+    }
+    for (size_t i = 0; i < index->count; i++) {
+        writeU64LE(e, index->entries[i].offset);
+        writeU32LE(e + 8, index->entries[i].compSize);
+        writeU32LE(e + 12, index->entries[i].rawSize);
+        writeBytes(wr, e, INDEX_ENTRY_SIZE);
+    }
+    writeU32LE(e, (uint32_t)index->count);
+    writeU64LE(e + 4, index->totalRaw);
+    memcpy(e + 12, "HIDX", 4);
+    writeBytes(wr, e, INDEX_TRAILER_SIZE);
+}
+
+// Function to load the block index from the end of a mapped file into index (emptied first);
+// returns HUFF_ERR_CORRUPT if it is missing or invalid
+static int readBlockIndex(const unsigned char* base, size_t size, BlockIndex* index) {
+    const unsigned char* trailer;
+    size_t count, i, check;
+
+    resetBlockIndex(index);
+    if (size < FILE_HEADER_SIZE + 1 + INDEX_TRAILER_SIZE)
+        return HUFF_ERR_CORRUPT;
+    trailer = base + size - INDEX_TRAILER_SIZE;
+    if (memcmp(trailer + 12, "HIDX", 4) != 0)
+        return HUFF_ERR_CORRUPT;
+    count = readU32LE(trailer);
+    if (count > (size - FILE_HEADER_SIZE - 1 - INDEX_TRAILER_SIZE) / INDEX_ENTRY_SIZE)
+        return HUFF_ERR_CORRUPT;
+
+    const unsigned char* p = trailer - count * INDEX_ENTRY_SIZE;
+    size_t indexStart = (size_t)(p - base);
+    check = (base[4] & FLAG_CHECKSUM) ? CHECKSUM_SIZE : 0;
+    if (reserveBlockIndex(index, count, 0) != HUFF_OK)
+        return HUFF_ERR_NOMEM;
+    for (i = 0; i < count; i++, p += INDEX_ENTRY_SIZE) {
+        uint64_t offset = readU64LE(p);
+        uint32_t compSize = readU32LE(p + 8);
+        uint32_t rawSize = readU32LE(p + 12);
+        // Every block must lie between the file header and the index (checked without adding to
+        // the offset, which could wrap)
+        if (offset < FILE_HEADER_SIZE || offset > indexStart ||
+            indexStart - offset < BLOCK_HEADER_SIZE + (uint64_t)compSize + check || rawSize > MAX_BLOCK_SIZE)
+            return HUFF_ERR_CORRUPT;
+        addIndexEntry(index, offset, compSize, rawSize);
+    }
+    if (index->totalRaw != readU64LE(trailer + 4))
+        return HUFF_ERR_CORRUPT;
+
+    // Optional sync section right in front of the entries
+    if (indexStart >= 8 && memcmp(base + indexStart - 4, "HSYN", 4) == 0) {
+        uint32_t interval = readU32LE(base + indexStart - 8);
+        size_t total = 0;
+        for (i = 0; interval && i < count; i++)
+            total += syncPointsInBlock(index->entries[i].rawSize, interval);
+        if (interval && total <= (indexStart - 8) / 4) {
+            const unsigned char* s = base + indexStart - 8 - total * 4;
+            if (reserveBlockIndex(index, 0, total) != HUFF_OK)
+                return HUFF_ERR_NOMEM;
+            index->syncInterval = interval;
+            for (i = 0; i < total; i++)
+                index->sync[i] = readU32LE(s + 4 * i);
+            index->syncCount = total;
+            // Each block's sync points follow those of the blocks before it
+            for (i = 0, total = 0; i < count; i++) {
+                index->entries[i].firstSync = total;
+                total += syncPointsInBlock(index->entries[i].rawSize, interval);
+            }
+        }
+    }
+    return HUFF_OK;
+}
+
+// Function to write a finished block (header, payload and checksum) to the output
+static int writeBlock(Writer* wr, const BlockJob* job, BlockIndex* index) {
+    unsigned char hdr[9];
+    // A stored block is copied straight from the input
+    const unsigned char* payload = job->mode == BLOCK_STORED ? job->in : job->out.buf;
+    size_t size = job->mode == BLOCK_STORED ? job->n : job->out.pos;
+    int status = job->out.error;
+    if (status == HUFF_OK)
+        status = addIndexEntry(index, wr->written + wr->pos, (uint32_t)size, (uint32_t)job->n);
+    if (status == HUFF_OK)
+        status = addSyncPoints(index, job->sync, job->syncCount);
+    if (status != HUFF_OK)
+        return status;
+    hdr[0] = (unsigned char)job->mode;
+    writeU32LE(hdr + 1, (uint32_t)job->n);
+    writeU32LE(hdr + 5, (uint32_t)size);
+    writeBytes(wr, hdr, 9);
+    writeBytes(wr, payload, size);
+    if (job->opts->checksum) {
+        writeU32LE(hdr, job->crc);
+        writeBytes(wr, hdr, CHECKSUM_SIZE);
+        index->checksum = crc32cCombine(index->checksum, job->crc, job->n);
+    }
+    return wr->error;
+}
+
+// Function to get the encoder's ring of block jobs, allocating it (and, for inputs that are
+// not mapped, the block copies) on first use
+static int getBlockJobs(HuffEncoder* enc, int ring, int needCopy, BlockJob** out) {
+    Workspace* ws = &enc->ws;
+    const HuffOptions* opts = &enc->opts;
+    int i, status = HUFF_OK;
+
+    if (ws->blockJobs == NULL) {
+        ws->blockJobs = (BlockJob*)allocBuffer(&ws->stats, NULL, ring * sizeof(BlockJob));
+        if (ws->blockJobs == NULL)
+            return HUFF_ERR_NOMEM;
+        memset(ws->blockJobs, 0, ring * sizeof(BlockJob));
+        ws->blockJobCount = ring;
+        for (i = 0; i < ring && status == HUFF_OK; i++) {
+            BlockJob* job = &ws->blockJobs[i];
+            job->task.run = compressBlockTask;
+            job->task.arg = job;
+            job->opts = opts;
+            job->cs = ws->cs;
+            // Worst case payload: table plus MAX_CODE_LEN bits per byte
+            status = openMemoryWriter(&job->out, opts->blockSize / 8 * MAX_CODE_LEN + 256, &ws->stats);
+            job->sync = (uint32_t*)allocBuffer(&ws->stats, NULL, (opts->blockSize / (opts->syncInterval ? opts->syncInterval : opts->blockSize) + 1) * sizeof(uint32_t));
+            if (job->sync == NULL)
+                status = HUFF_ERR_NOMEM;
+        }
+    }
+    for (i = 0; i < ring && needCopy && status == HUFF_OK; i++) {
+        BlockJob* job = &ws->blockJobs[i];
+        if (job->copy == NULL) {
+            job->copy = (unsigned char*)allocBuffer(&ws->stats, NULL, opts->blockSize);
+            if (job->copy == NULL)
+                status = HUFF_ERR_NOMEM;
+        }
+    }
+    *out = ws->blockJobs;
+    return status;
+}
+
+// Function to compress the input as independent blocks on the encoder's worker threads
+static int compressBlocks(HuffEncoder* enc, Reader* rd, Writer* wr) {
+    const HuffOptions* opts = &enc->opts;
+    int threads = enc->workers.count;
+    int ring = threads > 1 ? 2 * threads : 1;   // Blocks in flight, so readers never wait on writers
+    size_t submitted = 0, retired = 0;
+    unsigned char hdr[FILE_HEADER_SIZE];
+    ThreadPool* pool;
+    BlockIndex* index = &enc->ws.index;
+    BlockJob* jobs;
+    int status;
+
+    // File header: magic, format version, flags, code length limit, block size
+    hdr[0] = 'H';
+    hdr[1] = 'U';
+    hdr[2] = 'F';
+    hdr[3] = FORMAT_BLOCKS;
+    hdr[4] = FLAG_INDEX | (opts->syncInterval ? FLAG_SYNC : 0) | (opts->streams > 1 ? FLAG_STREAMS : 0) |
+             (opts->checksum ? FLAG_CHECKSUM : 0);
+    index->stats = &enc->ws.stats;
+    resetBlockIndex(index);
+    index->syncInterval = (uint32_t)opts->syncInterval;
+    hdr[5] = (unsigned char)opts->maxCodeLen;
+    writeU32LE(hdr + 6, (uint32_t)opts->blockSize);
+    writeBytes(wr, hdr, FILE_HEADER_SIZE);
+
+    status = getPool(&enc->workers, &pool, &enc->ws.stats);
+    if (status == HUFF_OK)
+        status = getBlockJobs(enc, ring, !rd->mapped, &jobs);
+
+    // Read blocks in order; once the ring is full, retire the oldest block first
+    while (status == HUFF_OK) {
+        BlockJob* job = &jobs[submitted % ring];
+        if (submitted - retired == (size_t)ring) {
+            waitTask(pool, &job->task);
+            retired++;
+            if ((status = writeBlock(wr, job, index)) != HUFF_OK)
+                break;
+            releaseInput(rd, job->in, job->n);
+        }
+        job->n = readSpan(rd, opts->blockSize, &job->in, job->copy);
+        if (job->n == 0)
+            break;
+        submitTask(pool, &job->task);
+        submitted++;
+    }
+    if (status == HUFF_OK)
+        status = rd->error;
+
+    // Write the blocks still in flight, oldest first
+    for (; retired < submitted; retired++) {
+        BlockJob* job = &jobs[retired % ring];
+        waitTask(pool, &job->task);
+        if (status == HUFF_OK)
+            status = writeBlock(wr, job, index);
+    }
+    if (status == HUFF_OK) {
+        writeByte(wr, BLOCK_END);
+        if (opts->checksum) {
+            writeU32LE(hdr, index->checksum);
+            writeBytes(wr, hdr, CHECKSUM_SIZE);
+        }
+        writeBlockIndex(wr, index);
+        enc->ws.stats.processed += index->totalRaw;
+    }
+    return status;
+}
+
+// Function to count a mapped input on the encoder's worker threads, in rounds of one slice
+// per worker, and merge the slice histograms into freq
+static int countBytesParallel(HuffEncoder* enc, Reader* rd, uint64_t freq[256]) {
+    Workspace* ws = &enc->ws;
+    int count = enc->workers.count, active, i;
+    const unsigned char* in = rd->buf;
+    size_t n = rd->len, pos = 0;
+    ThreadPool* pool;
+    int status = getPool(&enc->workers, &pool, &ws->stats);
+
+    if (status != HUFF_OK)
+        return status;
+    if (ws->histJobs == NULL) {
+        ws->histJobs = (HistogramJob*)allocBuffer(&ws->stats, NULL, count * sizeof(HistogramJob));
+        if (ws->histJobs == NULL)
+            return HUFF_ERR_NOMEM;
+    }
+    while (pos < n) {
+        size_t start = pos;
+        for (active = 0; active < count && pos < n; active++) {
+            HistogramJob* job = &ws->histJobs[active];
+            job->task.run = countBytesTask;
+            job->task.arg = job;
+            job->cs = ws->cs;
+            job->in = in + pos;
+            job->n = n - pos < HISTOGRAM_SLICE ? n - pos : HISTOGRAM_SLICE;
+            submitTask(pool, &job->task);
+            pos += job->n;
+        }
+        for (i = 0; i < active; i++) {
+            waitTask(pool, &ws->histJobs[i].task);
+            for (int s = 0; s < 256; s++)
+                freq[s] += ws->histJobs[i].freq[s];
+        }
+        releaseInput(rd, in + start, pos - start);
+    }
+    return HUFF_OK;
+}
+
+// Pool task: work out how many bits a slice takes with the shared code table
+static void measureSliceTask(void* arg) {
+    EncodeJob* job = (EncodeJob*)arg;
+    uint64_t freq[256] = {0};
+    PhaseMark mark;
+    markPhase(job->cs, &mark);
+    countBytes(job->in, job->n, freq);
+    job->bits = 0;
+    for (int s = 0; s < 256; s++)
+        job->bits += freq[s] * (uint64_t)job->table[s].l;
+    endPhase(job->cs, HUFF_PHASE_ENCODE, &mark);
+}
+
+// Pool task: encode a slice whose first bit lands align bits into its first byte
+static void encodeSliceTask(void* arg) {
+    EncodeJob* job = (EncodeJob*)arg;
+    BitWriter bw = { 0, job->align, &job->out };
+    PhaseMark mark;
+    markPhase(job->cs, &mark);
+    rewindWriter(&job->out);
+    for (size_t i = 0; i < job->n; i++)
+        putCode(&bw, &job->table[job->in[i]]);
+    flushBits(&bw);
+    endPhase(job->cs, HUFF_PHASE_ENCODE, &mark);
+}
+
+// Function to encode a mapped input as one bitstream on the encoder's worker threads; the
+// output is identical to compressFile(). Each round gives every worker a slice: the slices
+// are first measured, a prefix sum of their sizes gives each one its starting bit, and then
+// they are encoded side by side. Only the byte shared by two neighbouring slices is merged
+static int compressFileParallel(HuffEncoder* enc, Reader* rd, Writer* wr, const code table[256],
+                                int finalByte) {
+    Workspace* ws = &enc->ws;
+    int count = enc->workers.count, active, i;
+    const unsigned char* in = rd->buf;
+    size_t n = rd->len, pos = 0;
+    uint64_t bitPos = 0;
+    int pending = -1;       // Partial byte left by the previous slice, or -1
+    ThreadPool* pool;
+    int status = getPool(&enc->workers, &pool, &ws->stats);
+
+    if (status != HUFF_OK)
+        return status;
+    if (ws->encodeJobs == NULL) {
+        ws->encodeJobs = (EncodeJob*)allocBuffer(&ws->stats, NULL, count * sizeof(EncodeJob));
+        if (ws->encodeJobs == NULL)
+            return HUFF_ERR_NOMEM;
+        memset(ws->encodeJobs, 0, count * sizeof(EncodeJob));
+        ws->encodeJobCount = count;
+        for (i = 0; i < count && status == HUFF_OK; i++)
+            status = openMemoryWriter(&ws->encodeJobs[i].out, ENCODE_SLICE, &ws->stats);
+        if (status != HUFF_OK)
+            return status;
+    }
+    EncodeJob* jobs = ws->encodeJobs;
+
+    while (pos < n && status == HUFF_OK) {
+        size_t start = pos;
+        // Measure this round's slices
+        for (active = 0; active < count && pos < n; active++) {
+            EncodeJob* job = &jobs[active];
+            job->table = table;
+            job->cs = ws->cs;
+            job->in = in + pos;
+            job->n = n - pos < ENCODE_SLICE ? n - pos : ENCODE_SLICE;
+            job->task.run = measureSliceTask;
+            job->task.arg = job;
+            submitTask(pool, &job->task);
+            pos += job->n;
+        }
+        for (i = 0; i < active; i++)
+            waitTask(pool, &jobs[i].task);
+
+        // Prefix sum of the slice sizes, then encode every slice at its offset
+        for (i = 0; i < active; i++) {
+            jobs[i].align = (int)(bitPos % 8);
+            bitPos += jobs[i].bits;
+            jobs[i].task.run = encodeSliceTask;
+            submitTask(pool, &jobs[i].task);
+        }
+
+        // Write the slices in order, joining the byte two slices share
+        for (i = 0; i < active; i++) {
+            EncodeJob* job = &jobs[i];
+            waitTask(pool, &job->task);
+            if ((status = job->out.error) != HUFF_OK)
+                continue;
+            size_t len = job->out.pos;
+            if (len == 0)
+                continue;
+            if (pending >= 0)
+                job->out.buf[0] |= (unsigned char)pending;
+            if ((job->align + job->bits) % 8 != 0) {
+                // The last byte is shared with the next slice
+                pending = job->out.buf[len - 1];
+                len--;
+            }
+            else {
+                pending = -1;
+            }
+            writeBytes(wr, job->out.buf, len);
+        }
+        releaseInput(rd, in + start, pos - start);
+    }
+
+    // The final partial byte is zero padded, as flushBits() leaves it
+    if ((pending >= 0 || finalByte) && status == HUFF_OK)
+        writeByte(wr, pending >= 0 ? (unsigned char)pending : 0);
+    rd->pos = rd->len;
+    return status;
+}
+
+// Function to compress the input with one code table (formats 1 and 2); reads the input twice
+static int compressSingle(HuffEncoder* enc, Reader* rd, Writer* wr) {
+    const unsigned char* chunk;
+    size_t len;
+    uint64_t freq[256] = {0};  // Initialize frequency array for all possible characters
+    uint64_t total = 0;        // Total number of characters in the file
+    code table[256];
+    CallStats* cs = enc->ws.cs;
+    PhaseMark mark;
+    int status;
+
+    // The single-table formats read the input twice, so it must be seekable
+    if (!rd->mapped && (rd->fd < 0 || lseek(rd->fd, 0, SEEK_CUR) == -1))
+        return HUFF_ERR_UNSUPPORTED;
+
+    // A large mapped input is counted in slices on the worker threads (which time themselves)
+    if (rd->mapped && enc->workers.count > 1 && rd->len >= PARALLEL_HISTOGRAM_MIN) {
+        if ((status = countBytesParallel(enc, rd, freq)) != HUFF_OK)
+            return status;
+        total = rd->len;
+        rd->pos = rd->len;
+    }
+
+    // Read each buffered chunk and update frequencies
+    markPhase(cs, &mark);
+    while ((len = readChunk(rd, &chunk)) != 0) {
+        countBytes(chunk, len, freq);
+        total += len;
+    }
+    endPhase(cs, HUFF_PHASE_HISTOGRAM, &mark);
+    if (rd->error != HUFF_OK)
+        return rd->error;
+    // The original header stores the total as a signed int; the compact one takes 64 bits
+    if (enc->opts.format == FORMAT_LEGACY && total > 0x7FFFFFFFu)
+        return HUFF_ERR_UNSUPPORTED;
+
+    // Count unique characters
+    int uniqueChars = 0;
+    for (int i = 0; i < 256; i++) {
+        if (freq[i] > 0) {
+            uniqueChars++;
+        }
+    }
+
+    // The original format cannot represent an empty file, so that always uses the compact header
+    int legacy = enc->opts.format == FORMAT_LEGACY && uniqueChars > 0;
+    if (legacy) {
+        // Create arrays for unique characters and their frequencies
+        char arr[256];
+        int freqArr[256];
+        int index = 0;
+        int totalChars = (int)total;
+
+        // Fill the arrays
+        for (int i = 0; i < 256; i++) {
+            if (freq[i] > 0) {
+                arr[index] = (char)i;
+                freqArr[index] = (int)freq[i];
+                index++;
+            }
+        }
+
+        // Write header information to compressed file
+        writeBytes(wr, &uniqueChars, sizeof(int));  // Number of unique characters
+        writeBytes(wr, &totalChars, sizeof(int));   // Total number of characters
+
+        // Build Huffman tree
+        NodePool pool;
+        struct Node* root = buildHuffmanTree(&pool, arr, freqArr, uniqueChars);
+
+        // Generate Huffman codes and write to file
+        int codeArr[MAX];
+        memset(table, 0, sizeof(table));
+        printCodesIntoFile(wr, root, codeArr, 0, table);
+    }
+    else {
+        // Length-limited canonical codes; only their lengths go into the header
+        int lengths[256];
+        buildLimitedCodeLengths(freq, enc->opts.maxCodeLen, lengths);
+        assignCanonicalCodes(lengths, table);
+        writeCompactHeader(wr, total, enc->opts.maxCodeLen, table);
+    }
+    noteBlock(cs, BLOCK_HUFFMAN);
+    noteHistogram(cs, freq, table);
+    endPhase(cs, HUFF_PHASE_TREE, &mark);
+
+    // Compress the file using generated codes, on all workers when the input is mapped
+    if (rd->mapped && enc->workers.count > 1 && rd->len >= PARALLEL_ENCODE_MIN) {
+        status = compressFileParallel(enc, rd, wr, table, legacy);
+    }
+    else {
+        status = compressFile(rd, wr, table, legacy);
+        endPhase(cs, HUFF_PHASE_ENCODE, &mark);
+    }
+    if (status == HUFF_OK)
+        enc->ws.stats.processed += total;
+    return status != HUFF_OK ? status : wr->error;
+}
+
+// Function to compress the input with the attached dictionary (format 4): there is no
+// frequency count and no tree, the header holds only the dictionary ID and the input size
+static int compressDictionary(HuffEncoder* enc, Reader* rd, Writer* wr) {
+    unsigned char hdr[8 + MAX_VARINT_SIZE];
+    const unsigned char* chunk;
+    CallStats* cs = enc->ws.cs;
+    uint64_t start;
+    PhaseMark mark;
+    Reader mem;
+    size_t len;
+    int status;
+
+    if (!enc->hasDict)
+        return HUFF_ERR_ARGUMENT;
+    // The size comes first, so input that is not in memory is collected in the scratch buffer
+    // (dictionary inputs are meant to be small records; larger ones would make memory unbounded)
+    if (!rd->mapped) {
+        Writer* tmp = &enc->ws.scratch;
+        if (tmp->buf == NULL && (status = openMemoryWriter(tmp, 0, &enc->ws.stats)) != HUFF_OK)
+            return status;
+        rewindWriter(tmp);
+        while ((len = readChunk(rd, &chunk)) != 0) {
+            if (len > MAX_DICTIONARY_STREAM - tmp->pos)
+                return HUFF_ERR_UNSUPPORTED;
+            writeBytes(tmp, chunk, len);
+        }
+        if (rd->error != HUFF_OK || tmp->error != HUFF_OK)
+            return rd->error != HUFF_OK ? rd->error : tmp->error;
+        openMemoryReader(&mem, tmp->buf, tmp->pos);
+        rd = &mem;
+    }
+
+    // Magic, format version, dictionary ID and input size
+    hdr[0] = 'H';
+    hdr[1] = 'U';
+    hdr[2] = 'F';
+    hdr[3] = FORMAT_DICTIONARY;
+    writeU32LE(hdr + 4, enc->dict.id);
+    writeBytes(wr, hdr, 8 + (size_t)writeVarint(hdr + 8, rd->len));
+
+    // Encode with the dictionary's codes, on all workers for a large mapped input
+    start = wr->written + wr->pos;
+    if (enc->workers.count > 1 && rd->len >= PARALLEL_ENCODE_MIN) {
+        status = compressFileParallel(enc, rd, wr, enc->dict.table, 0);
+    }
+    else {
+        markPhase(cs, &mark);
+        status = compressFile(rd, wr, enc->dict.table, 0);
+        endPhase(cs, HUFF_PHASE_ENCODE, &mark);
+    }
+    noteBlock(cs, BLOCK_HUFFMAN);
+    noteCodeTable(cs, enc->dict.table, (wr->written + wr->pos - start) * 8, rd->len);
+    if (status == HUFF_OK)
+        enc->ws.stats.processed += rd->len;
+    return status != HUFF_OK ? status : wr->error;
+}
+
+// Function to rebuild the adaptive codes from the counts, then age the counts so that recent
+// bytes weigh more; returns 1 if any code length changed
+static int rebuildAdaptiveModel(AdaptiveModel* m) {
+    int lengths[256], changed = 0, s;
+    uint64_t total = 0;
+
+    buildLimitedCodeLengths(m->freq, m->maxLen, lengths);
+    for (s = 0; s < 256; s++)
+        changed |= lengths[s] != m->table[s].l;
+    if (changed)
+        assignCanonicalCodes(lengths, m->table);
+    for (s = 0; s < 256; s++)
+        total += m->freq[s];
+    while (total > ADAPT_WINDOW) {
+        total = 0;
+        for (s = 0; s < 256; s++) {
+            m->freq[s] = (m->freq[s] + 1) >> 1;
+            total += m->freq[s];
+        }
+    }
+    // Rebuilds come often while the model learns and settle at the interval
+    m->step = m->step < m->interval / 2 ? m->step * 2 : m->interval;
+    m->left = m->step;
+    return changed;
+}
+
+// Function to start an adaptive model: every byte value counted once, so all start with 8-bit codes
+static void initAdaptiveModel(AdaptiveModel* m, int maxLen, size_t interval) {
+    for (int s = 0; s < 256; s++) {
+        m->freq[s] = 1;
+        m->table[s].l = 0;
+    }
+    m->maxLen = maxLen;
+    m->interval = interval;
+    m->step = ADAPT_FIRST_STEP / 2;
+    // The rebuild doubles the step, so the first gap is ADAPT_FIRST_STEP
+    rebuildAdaptiveModel(m);
+}
+
+// Function to add the counts of n bytes just coded with the model's codes to the model
+static void countAdaptive(AdaptiveModel* m, const unsigned char* p, size_t n, CallStats* cs) {
+    uint64_t seg[256] = {0};
+    countBytes(p, n, seg);
+    for (int s = 0; s < 256; s++)
+        m->freq[s] += seg[s];
+    noteHistogram(cs, seg, m->table);
+}
+
+// Function to compress the input in the adaptive format (format 5): no code table is stored,
+// both sides rebuild the codes from the bytes coded so far. Input is coded in chunks as it
+// arrives, and what a pipe or callback delivered is written out before the next read
+static int compressAdaptive(HuffEncoder* enc, Reader* rd, Writer* wr) {
+    unsigned char hdr[6 + 2 * MAX_VARINT_SIZE];
+    const unsigned char* chunk;
+    const HuffOptions* opts = &enc->opts;
+    Writer* tmp = &enc->ws.scratch;
+    CallStats* cs = enc->ws.cs;
+    AdaptiveModel m;
+    uint32_t crc = 0;
+    PhaseMark mark;
+    size_t len, n, i, take;
+    int status, flush = !rd->mapped && (wr->fd >= 0 || wr->sink != NULL);
+
+    if (tmp->buf == NULL && (status = openMemoryWriter(tmp, 0, &enc->ws.stats)) != HUFF_OK)
+        return status;
+
+    // Magic, format version, flags, code length limit and rebuild interval
+    hdr[0] = 'H';
+    hdr[1] = 'U';
+    hdr[2] = 'F';
+    hdr[3] = FORMAT_ADAPTIVE;
+    hdr[4] = opts->checksum ? FLAG_CHECKSUM : 0;
+    hdr[5] = (unsigned char)opts->maxCodeLen;
+    writeBytes(wr, hdr, 6 + (size_t)writeVarint(hdr + 6, opts->adaptInterval));
+
+    markPhase(cs, &mark);
+    initAdaptiveModel(&m, opts->maxCodeLen, opts->adaptInterval);
+    endPhase(cs, HUFF_PHASE_TREE, &mark);
+    while ((len = readChunk(rd, &chunk)) != 0) {
+        for (; len > 0; chunk += n, len -= n) {
+            n = len < ADAPT_MAX_CHUNK ? len : ADAPT_MAX_CHUNK;
+            if (opts->checksum) {
+                crc = crc32c(crc, chunk, n);
+                endPhase(cs, HUFF_PHASE_CHECKSUM, &mark);
+            }
+
+            // The chunk's bitstream goes to the scratch buffer until its size is known
+            BitWriter bw = { 0, 0, tmp };
+            rewindWriter(tmp);
+            for (i = 0; i < n; i += take) {
+                take = n - i < m.left ? n - i : m.left;
+                for (size_t k = i; k < i + take; k++)
+                    putBits(&bw, (uint32_t)m.table[chunk[k]].bits, m.table[chunk[k]].l);
+                endPhase(cs, HUFF_PHASE_ENCODE, &mark);
+                countAdaptive(&m, chunk + i, take, cs);
+                endPhase(cs, HUFF_PHASE_HISTOGRAM, &mark);
+                if ((m.left -= take) == 0) {
+                    rebuildAdaptiveModel(&m);
+                    endPhase(cs, HUFF_PHASE_TREE, &mark);
+                }
+            }
+            flushBits(&bw);
+            if (tmp->error != HUFF_OK)
+                return tmp->error;
+
+            // Chunk: uncompressed and compressed sizes, then the bitstream
+            i = (size_t)writeVarint(hdr, n);
+            i += (size_t)writeVarint(hdr + i, tmp->pos);
+            writeBytes(wr, hdr, i);
+            writeBytes(wr, tmp->buf, tmp->pos);
+            endPhase(cs, HUFF_PHASE_ENCODE, &mark);
+            noteBlock(cs, BLOCK_HUFFMAN);
+            enc->ws.stats.processed += n;
+        }
+        if (flush && wr->pos > 0)
+            flushWriter(wr);
+    }
+    if (rd->error != HUFF_OK)
+        return rd->error;
+
+    // A chunk of no bytes ends the data, followed by the CRC32C of all of it
+    writeByte(wr, 0);
+    if (opts->checksum) {
+        writeU32LE(hdr, crc);
+        writeBytes(wr, hdr, CHECKSUM_SIZE);
+    }
+    return wr->error;
+}
+
+// Function to compress rd into wr in the encoder's format
+static int compressAny(HuffEncoder* enc, Reader* rd, Writer* wr) {
+    uint64_t before = wr->written + wr->pos, processed = enc->ws.stats.processed;
+    PhaseMark start;
+    AllocStats mem;
+    int status;
+    beginCall(&enc->ws, &start, &mem);
+    if (enc->opts.format == FORMAT_BLOCKS)
+        // Blocks are read, compressed and written in a single pass
+        status = compressBlocks(enc, rd, wr);
+    else if (enc->opts.format == FORMAT_DICTIONARY)
+        status = compressDictionary(enc, rd, wr);
+    else if (enc->opts.format == FORMAT_ADAPTIVE)
+        status = compressAdaptive(enc, rd, wr);
+    else
+        status = compressSingle(enc, rd, wr);
+    endCall(&enc->ws, &start, &mem, enc->ws.stats.processed - processed, wr->written + wr->pos - before);
+    return status != HUFF_OK ? status : wr->error;
+}
+
+// Function to read the code table at the start of a block payload and locate the block's
+// bitstreams in *ly (flags are the file header flags)
+static int parseBlockCodes(const unsigned char* payload, size_t compSize, size_t rawSize, int maxLen,
+                           int flags, code table[256], StreamLayout* ly) {
+    int lengths[256];
+    Reader block;
+    int n = 1;
+
+    openMemoryReader(&block, payload, compSize);
+    if (!readCodeLengths(&block, maxLen, lengths) || !assignCanonicalCodes(lengths, table))
+        return HUFF_ERR_CORRUPT;
+    ly->begin[0] = block.pos;
+    if (flags & FLAG_STREAMS) {
+        // Jump table: stream count, then the sizes of all streams but the last
+        n = readByte(&block);
+        if (n < 1 || n > MAX_STREAMS || compSize - block.pos < 4 * (size_t)(n - 1))
+            return HUFF_ERR_CORRUPT;
+        ly->begin[0] = block.pos + 4 * (size_t)(n - 1);
+        for (int k = 1; k < n; k++) {
+            ly->begin[k] = ly->begin[k - 1] + readU32LE(payload + block.pos + 4 * (k - 1));
+            if (ly->begin[k] > compSize)
+                return HUFF_ERR_CORRUPT;
+        }
+    }
+    ly->count = n;
+    ly->begin[n] = compSize;
+    ly->segment = segmentSize(rawSize, n);
+    return HUFF_OK;
+}
+
+// Function to load the code table at the start of a block payload into dt and locate the
+// block's bitstreams in *ly (flags are the file header flags); the codes are noted in cs unless it is NULL
+static int parseBlockTable(const unsigned char* payload, size_t compSize, size_t rawSize, int maxLen,
+                           int flags, int bits, DecodeTable* dt, StreamLayout* ly, CallStats* cs) {
+    code table[256];
+    int status = parseBlockCodes(payload, compSize, rawSize, maxLen, flags, table, ly);
+    if (status != HUFF_OK)
+        return status;
+    noteCodeTable(cs, table, (uint64_t)(compSize - ly->begin[0]) * 8, rawSize);
+    return loadDecodeTable(dt, table, bits, NULL);
+}
+
+// Function to make room for n more bytes in a memory writer, returns where they go (NULL on error)
+static unsigned char* reserveWriter(Writer* wr, size_t n) {
+    while (wr->cap - wr->pos < n && wr->error == HUFF_OK) {
+        if (!wr->growable) {
+            wr->error = HUFF_ERR_SPACE;
+            break;
+        }
+        flushWriter(wr);
+    }
+    return wr->error == HUFF_OK ? wr->buf + wr->pos : NULL;
+}
+
+// Function to decode one block payload of the given mode into out (phase times go to cs unless it is NULL)
+static int decodeBlock(int mode, const unsigned char* payload, size_t compSize, size_t rawSize, int maxLen,
+                       int flags, int bits, DecodeTable* dt, Writer* out, CallStats* cs) {
+    Reader block;
+    StreamLayout ly;
+    PhaseMark mark;
+    int status;
+
+    markPhase(cs, &mark);
+    noteBlock(cs, mode);
+    // Stored and single-symbol blocks need no table
+    if (mode == BLOCK_STORED || mode == BLOCK_RLE) {
+        if (compSize != (mode == BLOCK_STORED ? rawSize : 1))
+            return HUFF_ERR_CORRUPT;
+        unsigned char* dst = reserveWriter(out, rawSize);
+        if (dst == NULL)
+            return out->error;
+        if (mode == BLOCK_STORED) {
+            memcpy(dst, payload, rawSize);
+        }
+        else {
+            memset(dst, payload[0], rawSize);
+            if (cs != NULL) {
+                uint64_t symbols[4] = {0};
+                symbols[payload[0] >> 6] = (uint64_t)1 << (payload[0] & 63);
+                noteCoding(cs, symbols, 0, 0, 0);
+            }
+        }
+        out->pos += rawSize;
+        endPhase(cs, HUFF_PHASE_DECODE, &mark);
+        return HUFF_OK;
+    }
+    if (mode != BLOCK_HUFFMAN)
+        return HUFF_ERR_CORRUPT;
+
+    // Code lengths and bitstreams
+    if ((status = parseBlockTable(payload, compSize, rawSize, maxLen, flags, bits, dt, &ly, cs)) != HUFF_OK)
+        return status;
+    endPhase(cs, HUFF_PHASE_HEADER, &mark);
+
+    if (ly.count == 1) {
+        openMemoryReader(&block, payload + ly.begin[0], compSize - ly.begin[0]);
+        status = decompressFile(&block, out, dt, rawSize);
+        endPhase(cs, HUFF_PHASE_DECODE, &mark);
+        return status != HUFF_OK ? status : out->error;
+    }
+
+    // Several streams are decoded together, straight into the output buffer
+    unsigned char* dst = reserveWriter(out, rawSize);
+    if (dst == NULL)
+        return out->error;
+    status = decodeInterleaved(payload, &ly, dt, dst, rawSize);
+    if (status == HUFF_OK)
+        out->pos += rawSize;
+    endPhase(cs, HUFF_PHASE_DECODE, &mark);
+    return status;
+}
+
+// Function to check the decoded data of a block against the CRC32C stored after its payload
+static int checkBlock(const unsigned char* data, size_t n, uint32_t expected, CallStats* cs) {
+    PhaseMark mark;
+    markPhase(cs, &mark);
+    uint32_t crc = crc32c(0, data, n);
+    endPhase(cs, HUFF_PHASE_CHECKSUM, &mark);
+    return crc == expected ? HUFF_OK : HUFF_ERR_CHECKSUM;
+}
+
+// Function to check the CRC32C after the end marker of a mapped container against the block
+// checksums joined in order (each of them already matched its block's data)
+static int checkFileChecksum(const unsigned char* base, size_t size, const BlockIndex* index) {
+    uint64_t end = FILE_HEADER_SIZE;
+    uint32_t crc = 0;
+    for (size_t i = 0; i < index->count; i++) {
+        const BlockIndexEntry* e = &index->entries[i];
+        end = e->offset + BLOCK_HEADER_SIZE + e->compSize;
+        crc = crc32cCombine(crc, readU32LE(base + end), e->rawSize);
+        end += CHECKSUM_SIZE;
+    }
+    if (end + 1 + CHECKSUM_SIZE > size || base[end] != BLOCK_END)
+        return HUFF_ERR_CORRUPT;
+    return readU32LE(base + end + 1) == crc ? HUFF_OK : HUFF_ERR_CHECKSUM;
+}
+
+// Function to decode the block with the given index number into out
+static int decodeIndexedBlock(ParallelDecode* pd, size_t i, DecodeJob* job, Writer* out) {
+    const BlockIndexEntry* e = &pd->index->entries[i];
+    const unsigned char* hdr = pd->base + e->offset;
+
+    // The block header must agree with the index
+    if (readU32LE(hdr + 1) != e->rawSize || readU32LE(hdr + 5) != e->compSize)
+        return HUFF_ERR_CORRUPT;
+    rewindWriter(out);
+    int status = decodeBlock(hdr[0], hdr + BLOCK_HEADER_SIZE, e->compSize, e->rawSize, pd->maxLen, pd->flags,
+                             pd->tableBits, &job->dt, out, job->cs);
+    // Checked while the block is still in cache
+    if (status == HUFF_OK && (pd->flags & FLAG_CHECKSUM))
+        status = checkBlock(out->buf, out->pos, readU32LE(hdr + BLOCK_HEADER_SIZE + e->compSize), job->cs);
+    if (pd->release)
+        releaseMapped(hdr, BLOCK_HEADER_SIZE + e->compSize);
+    return status;
+}
+
+// Function to write a decoded block at its final offset in the output file
+static int pwriteAll(int fd, const unsigned char* buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return HUFF_ERR_IO;
+        }
+        done += (size_t)n;
+    }
+    return HUFF_OK;
+}
+
+// Pool task: claim blocks until none are left and put each one at its final position,
+// in the output file or straight into the target buffer (or nowhere, when only verifying)
+static void decodeWorkerTask(void* arg) {
+    DecodeJob* job = (DecodeJob*)arg;
+    ParallelDecode* pd = job->shared;
+    job->status = HUFF_OK;
+    for (;;) {
+        pthread_mutex_lock(&pd->lock);
+        size_t i = pd->next++;
+        pthread_mutex_unlock(&pd->lock);
+        if (i >= pd->index->count)
+            break;
+        const BlockIndexEntry* e = &pd->index->entries[i];
+
+        if (pd->target != NULL) {
+            // Decode in place; the block fills exactly its share of the buffer
+            Writer direct;
+            unsigned char spare;
+            openFixedWriter(&direct, e->rawSize ? pd->target + e->rawOffset : &spare,
+                            e->rawSize ? e->rawSize : 1);
+            job->status = decodeIndexedBlock(pd, i, job, &direct);
+        }
+        else {
+            job->status = decodeIndexedBlock(pd, i, job, &job->out);
+            if (job->status == HUFF_OK && pd->fd >= 0)
+                job->status = pwriteAll(pd->fd, job->out.buf, job->out.pos, e->rawOffset);
+        }
+        if (job->status != HUFF_OK) {
+            // Make the other workers stop early
+            pthread_mutex_lock(&pd->lock);
+            pd->next = pd->index->count;
+            pthread_mutex_unlock(&pd->lock);
+            break;
+        }
+    }
+}
+
+// Pool task: decode a single block for in-order output
+static void decodeOrderedTask(void* arg) {
+    DecodeJob* job = (DecodeJob*)arg;
+    job->status = decodeIndexedBlock(job->shared, job->block, job, &job->out);
+}
+
+// Pool task: decode a block that was read from a stream
+static void decodeStreamTask(void* arg) {
+    DecodeJob* job = (DecodeJob*)arg;
+    rewindWriter(&job->out);
+    job->status = decodeBlock(job->mode, job->payload, job->compSize, job->rawSize, job->maxLen, job->flags, job->tableBits,
+                              &job->dt, &job->out, job->cs);
+    if (job->status == HUFF_OK && (job->flags & FLAG_CHECKSUM))
+        job->status = checkBlock(job->out.buf, job->out.pos, job->crc, job->cs);
+}
+
+// Function to get the decoder's jobs (as many as the ring of blocks in flight), giving the
+// first count of them an output buffer unless withOut is 0
+static int getDecodeJobs(HuffDecoder* dec, int count, size_t blockCap, int withOut, DecodeJob** out) {
+    Workspace* ws = &dec->ws;
+    int threads = dec->workers.count;
+    int ring = threads > 1 ? 2 * threads : 1;
+    int i, status = HUFF_OK;
+
+    if (ws->decodeJobs == NULL) {
+        ws->decodeJobs = (DecodeJob*)allocBuffer(&ws->stats, NULL, ring * sizeof(DecodeJob));
+        if (ws->decodeJobs == NULL)
+            return HUFF_ERR_NOMEM;
+        memset(ws->decodeJobs, 0, ring * sizeof(DecodeJob));
+        ws->decodeJobCount = ring;
+        for (i = 0; i < ring; i++) {
+            ws->decodeJobs[i].dt.stats = &ws->stats;
+            ws->decodeJobs[i].cs = ws->cs;
+        }
+    }
+    for (i = 0; i < ws->decodeJobCount && dec->opts.tableCache > 0 && status == HUFF_OK; i++) {
+        if (ws->decodeJobs[i].dt.cache == NULL)
+            status = attachTableCache(&ws->decodeJobs[i].dt, dec->opts.tableCache);
+    }
+    for (i = 0; i < count && withOut && status == HUFF_OK; i++) {
+        if (ws->decodeJobs[i].out.buf == NULL)
+            status = openMemoryWriter(&ws->decodeJobs[i].out, blockCap, &ws->stats);
+    }
+    *out = ws->decodeJobs;
+    return status;
+}
+
+// Function to decode all blocks of an indexed container held whole by rd on the decoder's
+// worker threads
+static int decompressParallel(HuffDecoder* dec, const Reader* rd, const BlockIndex* index, int maxLen, int flags, size_t blockCap, Writer* wr) {
+    int threads = dec->workers.count;
+    struct stat st;
+    ParallelDecode pd;
+    ThreadPool* pool;
+    DecodeJob* jobs;
+    int i, jobCount, mode;
+    int status = getPool(&dec->workers, &pool, &dec->ws.stats);
+
+    if (status != HUFF_OK)
+        return status;
+    pd.base = rd->buf;
+    pd.size = rd->len;
+    pd.release = rd->owned;
+    pd.index = index;
+    pd.maxLen = maxLen;
+    pd.flags = flags;
+    pd.tableBits = dec->opts.tableBits;
+    pd.fd = wr->fd;
+    pd.target = NULL;
+    pd.next = 0;
+
+    // A fixed buffer or a regular file is filled in place, and blocks that are only checked
+    // go nowhere; anything else gets the blocks in order
+    if (wr->discard) {
+        mode = 1;
+    }
+    else if (!wr->growable && wr->sink == NULL && wr->fd < 0 && wr->pos == 0) {
+        if (index->totalRaw > wr->cap)
+            return HUFF_ERR_SPACE;
+        pd.target = wr->buf;
+        mode = 1;
+    }
+    else {
+        mode = wr->fd >= 0 && wr->pos == 0 && wr->written == 0 && fstat(wr->fd, &st) == 0 &&
+               S_ISREG(st.st_mode) && lseek(wr->fd, 0, SEEK_CUR) == 0;
+    }
+    jobCount = mode ? threads : (threads > 1 ? 2 * threads : 1);
+    if ((status = getDecodeJobs(dec, jobCount, blockCap, pd.target == NULL, &jobs)) != HUFF_OK)
+        return status;
+    pthread_mutex_init(&pd.lock, NULL);
+    for (i = 0; i < jobCount; i++) {
+        jobs[i].shared = &pd;
+        jobs[i].task.arg = &jobs[i];
+        jobs[i].task.run = mode ? decodeWorkerTask : decodeOrderedTask;
+    }
+
+    if (status != HUFF_OK) {
+        // Setup failed, nothing was started
+    }
+    else if (mode) {
+        // Size the output up front, then let every worker pull blocks
+        if (pd.target == NULL && pd.fd >= 0 && ftruncate(wr->fd, (off_t)index->totalRaw) != 0)
+            status = HUFF_ERR_IO;
+        for (i = 0; i < jobCount && status == HUFF_OK; i++)
+            submitTask(pool, &jobs[i].task);
+        for (int j = 0; j < i; j++) {
+            waitTask(pool, &jobs[j].task);
+            if (status == HUFF_OK)
+                status = jobs[j].status;
+        }
+        if (pd.target != NULL && status == HUFF_OK)
+            wr->pos = (size_t)index->totalRaw;
+        else if (status == HUFF_OK)
+            wr->written += index->totalRaw;
+    }
+    else {
+        // Keep a ring of blocks in flight and write each one as soon as its predecessors are out
+        size_t submitted = 0, retired = 0;
+        while (status == HUFF_OK && submitted < index->count) {
+            DecodeJob* job = &jobs[submitted % jobCount];
+            if (submitted - retired == (size_t)jobCount) {
+                waitTask(pool, &job->task);
+                retired++;
+                if ((status = job->status) != HUFF_OK)
+                    break;
+                writeBytes(wr, job->out.buf, job->out.pos);
+                if ((status = wr->error) != HUFF_OK)
+                    break;
+            }
+            job->block = submitted++;
+            submitTask(pool, &job->task);
+        }
+        for (; retired < submitted; retired++) {
+            DecodeJob* job = &jobs[retired % jobCount];
+            waitTask(pool, &job->task);
+            if (status == HUFF_OK)
+                status = job->status;
+            if (status == HUFF_OK)
+                writeBytes(wr, job->out.buf, job->out.pos);
+        }
+    }
+
+    pthread_mutex_destroy(&pd.lock);
+    return status != HUFF_OK ? status : wr->error;
+}
+
+// Function to decompress a block container (format version 3)
+static int decompressBlocks(HuffDecoder* dec, Reader* rd, Writer* wr) {
+    unsigned char hdr[6], bhdr[8];
+    BlockIndex* index = &dec->ws.index;
+    size_t blockCap;
+    int maxLen, status, fileStatus = HUFF_OK;
+    uint32_t crc = 0;
+
+    // Flags, code length limit and block size
+    if (readBytes(rd, hdr, 6) != 6 || hdr[1] < 1 || hdr[1] > MAX_CODE_LEN)
+        return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+    maxLen = hdr[1];
+    blockCap = readU32LE(hdr + 2);
+    if (blockCap > MAX_BLOCK_SIZE)
+        blockCap = MAX_BLOCK_SIZE;
+
+    // With the whole file mapped, the index lets the blocks be decoded in parallel
+    if ((hdr[0] & FLAG_INDEX) && rd->mapped) {
+        PhaseMark mark;
+        markPhase(dec->ws.cs, &mark);
+        index->stats = &dec->ws.stats;
+        status = readBlockIndex(rd->buf, rd->len, index);
+        endPhase(dec->ws.cs, HUFF_PHASE_HEADER, &mark);
+        if (status == HUFF_OK) {
+            status = decompressParallel(dec, rd, index, maxLen, hdr[0], blockCap, wr);
+            if (status == HUFF_OK && (hdr[0] & FLAG_CHECKSUM)) {
+                status = checkFileChecksum(rd->buf, rd->len, index);
+                dec->ws.checked = status == HUFF_OK;
+            }
+            return status;
+        }
+        // A damaged index only costs random access and parallel decoding, but a check must report it
+        if (status == HUFF_ERR_NOMEM || wr->discard)
+            return status;
+    }
+
+    // Otherwise stream: read blocks in order, decode them on the pool and write them in order
+    int threads = dec->workers.count;
+    int ring = threads > 1 ? 2 * threads : 1;
+    size_t submitted = 0, retired = 0, i;
+    ThreadPool* pool;
+    DecodeJob* jobs;
+
+    if ((status = getPool(&dec->workers, &pool, &dec->ws.stats)) != HUFF_OK ||
+        (status = getDecodeJobs(dec, ring, blockCap, 1, &jobs)) != HUFF_OK)
+        return status;
+    for (i = 0; i < (size_t)ring; i++) {
+        jobs[i].task.run = decodeStreamTask;
+        jobs[i].task.arg = &jobs[i];
+        jobs[i].maxLen = maxLen;
+        jobs[i].flags = hdr[0];
+        jobs[i].tableBits = dec->opts.tableBits;
+    }
+
+    while (status == HUFF_OK) {
+        DecodeJob* job = &jobs[submitted % ring];
+        if (submitted - retired == (size_t)ring) {
+            waitTask(pool, &job->task);
+            retired++;
+            if ((status = job->status) != HUFF_OK)
+                break;
+            writeBytes(wr, job->out.buf, job->out.pos);
+            if ((status = wr->error) != HUFF_OK)
+                break;
+            releaseInput(rd, job->payload, job->compSize);
+        }
+        int mode = readByte(rd);
+        if (mode == BLOCK_END) {
+            // The checksum of all data follows the end marker
+            if ((hdr[0] & FLAG_CHECKSUM) && (readBytes(rd, bhdr, CHECKSUM_SIZE) != CHECKSUM_SIZE))
+                status = HUFF_ERR_CORRUPT;
+            else if ((hdr[0] & FLAG_CHECKSUM) && readU32LE(bhdr) != crc)
+                fileStatus = HUFF_ERR_CHECKSUM;
+            break;
+        }
+        if ((mode != BLOCK_HUFFMAN && mode != BLOCK_STORED && mode != BLOCK_RLE) || readBytes(rd, bhdr, 8) != 8) {
+            status = HUFF_ERR_CORRUPT;
+            break;
+        }
+        job->mode = mode;
+        job->rawSize = readU32LE(bhdr);
+        job->compSize = readU32LE(bhdr + 4);
+        if (job->rawSize > MAX_BLOCK_SIZE) {
+            status = HUFF_ERR_CORRUPT;
+            break;
+        }
+
+        // Bring the whole payload into memory so decoding cannot run into the next block
+        if (!rd->mapped && job->compSize > job->copyCap) {
+            unsigned char* copy = (unsigned char*)allocBuffer(&dec->ws.stats, job->copy, job->compSize);
+            if (copy == NULL) {
+                status = HUFF_ERR_NOMEM;
+                break;
+            }
+            job->copy = copy;
+            job->copyCap = job->compSize;
+        }
+        if (readSpan(rd, job->compSize, &job->payload, job->copy) != job->compSize ||
+            ((hdr[0] & FLAG_CHECKSUM) && readBytes(rd, bhdr, CHECKSUM_SIZE) != CHECKSUM_SIZE)) {
+            // Truncated block
+            status = HUFF_ERR_CORRUPT;
+            break;
+        }
+        if (hdr[0] & FLAG_CHECKSUM) {
+            job->crc = readU32LE(bhdr);
+            crc = crc32cCombine(crc, job->crc, job->rawSize);
+        }
+        submitTask(pool, &job->task);
+        submitted++;
+    }
+    if (rd->error != HUFF_OK)
+        status = rd->error;
+
+    // Write the blocks still in flight, oldest first
+    for (; retired < submitted; retired++) {
+        DecodeJob* job = &jobs[retired % ring];
+        waitTask(pool, &job->task);
+        if (status == HUFF_OK)
+            status = job->status;
+        if (status == HUFF_OK)
+            writeBytes(wr, job->out.buf, job->out.pos);
+    }
+    if (status == HUFF_OK)
+        status = fileStatus;
+    if (status == HUFF_OK && (hdr[0] & FLAG_CHECKSUM))
+        dec->ws.checked = 1;
+    return status != HUFF_OK ? status : wr->error;
+}
+
+// Function to decompress a single-table file (formats 1 and 2) after its first 4 bytes
+static int decompressSingle(HuffDecoder* dec, Reader* rd, Writer* wr, const unsigned char magic[4]) {
+    int uniqueChars, totalChars, maxLen;
+    uint64_t total = 0;
+    code table[256];
+    Tree* root = NULL;
+    DecodeTable* dt = &dec->ws.dt;
+    CallStats* cs = dec->ws.cs;
+    PhaseMark mark;
+    uint64_t start;
+    int status;
+
+    markPhase(cs, &mark);
+    dt->stats = &dec->ws.stats;
+    if (dt->cache == NULL && dec->opts.tableCache > 0 &&
+        (status = attachTableCache(dt, dec->opts.tableCache)) != HUFF_OK)
+        return status;
+    if (magic[0] == 'H' && magic[1] == 'U' && magic[2] == 'F' && magic[3] == FORMAT_CANONICAL) {
+        // Compact canonical header
+        status = readCompactHeader(rd, &total, &maxLen, table);
+        if (status == HUFF_OK)
+            status = loadDecodeTable(dt, table, dec->opts.tableBits, NULL);
+    }
+    else {
+        // Original format: the first field is the number of unique characters
+        memcpy(&uniqueChars, magic, sizeof(int));
+        if (readBytes(rd, &totalChars, sizeof(int)) != sizeof(int) ||   // Total number of characters
+            uniqueChars < 1 || uniqueChars > 256 || totalChars < 0) {
+            status = rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+        }
+        else {
+            total = (uint64_t)totalChars;
+            // Rebuild Huffman tree from codes in the compressed file
+            status = ReBuildHuffmanTree(rd, uniqueChars, &dec->ws, &root, table);
+            if (status == HUFF_OK)
+                status = loadDecodeTable(dt, table, dec->opts.tableBits, root);
+        }
+    }
+
+    // Decompress the file
+    if (status == HUFF_OK && total > SIZE_MAX)
+        status = HUFF_ERR_UNSUPPORTED;
+    endPhase(cs, HUFF_PHASE_HEADER, &mark);
+    start = readerOffset(rd);
+    if (status == HUFF_OK)
+        status = decompressFile(rd, wr, dt, (size_t)total);
+    if (status == HUFF_OK)
+        status = rd->error;
+    if (status == HUFF_OK) {
+        endPhase(cs, HUFF_PHASE_DECODE, &mark);
+        noteBlock(cs, BLOCK_HUFFMAN);
+        noteCodeTable(cs, table, (readerOffset(rd) - start) * 8, total);
+    }
+    return status != HUFF_OK ? status : wr->error;
+}
+
+// Function to decompress a dictionary format file (format 4) after its first 4 bytes
+static int decompressDictionary(HuffDecoder* dec, Reader* rd, Writer* wr) {
+    unsigned char hdr[4];
+    uint64_t total, start;
+    PhaseMark mark;
+    int status;
+
+    // Dictionary ID, which must match the attached dictionary
+    if (readBytes(rd, hdr, 4) != 4)
+        return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+    if (!dec->hasDict || readU32LE(hdr) != dec->dict.id)
+        return HUFF_ERR_DICTIONARY;
+
+    // Uncompressed size, 7 bits per byte
+    if (!readStreamVarint(rd, &total))
+        return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+    if (total > SIZE_MAX)
+        return HUFF_ERR_CORRUPT;
+    // Every byte value has a code, so missing bits would decode silently; each code takes
+    // at least one bit, which bounds the size of an input held in memory
+    if (rd->mapped && total / 8 > rd->len - rd->pos)
+        return HUFF_ERR_CORRUPT;
+
+    // The decode table was built when the dictionary was attached
+    markPhase(dec->ws.cs, &mark);
+    start = readerOffset(rd);
+    status = decompressFile(rd, wr, &dec->ws.dictDt, (size_t)total);
+    if (status == HUFF_OK)
+        status = rd->error;
+    if (status == HUFF_OK) {
+        endPhase(dec->ws.cs, HUFF_PHASE_DECODE, &mark);
+        noteBlock(dec->ws.cs, BLOCK_HUFFMAN);
+        noteCodeTable(dec->ws.cs, dec->dict.table, (readerOffset(rd) - start) * 8, total);
+    }
+    return status != HUFF_OK ? status : wr->error;
+}
+
+// Function to decompress an adaptive format file (format 5) after its first 4 bytes, updating
+// the model exactly as the encoder did
+static int decompressAdaptive(HuffDecoder* dec, Reader* rd, Writer* wr) {
+    unsigned char hdr[CHECKSUM_SIZE];
+    const unsigned char* payload;
+    Writer* tmp = &dec->ws.scratch;
+    DecodeTable* dt = &dec->ws.dt;
+    CallStats* cs = dec->ws.cs;
+    AdaptiveModel m;
+    uint64_t interval, raw, comp, done, take;
+    uint32_t crc = 0;
+    PhaseMark mark;
+    Reader chunk;
+    int flags, status, flush = !rd->mapped && (wr->fd >= 0 || wr->sink != NULL);
+
+    // Flags, code length limit and rebuild interval
+    if (readBytes(rd, hdr, 2) != 2 || !readStreamVarint(rd, &interval))
+        return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+    flags = hdr[0];
+    if ((flags & ~FLAG_CHECKSUM) || hdr[1] < MIN_CODE_LEN || hdr[1] > MAX_CODE_LEN ||
+        interval < MIN_ADAPT_INTERVAL || interval > MAX_ADAPT_INTERVAL)
+        return HUFF_ERR_CORRUPT;
+    if (tmp->buf == NULL && (status = openMemoryWriter(tmp, 0, &dec->ws.stats)) != HUFF_OK)
+        return status;
+    dt->stats = &dec->ws.stats;
+    if (dt->cache == NULL && dec->opts.tableCache > 0 &&
+        (status = attachTableCache(dt, dec->opts.tableCache)) != HUFF_OK)
+        return status;
+
+    markPhase(cs, &mark);
+    initAdaptiveModel(&m, hdr[1], (size_t)interval);
+    if ((status = loadDecodeTable(dt, m.table, dec->opts.tableBits, NULL)) != HUFF_OK)
+        return status;
+    endPhase(cs, HUFF_PHASE_HEADER, &mark);
+    for (;;) {
+        if (!readStreamVarint(rd, &raw))
+            return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+        if (raw == 0)
+            break;
+        if (raw > ADAPT_MAX_CHUNK || !readStreamVarint(rd, &comp) || comp > raw * MAX_CODE_LEN / 8 + 1)
+            return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+
+        // The chunk's bitstream, in place in a mapping or copied to the scratch buffer
+        if (rd->mapped) {
+            if (rd->len - rd->pos < comp)
+                return HUFF_ERR_CORRUPT;
+            payload = rd->buf + rd->pos;
+            rd->pos += (size_t)comp;
+        }
+        else {
+            rewindWriter(tmp);
+            if (reserveWriter(tmp, (size_t)comp) == NULL)
+                return tmp->error;
+            if (readBytes(rd, tmp->buf, (size_t)comp) != comp)
+                return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+            payload = tmp->buf;
+        }
+        openMemoryReader(&chunk, payload, (size_t)comp);
+        BitReader br = { 0, 0, &chunk };
+
+        for (done = 0; done < raw; done += take) {
+            // Runs end at rebuilds and at the end of the output buffer, so their bytes can be
+            // counted where they were decoded
+            if (wr->pos == wr->cap)
+                flushWriter(wr);
+            if (wr->error != HUFF_OK)
+                return wr->error;
+            take = raw - done < m.left ? raw - done : m.left;
+            if (take > wr->cap - wr->pos)
+                take = wr->cap - wr->pos;
+            const unsigned char* out = wr->buf + wr->pos;
+            if ((status = decodeSymbols(&br, wr, dt, (size_t)take)) != HUFF_OK)
+                return status;
+            endPhase(cs, HUFF_PHASE_DECODE, &mark);
+            if (flags & FLAG_CHECKSUM) {
+                crc = crc32c(crc, out, (size_t)take);
+                endPhase(cs, HUFF_PHASE_CHECKSUM, &mark);
+            }
+            countAdaptive(&m, out, (size_t)take, cs);
+            endPhase(cs, HUFF_PHASE_HISTOGRAM, &mark);
+            if ((m.left -= take) == 0) {
+                int changed = rebuildAdaptiveModel(&m);
+                endPhase(cs, HUFF_PHASE_TREE, &mark);
+                if (changed && (status = loadDecodeTable(dt, m.table, dec->opts.tableBits, NULL)) != HUFF_OK)
+                    return status;
+                endPhase(cs, HUFF_PHASE_HEADER, &mark);
+            }
+        }
+        noteBlock(cs, BLOCK_HUFFMAN);
+        if (rd->owned)
+            releaseConsumed(rd);
+        // What arrived so far reaches the output before waiting for more input
+        if (flush && wr->pos > 0)
+            flushWriter(wr);
+    }
+
+    if (flags & FLAG_CHECKSUM) {
+        if (readBytes(rd, hdr, CHECKSUM_SIZE) != CHECKSUM_SIZE)
+            return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+        if (readU32LE(hdr) != crc)
+            return HUFF_ERR_CHECKSUM;
+        dec->ws.checked = 1;
+    }
+    return wr->error;
+}
+
+// Function to decompress rd into wr, detecting the format from the first bytes
+static int decompressAny(HuffDecoder* dec, Reader* rd, Writer* wr) {
+    unsigned char magic[4];
+    uint64_t before = wr->written + wr->pos;
+    PhaseMark start;
+    AllocStats mem;
+    int status;
+    beginCall(&dec->ws, &start, &mem);
+    dec->ws.checked = 0;
+    if (readBytes(rd, magic, 4) != 4)
+        return rd->error != HUFF_OK ? rd->error : HUFF_ERR_CORRUPT;
+    if (magic[0] == 'H' && magic[1] == 'U' && magic[2] == 'F' && magic[3] == FORMAT_BLOCKS)
+        // Block container: every block carries its own table
+        status = decompressBlocks(dec, rd, wr);
+    else if (magic[0] == 'H' && magic[1] == 'U' && magic[2] == 'F' && magic[3] == FORMAT_DICTIONARY)
+        // Shared table: only its ID is stored
+        status = decompressDictionary(dec, rd, wr);
+    else if (magic[0] == 'H' && magic[1] == 'U' && magic[2] == 'F' && magic[3] == FORMAT_ADAPTIVE)
+        // No table stored: the codes follow the data
+        status = decompressAdaptive(dec, rd, wr);
+    else
+        status = decompressSingle(dec, rd, wr, magic);
+    if (status == HUFF_OK)
+        dec->ws.stats.processed += wr->written + wr->pos - before;
+    endCall(&dec->ws, &start, &mem, rd->mapped ? rd->len : readerOffset(rd), wr->written + wr->pos - before);
+    return status;
+}
+
+// Function to write bytes [offset, offset + length) of a mapped block container to out,
+// decoding only the blocks (and within them, only from the nearest sync point) that cover the range
+static int extractRange(HuffDecoder* dec, const unsigned char* base, size_t size,
+                        uint64_t offset, uint64_t length, Writer* out) {
+    Workspace* ws = &dec->ws;
+    BlockIndex* index = &ws->index;
+    DecodeTable* dt = &ws->dt;
+    Writer* tmp = &ws->scratch;
+    int status;
+
+    // Random access needs a block container with an index
+    if (size < FILE_HEADER_SIZE || memcmp(base, "HUF", 3) != 0 || base[3] != FORMAT_BLOCKS ||
+        !(base[4] & FLAG_INDEX))
+        return HUFF_ERR_UNSUPPORTED;
+    int flags = base[4];
+    int maxLen = base[5];
+    if (maxLen < 1 || maxLen > MAX_CODE_LEN)
+        return HUFF_ERR_CORRUPT;
+    index->stats = &ws->stats;
+    dt->stats = &ws->stats;
+    if (dt->cache == NULL && dec->opts.tableCache > 0 &&
+        (status = attachTableCache(dt, dec->opts.tableCache)) != HUFF_OK)
+        return status;
+    if ((status = readBlockIndex(base, size, index)) != HUFF_OK)
+        return status;
+
+    // Clip the range to the uncompressed size
+    if (offset >= index->totalRaw)
+        length = 0;
+    else if (length > index->totalRaw - offset)
+        length = index->totalRaw - offset;
+
+    // Binary search for the block holding the first requested byte
+    size_t lo = 0, hi = index->count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (index->entries[mid].rawOffset <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    // The scratch writer grows to the longest prefix decoded so far and is kept
+    if (tmp->buf == NULL)
+        status = openMemoryWriter(tmp, index->syncInterval ? index->syncInterval : DEFAULT_SYNC_INTERVAL, &ws->stats);
+    for (size_t b = lo; status == HUFF_OK && length > 0 && b < index->count; b++) {
+        const BlockIndexEntry* e = &index->entries[b];
+        const unsigned char* hdr = base + e->offset;
+        size_t start = (size_t)(offset - e->rawOffset);
+        size_t take = e->rawSize - start;
+        if (take > length)
+            take = (size_t)length;
+        if (readU32LE(hdr + 1) != e->rawSize || readU32LE(hdr + 5) != e->compSize) {
+            status = HUFF_ERR_CORRUPT;
+            break;
+        }
+        if (take == 0)
+            continue;   // Empty block
+
+        // Stored and single-symbol blocks are written without decoding anything
+        if (hdr[0] == BLOCK_STORED || hdr[0] == BLOCK_RLE) {
+            if (e->compSize != (hdr[0] == BLOCK_STORED ? e->rawSize : 1)) {
+                status = HUFF_ERR_CORRUPT;
+                break;
+            }
+            if (hdr[0] == BLOCK_STORED) {
+                writeBytes(out, hdr + BLOCK_HEADER_SIZE + start, take);
+            }
+            else {
+                unsigned char run[4096];
+                memset(run, hdr[BLOCK_HEADER_SIZE], sizeof(run));
+                for (size_t done = 0; done < take; done += sizeof(run))
+                    writeBytes(out, run, take - done < sizeof(run) ? take - done : sizeof(run));
+            }
+            if ((status = out->error) != HUFF_OK)
+                break;
+            offset += take;
+            length -= take;
+            ws->stats.processed += take;
+            continue;
+        }
+        if (hdr[0] != BLOCK_HUFFMAN) {
+            status = HUFF_ERR_CORRUPT;
+            break;
+        }
+
+        // Start at the nearest stream start or sync point at or before the first wanted byte
+        const unsigned char* payload = hdr + BLOCK_HEADER_SIZE;
+        StreamLayout ly;
+        if ((status = parseBlockTable(payload, e->compSize, e->rawSize, maxLen, flags,
+                                      dec->opts.tableBits, dt, &ly, NULL)) != HUFF_OK)
+            break;
+        int s = (int)(start / ly.segment);
+        size_t first = (size_t)s * ly.segment, bit = ly.begin[s] * 8;
+        if (index->syncInterval && start >= index->syncInterval) {
+            size_t k = start / index->syncInterval;
+            if (k * index->syncInterval > first) {
+                first = k * index->syncInterval;
+                bit = index->sync[e->firstSync + k - 1];
+            }
+        }
+
+        // Decode the skipped prefix and the wanted bytes, keep only the latter; a range
+        // running past the end of a stream continues at the start of the next one
+        rewindWriter(tmp);
+        for (size_t pos = first; pos < start + take; s++) {
+            size_t stop = (size_t)(s + 1) * ly.segment < start + take ? (size_t)(s + 1) * ly.segment : start + take;
+            if (bit / 8 < ly.begin[s] || bit / 8 > ly.begin[s + 1]) {
+                // Sync point outside its stream
+                status = HUFF_ERR_CORRUPT;
+                break;
+            }
+            Reader block;
+            openMemoryReader(&block, payload + bit / 8, ly.begin[s + 1] - bit / 8);
+            BitReader br = { 0, 0, &block };
+            refillBits(&br);
+            skipBits(&br, (int)(bit % 8));
+            if ((status = decodeSymbols(&br, tmp, dt, stop - pos)) != HUFF_OK || (status = tmp->error) != HUFF_OK)
+                break;
+            pos = stop;
+            if (s + 1 < ly.count)
+                bit = ly.begin[s + 1] * 8;
+        }
+        if (status != HUFF_OK)
+            break;
+        writeBytes(out, tmp->buf + (start - first), take);
+        status = out->error;
+
+        offset += take;
+        length -= take;
+        ws->stats.processed += take;
+    }
+    return status;
+}
+
+// Function to build the shift-and masks that find the code bits of the pattern in a bitstream
+// one byte at a time: bit j of masks[x] is set if stream byte x agrees with the pattern bits that
+// end at pattern bit j, counting bits past the end of the pattern as matching anything. Returns
+// the number of pattern bits the masks cover (at most SEARCH_FILTER_BITS)
+static int buildSearchMasks(const code table[256], const unsigned char* pattern, size_t len, uint64_t masks[256]) {
+    unsigned char bits[SEARCH_FILTER_BITS];
+    int m = 0;
+
+    for (size_t i = 0; i < len && m < SEARCH_FILTER_BITS; i++) {
+        const code* c = &table[pattern[i]];
+        for (int k = c->l - 1; k >= 0 && m < SEARCH_FILTER_BITS; k--)
+            bits[m++] = (unsigned char)((c->bits >> k) & 1);
+    }
+    for (int x = 0; x < 256; x++) {
+        uint64_t mask = 0;
+        for (int j = 0; j < m + 7; j++) {
+            int ok = 1;
+            // Stream bit i of x (most significant first) lines up with pattern bit j - 7 + i
+            for (int i = 0; i < 8 && ok; i++) {
+                int p = j - 7 + i;
+                if (p >= 0 && p < m && bits[p] != ((x >> (7 - i)) & 1))
+                    ok = 0;
+            }
+            if (ok)
+                mask |= (uint64_t)1 << j;
+        }
+        masks[x] = mask;
+    }
+    return m;
+}
+
+// Function to scan a bitstream for the pattern bits at every bit alignment, returns 1 if they
+// may occur (a hit can also fall inside a code or in the padding, so it still has to be checked)
+static int scanBitstream(const unsigned char* p, size_t n, const uint64_t masks[256], int m) {
+    uint64_t state = 0, found = (uint64_t)0xFF << (m - 1);
+    for (size_t i = 0; i < n; i++) {
+        state = ((state << 8) | 0xFF) & masks[p[i]];
+        if (state & found)
+            return 1;
+    }
+    return 0;
+}
+
+// Function to tell whether a match could run across a boundary, given the n bytes after it:
+// some proper suffix of the pattern must start them. When fewer than len - 1 bytes are known but
+// more data follows (more is set), the answer is yes
+static int straddlesBoundary(const unsigned char* pattern, size_t len, const unsigned char* after, size_t n, int more) {
+    if (n < len - 1 && more)
+        return 1;
+    for (size_t j = 1; j < len && j <= n; j++) {
+        if (memcmp(pattern + len - j, after, j) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Function to decode n bytes of a Huffman block into dst, starting at the beginning of stream s
+// and running on into the following streams
+static int decodeFromStream(const unsigned char* payload, const StreamLayout* ly, const DecodeTable* dt,
+                            int s, size_t rawSize, size_t n, unsigned char* dst) {
+    Writer w;
+    size_t done = 0;
+    int status;
+
+    openFixedWriter(&w, dst, n > 0 ? n : 1);
+    for (; done < n && s < ly->count; s++) {
+        size_t first = (size_t)s * ly->segment;
+        size_t end = first + ly->segment < rawSize ? first + ly->segment : rawSize;
+        size_t take = end - first < n - done ? end - first : n - done;
+        Reader block;
+        openMemoryReader(&block, payload + ly->begin[s], ly->begin[s + 1] - ly->begin[s]);
+        BitReader br = { 0, 0, &block };
+        if ((status = decodeSymbols(&br, &w, dt, take)) != HUFF_OK)
+            return status;
+        done += take;
+    }
+    return w.error;
+}
+
+// Function to get the first bytes of block b (up to n, fewer if the block is shorter) into dst;
+// *got receives how many
+static int readBlockHead(const ParallelSearch* ps, size_t b, DecodeTable* dt, unsigned char* dst, size_t n, size_t* got) {
+    const BlockIndexEntry* e = &ps->index->entries[b];
+    const unsigned char* hdr = ps->base + e->offset;
+    const unsigned char* payload = hdr + BLOCK_HEADER_SIZE;
+    StreamLayout ly;
+    int status;
+
+    *got = 0;
+    if (readU32LE(hdr + 1) != e->rawSize || readU32LE(hdr + 5) != e->compSize)
+        return HUFF_ERR_CORRUPT;
+    if (n > e->rawSize)
+        n = e->rawSize;
+    if (n == 0)
+        return HUFF_OK;
+    if (hdr[0] == BLOCK_STORED || hdr[0] == BLOCK_RLE) {
+        if (e->compSize != (hdr[0] == BLOCK_STORED ? e->rawSize : 1))
+            return HUFF_ERR_CORRUPT;
+        if (hdr[0] == BLOCK_STORED)
+            memcpy(dst, payload, n);
+        else
+            memset(dst, payload[0], n);
+    }
+    else if (hdr[0] != BLOCK_HUFFMAN) {
+        return HUFF_ERR_CORRUPT;
+    }
+    else if ((status = parseBlockTable(payload, e->compSize, e->rawSize, ps->maxLen, ps->flags, ps->tableBits,
+                                       dt, &ly, NULL)) != HUFF_OK ||
+             (status = decodeFromStream(payload, &ly, dt, 0, e->rawSize, n, dst)) != HUFF_OK) {
+        return status;
+    }
+    *got = n;
+    return HUFF_OK;
+}
+
+// Function to tell whether a match may lie wholly inside the block searched by job, without
+// decoding it: the pattern bits are looked for in each bitstream, and the starts of the streams
+// after the first are decoded to catch matches running from one stream into the next
+static int blockMayMatch(SearchJob* job, const BlockIndexEntry* e, int* status) {
+    const ParallelSearch* ps = job->shared;
+    const unsigned char* hdr = ps->base + e->offset;
+    const unsigned char* payload = hdr + BLOCK_HEADER_SIZE;
+    unsigned char after[HUFF_MAX_PATTERN];
+    code table[256];
+    StreamLayout ly;
+    int m;
+
+    *status = HUFF_OK;
+    if (e->rawSize < ps->len)
+        return 0;
+    if (hdr[0] == BLOCK_STORED)
+        return 1;   // Scanned directly, nothing to decode
+    if (hdr[0] == BLOCK_RLE) {
+        for (size_t i = 0; i < ps->len; i++) {
+            if (ps->pattern[i] != payload[0])
+                return 0;
+        }
+        return 1;
+    }
+    if (hdr[0] != BLOCK_HUFFMAN ||
+        (*status = parseBlockCodes(payload, e->compSize, e->rawSize, ps->maxLen, ps->flags, table, &ly)) != HUFF_OK) {
+        if (*status == HUFF_OK)
+            *status = HUFF_ERR_CORRUPT;
+        return 0;
+    }
+
+    // A byte without a code does not occur in the block
+    for (size_t i = 0; i < ps->len; i++) {
+        if (table[ps->pattern[i]].l == 0)
+            return 0;
+    }
+    m = buildSearchMasks(table, ps->pattern, ps->len, job->masks);
+    for (int k = 0; k < ly.count; k++) {
+        if (scanBitstream(payload + ly.begin[k], ly.begin[k + 1] - ly.begin[k], job->masks, m))
+            return 1;
+    }
+
+    // Matches split between two streams
+    if (ps->len > 1 && ly.count > 1) {
+        if ((*status = buildDecodeTable(&job->dt, table, ps->tableBits, NULL)) != HUFF_OK)
+            return 0;
+        for (int k = 1; k < ly.count && (size_t)k * ly.segment < e->rawSize; k++) {
+            size_t first = (size_t)k * ly.segment;
+            size_t n = e->rawSize - first < ps->len - 1 ? e->rawSize - first : ps->len - 1;
+            if ((*status = decodeFromStream(payload, &ly, &job->dt, k, e->rawSize, n, after)) != HUFF_OK)
+                return 0;
+            if (straddlesBoundary(ps->pattern, ps->len, after, n, first + n < e->rawSize))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to record a match starting at offset inside the job's block
+static int addSearchHit(SearchJob* job, uint64_t offset) {
+    if (job->hitCount == job->hitCap) {
+        size_t cap = job->hitCap ? 2 * job->hitCap : 64;
+        uint64_t* grown = (uint64_t*)allocBuffer(job->stats, job->hits, cap * sizeof(uint64_t));
+        if (grown == NULL)
+            return HUFF_ERR_NOMEM;
+        job->hits = grown;
+        job->hitCap = cap;
+    }
+    job->hits[job->hitCount++] = offset;
+    return HUFF_OK;
+}
+
+// Function to record every match in buf (avail bytes) that starts before limit
+static int findPattern(SearchJob* job, const unsigned char* buf, size_t avail, size_t limit) {
+    const ParallelSearch* ps = job->shared;
+    const unsigned char* p = buf;
+    int status = HUFF_OK;
+
+    while (status == HUFF_OK && (size_t)(p - buf) < limit &&
+           (p = (const unsigned char*)memchr(p, ps->pattern[0], limit - (size_t)(p - buf))) != NULL) {
+        if ((size_t)(p - buf) + ps->len <= avail && memcmp(p, ps->pattern, ps->len) == 0)
+            status = addSearchHit(job, (uint64_t)(p - buf));
+        p++;
+    }
+    return status;
+}
+
+// Pool task: search one block of an indexed container. The block is decoded only if the pattern
+// may lie inside it, or if the bytes after it could end a match that starts in it
+static void searchBlockTask(void* arg) {
+    SearchJob* job = (SearchJob*)arg;
+    const ParallelSearch* ps = job->shared;
+    const BlockIndex* index = ps->index;
+    const BlockIndexEntry* e = &index->entries[job->block];
+    const unsigned char* hdr = ps->base + e->offset;
+    unsigned char after[HUFF_MAX_PATTERN];
+    size_t n = 0, got;
+    int status, need;
+
+    job->hitCount = 0;
+    if (readU32LE(hdr + 1) != e->rawSize || readU32LE(hdr + 5) != e->compSize) {
+        job->status = HUFF_ERR_CORRUPT;
+        return;
+    }
+    need = blockMayMatch(job, e, &status);
+
+    // The bytes after the block, gathered from as many blocks as it takes
+    for (size_t b = job->block + 1; status == HUFF_OK && ps->len > 1 && n < ps->len - 1 && b < index->count; b++) {
+        status = readBlockHead(ps, b, &job->dt, after + n, ps->len - 1 - n, &got);
+        n += got;
+    }
+    if (status == HUFF_OK && !need && e->rawSize > 0)
+        need = straddlesBoundary(ps->pattern, ps->len, after, n, 0);
+
+    if (status == HUFF_OK && need) {
+        if (hdr[0] == BLOCK_STORED && n == 0) {
+            // Searched in place
+            if (e->compSize != e->rawSize)
+                status = HUFF_ERR_CORRUPT;
+            else
+                status = findPattern(job, hdr + BLOCK_HEADER_SIZE, e->rawSize, e->rawSize);
+        }
+        else {
+            rewindWriter(&job->out);
+            status = decodeBlock(hdr[0], hdr + BLOCK_HEADER_SIZE, e->compSize, e->rawSize, ps->maxLen, ps->flags,
+                                 ps->tableBits, &job->dt, &job->out, NULL);
+            // A match reported from a decoded block must come from intact data
+            if (status == HUFF_OK && (ps->flags & FLAG_CHECKSUM))
+                status = checkBlock(job->out.buf, job->out.pos, readU32LE(hdr + BLOCK_HEADER_SIZE + e->compSize), NULL);
+            if (status == HUFF_OK) {
+                writeBytes(&job->out, after, n);
+                status = job->out.error;
+            }
+            if (status == HUFF_OK)
+                status = findPattern(job, job->out.buf, job->out.pos, e->rawSize);
+        }
+    }
+    if (ps->release)
+        releaseMapped(hdr, BLOCK_HEADER_SIZE + e->compSize);
+    job->status = status;
+}
+
+// Function to get the context's search jobs, creating them on first use
+static int getSearchJobs(HuffDecoder* dec, int count, size_t blockCap, SearchJob** out) {
+    Workspace* ws = &dec->ws;
+    int i, status = HUFF_OK;
+
+    if (ws->searchJobCount < count) {
+        SearchJob* grown = (SearchJob*)allocBuffer(&ws->stats, ws->searchJobs, count * sizeof(SearchJob));
+        if (grown == NULL)
+            return HUFF_ERR_NOMEM;
+        memset(grown + ws->searchJobCount, 0, (count - ws->searchJobCount) * sizeof(SearchJob));
+        for (i = ws->searchJobCount; i < count; i++) {
+            grown[i].dt.stats = &ws->stats;
+            grown[i].stats = &ws->stats;
+        }
+        ws->searchJobs = grown;
+        ws->searchJobCount = count;
+    }
+    for (i = 0; i < count && status == HUFF_OK; i++) {
+        if (ws->searchJobs[i].out.buf == NULL)
+            status = openMemoryWriter(&ws->searchJobs[i].out, blockCap, &ws->stats);
+    }
+    *out = ws->searchJobs;
+    return status;
+}
+
+// Function to search an indexed block container held whole in memory, block by block on the
+// decoder's threads; the matches of each block are reported once those of earlier blocks are out
+static int searchBlocks(HuffDecoder* dec, const unsigned char* base, size_t size, int release,
+                        const unsigned char* pattern, size_t len, HuffMatchFn match, void* user) {
+    Workspace* ws = &dec->ws;
+    BlockIndex* index = &ws->index;
+    int threads = dec->workers.count;
+    int jobCount = threads > 1 ? 2 * threads : 1;
+    size_t submitted = 0, retired = 0;
+    ParallelSearch ps;
+    ThreadPool* pool;
+    SearchJob* jobs;
+    int status, stop = 0;
+
+    ps.base = base;
+    ps.index = index;
+    ps.flags = base[4];
+    ps.maxLen = base[5];
+    ps.tableBits = dec->opts.tableBits;
+    ps.release = release;
+    ps.pattern = pattern;
+    ps.len = len;
+    if (ps.maxLen < 1 || ps.maxLen > MAX_CODE_LEN)
+        return HUFF_ERR_CORRUPT;
+    index->stats = &ws->stats;
+    if ((status = readBlockIndex(base, size, index)) != HUFF_OK ||
+        (status = getPool(&dec->workers, &pool, &ws->stats)) != HUFF_OK ||
+        (status = getSearchJobs(dec, jobCount, (size_t)readU32LE(base + 6) + len, &jobs)) != HUFF_OK)
+        return status;
+    for (int i = 0; i < jobCount; i++) {
+        jobs[i].shared = &ps;
+        jobs[i].task.run = searchBlockTask;
+        jobs[i].task.arg = &jobs[i];
+    }
+
+    // Keep a ring of blocks in flight and report each one's matches in order
+    while (submitted < index->count || retired < submitted) {
+        SearchJob* job = &jobs[retired % jobCount];
+        if (!stop && status == HUFF_OK && submitted < index->count && submitted - retired < (size_t)jobCount) {
+            SearchJob* next = &jobs[submitted % jobCount];
+            next->block = submitted++;
+            submitTask(pool, &next->task);
+            continue;
+        }
+        if (retired == submitted)
+            break;
+        waitTask(pool, &job->task);
+        retired++;
+        if (status == HUFF_OK)
+            status = job->status;
+        for (size_t h = 0; status == HUFF_OK && !stop && h < job->hitCount; h++)
+            stop = match(user, index->entries[job->block].rawOffset + job->hits[h]) != 0;
+        ws->stats.processed += index->entries[job->block].rawSize;
+    }
+    return status;
+}
+
+// Function to report the matches in a chunk of decoded bytes, carrying the last len - 1 bytes
+// over to the next chunk so matches across chunks are found too (writer callback)
+static int searchSinkWrite(void* user, const void* buf, size_t n) {
+    SearchSink* sk = (SearchSink*)user;
+    const unsigned char* p = (const unsigned char*)buf;
+    size_t keep = sk->len - 1, take = n < keep ? n : keep, i;
+
+    // Matches starting in the carried bytes
+    memcpy(sk->carry + sk->carryLen, p, take);
+    for (i = 0; i < sk->carryLen && !sk->stopped; i++) {
+        if (i + sk->len <= sk->carryLen + take && memcmp(sk->carry + i, sk->pattern, sk->len) == 0)
+            sk->stopped = sk->match(sk->user, sk->offset + i) != 0;
+    }
+    // Matches starting in the chunk
+    for (i = 0; i + sk->len <= n && !sk->stopped; i++) {
+        const unsigned char* q = (const unsigned char*)memchr(p + i, sk->pattern[0], n - sk->len + 1 - i);
+        if (q == NULL)
+            break;
+        i = (size_t)(q - p);
+        if (memcmp(q, sk->pattern, sk->len) == 0)
+            sk->stopped = sk->match(sk->user, sk->offset + sk->carryLen + i) != 0;
+    }
+    if (sk->stopped)
+        return -1;
+
+    // Keep the last len - 1 bytes seen
+    if (n >= keep) {
+        sk->offset += sk->carryLen + n - keep;
+        memcpy(sk->carry, p + n - keep, keep);
+        sk->carryLen = keep;
+    }
+    else if (sk->carryLen + n > keep) {
+        size_t drop = sk->carryLen + n - keep;
+        memmove(sk->carry, sk->carry + drop, keep);
+        sk->offset += drop;
+        sk->carryLen = keep;
+    }
+    else {
+        sk->carryLen += n;
+    }
+    return 0;
+}
+
+// Function to search any compressed input by decoding it into memory a buffer at a time
+static int searchDecoded(HuffDecoder* dec, Reader* rd, const unsigned char* pattern, size_t len,
+                         HuffMatchFn match, void* user) {
+    SearchSink sink;
+    Writer wr;
+    int status, closed;
+
+    sink.pattern = pattern;
+    sink.len = len;
+    sink.carryLen = 0;
+    sink.offset = 0;
+    sink.match = match;
+    sink.user = user;
+    sink.stopped = 0;
+    if ((status = openSinkWriter(&wr, searchSinkWrite, &sink, &dec->ws)) != HUFF_OK)
+        return status;
+    status = decompressAny(dec, rd, &wr);
+    closed = closeWriter(&wr);
+    if (status == HUFF_OK)
+        status = closed;
+    // Stopping early surfaces as a failed write
+    return sink.stopped ? HUFF_OK : status;
+}
+
+// Function to search a reader's input: indexed block containers in memory block by block,
+// anything else by decoding it
+static int searchAny(HuffDecoder* dec, Reader* rd, const unsigned char* pattern, size_t len,
+                     HuffMatchFn match, void* user) {
+    if (rd->mapped && rd->len >= FILE_HEADER_SIZE && memcmp(rd->buf, "HUF", 3) == 0 &&
+        rd->buf[3] == FORMAT_BLOCKS && (rd->buf[4] & FLAG_INDEX))
+        return searchBlocks(dec, rd->buf, rd->len, rd->owned, pattern, len, match, user);
+    return searchDecoded(dec, rd, pattern, len, match, user);
+}
+
+// Function to fill opts with the default settings
+void huffDefaultOptions(HuffOptions* opts) {
+    opts->format = FORMAT_BLOCKS;
+    opts->maxCodeLen = DEFAULT_MAX_CODE_LEN;
+    opts->tableBits = DEFAULT_TABLE_BITS;
+    opts->blockSize = DEFAULT_BLOCK_SIZE;
+    opts->syncInterval = DEFAULT_SYNC_INTERVAL;
+    opts->threads = 0;
+    opts->streams = DEFAULT_STREAMS;
+    opts->stats = 0;
+    opts->asyncIo = 1;
+    opts->checksum = 1;
+    opts->tableCache = 0;
+    opts->adaptInterval = DEFAULT_ADAPT_INTERVAL;
+}
+
+// Function to describe a status code
+const char* huffErrorString(int status) {
+    switch (status) {
+    case HUFF_OK:              return "Success";
+    case HUFF_ERR_IO:          return "Read or write failed";
+    case HUFF_ERR_NOMEM:       return "Out of memory";
+    case HUFF_ERR_CORRUPT:     return "Corrupt compressed data";
+    case HUFF_ERR_ARGUMENT:    return "Invalid argument";
+    case HUFF_ERR_SPACE:       return "Destination buffer too small";
+    case HUFF_ERR_UNSUPPORTED: return "Operation not supported for this input";
+    case HUFF_ERR_DICTIONARY:  return "Data needs a different dictionary";
+    case HUFF_ERR_CHECKSUM:    return "Checksum mismatch";
+    default:                   return "Unknown error";
+    }
+}
+
+// Function to copy opts (or the defaults) and check the ranges, returns 0 if they are invalid
+static int loadOptions(HuffOptions* dst, const HuffOptions* opts) {
+    if (opts == NULL)
+        huffDefaultOptions(dst);
+    else
+        *dst = *opts;
+    // The index stores the interval in 32 bits, and an interval of a whole block or more
+    // records no sync points anyway
+    if (dst->syncInterval > MAX_BLOCK_SIZE)
+        dst->syncInterval = MAX_BLOCK_SIZE;
+    return dst->format >= FORMAT_LEGACY && dst->format <= FORMAT_ADAPTIVE &&
+           dst->maxCodeLen >= MIN_CODE_LEN && dst->maxCodeLen <= MAX_CODE_LEN &&
+           dst->tableBits >= MIN_TABLE_BITS && dst->tableBits <= MAX_TABLE_BITS &&
+           dst->blockSize >= MIN_BLOCK_SIZE && dst->blockSize <= MAX_BLOCK_SIZE &&
+           (dst->syncInterval == 0 || dst->syncInterval >= MIN_SYNC_INTERVAL) &&
+           dst->threads >= 0 && dst->threads <= MAX_THREADS &&
+           dst->streams >= 1 && dst->streams <= MAX_STREAMS &&
+           dst->tableCache >= 0 && dst->tableCache <= MAX_TABLE_CACHE &&
+           dst->adaptInterval >= MIN_ADAPT_INTERVAL && dst->adaptInterval <= MAX_ADAPT_INTERVAL;
+}
+
+// Function to release everything a context allocated
+static void freeWorkspace(Workspace* ws) {
+    int i;
+    if (ws->ioStarted)
+        stopPool(&ws->io);
+#ifdef HAVE_IO_URING
+    if (ws->ringState == 1)
+        closeRing(&ws->ring);
+#endif
+    free(ws->inBuf);
+    free(ws->outBuf);
+    free(ws->inAhead);
+    free(ws->outSpare);
+    freeBlockIndex(&ws->index);
+    for (i = 0; i < ws->blockJobCount; i++) {
+        closeWriter(&ws->blockJobs[i].out);
+        free(ws->blockJobs[i].copy);
+        free(ws->blockJobs[i].sync);
+    }
+    free(ws->blockJobs);
+    for (i = 0; i < ws->decodeJobCount; i++) {
+        freeDecodeTable(&ws->decodeJobs[i].dt);
+        closeWriter(&ws->decodeJobs[i].out);
+        free(ws->decodeJobs[i].copy);
+    }
+    free(ws->decodeJobs);
+    freeDecodeTable(&ws->dt);
+    freeDecodeTable(&ws->dictDt);
+    closeWriter(&ws->scratch);
+    free(ws->treeNodes);
+    free(ws->histJobs);
+    for (i = 0; i < ws->encodeJobCount; i++)
+        closeWriter(&ws->encodeJobs[i].out);
+    free(ws->encodeJobs);
+    for (i = 0; i < ws->searchJobCount; i++) {
+        freeDecodeTable(&ws->searchJobs[i].dt);
+        closeWriter(&ws->searchJobs[i].out);
+        free(ws->searchJobs[i].hits);
+    }
+    free(ws->searchJobs);
+    memset(ws, 0, sizeof(Workspace));
+}
+
+// Function to copy a context's allocation counters into the public structure
+static void copyMemoryStats(const Workspace* ws, HuffMemoryStats* stats) {
+    stats->allocations = __atomic_load_n(&ws->stats.count, __ATOMIC_RELAXED);
+    stats->bytesAllocated = __atomic_load_n(&ws->stats.bytes, __ATOMIC_RELAXED);
+    stats->bytesProcessed = ws->stats.processed;
+    stats->tablesReused = __atomic_load_n(&ws->stats.reused, __ATOMIC_RELAXED);
+}
+
+// Function to create an encoder context
+HuffEncoder* huffEncoderCreate(const HuffOptions* opts) {
+    HuffEncoder* enc = (HuffEncoder*)calloc(1, sizeof(HuffEncoder));
+    if (enc == NULL)
+        return NULL;
+    if (!loadOptions(&enc->opts, opts)) {
+        free(enc);
+        return NULL;
+    }
+    enc->workers.count = workerCount(enc->opts.threads);
+    enc->ws.cs = enc->opts.stats ? &enc->ws.call : NULL;
+    enc->ws.asyncIo = enc->opts.asyncIo;
+    return enc;
+}
+
+// Function to release an encoder context and its threads
+void huffEncoderFree(HuffEncoder* enc) {
+    if (enc == NULL)
+        return;
+    releaseWorkers(&enc->workers);
+    freeWorkspace(&enc->ws);
+    free(enc);
+}
+
+// Function to read the encoder's allocation counters
+void huffEncoderMemoryStats(const HuffEncoder* enc, HuffMemoryStats* stats) {
+    copyMemoryStats(&enc->ws, stats);
+}
+
+// Function to read the statistics of the encoder's last call
+void huffEncoderStats(const HuffEncoder* enc, HuffStats* stats) {
+    *stats = enc->ws.last;
+}
+
+// Function to get the largest compressed size of srcSize bytes
+size_t huffCompressBound(const HuffEncoder* enc, size_t srcSize) {
+    const HuffOptions* opts = &enc->opts;
+    if (opts->format == FORMAT_LEGACY)
+        // Header, one 9-byte entry per symbol, and codes that may exceed the length limit
+        return 8 + 256 * 9 + srcSize * 8;
+    if (opts->format == FORMAT_CANONICAL)
+        return 13 + MAX_TABLE_SIZE + (srcSize / 8 + 1) * MAX_CODE_LEN;
+    if (opts->format == FORMAT_DICTIONARY)
+        return 8 + MAX_VARINT_SIZE + (srcSize / 8 + 1) * MAX_CODE_LEN;
+    if (opts->format == FORMAT_ADAPTIVE)
+        // Header, two sizes per chunk, end marker and checksum
+        return 6 + MAX_VARINT_SIZE + (srcSize / ADAPT_MAX_CHUNK + 1) * (2 * MAX_VARINT_SIZE + 1) +
+               (srcSize / 8 + 1) * MAX_CODE_LEN + 1 + CHECKSUM_SIZE;
+
+    // Block container: header, blocks, end marker, checksums, sync section, index and trailer
+    size_t blocks = (srcSize + opts->blockSize - 1) / opts->blockSize;
+    size_t syncs = opts->syncInterval ? srcSize / opts->syncInterval + 2 : 0;
+    return FILE_HEADER_SIZE + blocks * (BLOCK_HEADER_SIZE + MAX_TABLE_SIZE + MAX_JUMP_TABLE_SIZE +
+                                        4 * MAX_STREAMS + INDEX_ENTRY_SIZE + CHECKSUM_SIZE) +
+           (srcSize / 8 + 1) * MAX_CODE_LEN + 1 + CHECKSUM_SIZE + syncs * 4 + 8 + INDEX_TRAILER_SIZE;
+}
+
+// Function to compress a buffer into a caller-owned buffer
+int huffCompressBuffer(HuffEncoder* enc, const void* src, size_t srcSize,
+                       void* dst, size_t dstCapacity, size_t* dstSize) {
+    Reader rd;
+    Writer wr;
+    int status;
+
+    if (enc == NULL || (src == NULL && srcSize > 0) || dst == NULL || dstSize == NULL)
+        return HUFF_ERR_ARGUMENT;
+    *dstSize = 0;
+    // The smallest file (an empty input) is larger than this, and the bit writer needs a word of room
+    if (dstCapacity < 16)
+        return HUFF_ERR_SPACE;
+
+    openMemoryReader(&rd, (const unsigned char*)src, srcSize);
+    openFixedWriter(&wr, (unsigned char*)dst, dstCapacity);
+    status = compressAny(enc, &rd, &wr);
+    if (status == HUFF_OK)
+        *dstSize = wr.pos;
+    return status;
+}
+
+// Function to compress a callback stream into a callback stream
+int huffCompressStream(HuffEncoder* enc, HuffReadFn input, void* inputUser,
+                       HuffWriteFn output, void* outputUser) {
+    Reader rd;
+    Writer wr;
+    int status, closed;
+
+    if (enc == NULL || input == NULL || output == NULL)
+        return HUFF_ERR_ARGUMENT;
+    if ((status = openSourceReader(&rd, input, inputUser, &enc->ws)) == HUFF_OK &&
+        (status = openSinkWriter(&wr, output, outputUser, &enc->ws)) == HUFF_OK) {
+        status = compressAny(enc, &rd, &wr);
+        closed = closeWriter(&wr);
+        if (status == HUFF_OK)
+            status = closed;
+    }
+    closeReader(&rd);
+    return status;
+}
+
+// Function to compress between file descriptors
+int huffCompressFd(HuffEncoder* enc, int inFd, int outFd) {
+    Reader rd;
+    Writer wr;
+    int status, closed;
+
+    if (enc == NULL || inFd < 0 || outFd < 0)
+        return HUFF_ERR_ARGUMENT;
+    if ((status = openReader(&rd, inFd, &enc->ws)) == HUFF_OK &&
+        (status = openWriter(&wr, outFd, &enc->ws)) == HUFF_OK) {
+        status = compressAny(enc, &rd, &wr);
+        closed = closeWriter(&wr);
+        if (status == HUFF_OK)
+            status = closed;
+    }
+    closeReader(&rd);
+    return status;
+}
+
+// Function to create a decoder context
+HuffDecoder* huffDecoderCreate(const HuffOptions* opts) {
+    HuffDecoder* dec = (HuffDecoder*)calloc(1, sizeof(HuffDecoder));
+    if (dec == NULL)
+        return NULL;
+    if (!loadOptions(&dec->opts, opts)) {
+        free(dec);
+        return NULL;
+    }
+    dec->workers.count = workerCount(dec->opts.threads);
+    dec->ws.cs = dec->opts.stats ? &dec->ws.call : NULL;
+    dec->ws.asyncIo = dec->opts.asyncIo;
+    return dec;
+}
+
+// Function to release a decoder context and its threads
+void huffDecoderFree(HuffDecoder* dec) {
+    if (dec == NULL)
+        return;
+    releaseWorkers(&dec->workers);
+    freeWorkspace(&dec->ws);
+    free(dec);
+}
+
+// Function to read the decoder's allocation counters
+void huffDecoderMemoryStats(const HuffDecoder* dec, HuffMemoryStats* stats) {
+    copyMemoryStats(&dec->ws, stats);
+}
+
+// Function to read the statistics of the decoder's last call
+void huffDecoderStats(const HuffDecoder* dec, HuffStats* stats) {
+    *stats = dec->ws.last;
+}
+
+// Function to read the uncompressed size recorded in a compressed buffer
+int huffDecompressedSize(const void* src, size_t srcSize, uint64_t* size) {
+    const unsigned char* p = (const unsigned char*)src;
+    BlockIndex index = { 0 };
+    int status, n;
+
+    if (src == NULL || size == NULL)
+        return HUFF_ERR_ARGUMENT;
+    if (srcSize >= 4 && memcmp(p, "HUF", 3) == 0 && p[3] == FORMAT_BLOCKS) {
+        // Only the index records the total of a block container
+        if (srcSize < FILE_HEADER_SIZE || !(p[4] & FLAG_INDEX))
+            return HUFF_ERR_UNSUPPORTED;
+        status = readBlockIndex(p, srcSize, &index);
+        if (status == HUFF_OK)
+            *size = index.totalRaw;
+        freeBlockIndex(&index);
+        return status;
+    }
+    if (srcSize >= 9 && memcmp(p, "HUF", 3) == 0 && p[3] == FORMAT_CANONICAL) {
+        if (!(p[4] & COMPACT_TOTAL64))
+            *size = readU32LE(p + 5);
+        else if (srcSize >= 13)
+            *size = readU64LE(p + 5);
+        else
+            return HUFF_ERR_CORRUPT;
+        return HUFF_OK;
+    }
+    if (srcSize >= 4 && memcmp(p, "HUF", 3) == 0 && p[3] == FORMAT_ADAPTIVE) {
+        // No total is stored, so the sizes of the chunks are added up
+        uint64_t raw, comp, total = 0;
+        size_t pos = 6;
+        if (srcSize < pos || (n = readVarint(p + pos, srcSize - pos, &raw)) == 0)
+            return HUFF_ERR_CORRUPT;
+        for (pos += (size_t)n;; pos += (size_t)comp) {
+            if ((n = readVarint(p + pos, srcSize - pos, &raw)) == 0)
+                return HUFF_ERR_CORRUPT;
+            pos += (size_t)n;
+            if (raw == 0)
+                break;
+            if ((n = readVarint(p + pos, srcSize - pos, &comp)) == 0 || comp > srcSize - pos - (size_t)n)
+                return HUFF_ERR_CORRUPT;
+            pos += (size_t)n;
+            total += raw;
+        }
+        *size = total;
+        return HUFF_OK;
+    }
+    if (srcSize >= 8 && memcmp(p, "HUF", 3) == 0 && p[3] == FORMAT_DICTIONARY)
+        // Dictionary ID, then the size as a varint
+        return readVarint(p + 8, srcSize - 8, size) != 0 ? HUFF_OK : HUFF_ERR_CORRUPT;
+    // Original format: unique characters, total characters, then a character, code length and
+    // code (1 + 4 + 4 bytes) per unique character; anything else is not a compressed buffer
+    if (srcSize < 8)
+        return HUFF_ERR_CORRUPT;
+    memcpy(&n, p, sizeof(int));
+    if (n < 1 || n > 256 || srcSize - 8 < (size_t)n * (1 + 2 * sizeof(int)))
+        return HUFF_ERR_CORRUPT;
+    memcpy(&n, p + 4, sizeof(int));
+    if (n < 0)
+        return HUFF_ERR_CORRUPT;
+    *size = (uint64_t)n;
+    return HUFF_OK;
+}
+
+// Function to decompress a buffer into a caller-owned buffer
+int huffDecompressBuffer(HuffDecoder* dec, const void* src, size_t srcSize,
+                         void* dst, size_t dstCapacity, size_t* dstSize) {
+    Reader rd;
+    Writer wr;
+    unsigned char spare;
+    int status;
+
+    if (dec == NULL || (src == NULL && srcSize > 0) || (dst == NULL && dstCapacity > 0) || dstSize == NULL)
+        return HUFF_ERR_ARGUMENT;
+    *dstSize = 0;
+    openMemoryReader(&rd, (const unsigned char*)src, srcSize);
+    // A writer needs at least one byte of room; anything landing in spare is reported below
+    if (dstCapacity == 0)
+        openFixedWriter(&wr, &spare, 1);
+    else
+        openFixedWriter(&wr, (unsigned char*)dst, dstCapacity);
+    status = decompressAny(dec, &rd, &wr);
+    if (status == HUFF_OK && wr.pos > dstCapacity)
+        status = HUFF_ERR_SPACE;
+    if (status == HUFF_OK)
+        *dstSize = wr.pos;
+    return status;
+}
+
+// Function to decompress a callback stream into a callback stream
+int huffDecompressStream(HuffDecoder* dec, HuffReadFn input, void* inputUser,
+                         HuffWriteFn output, void* outputUser) {
+    Reader rd;
+    Writer wr;
+    int status, closed;
+
+    if (dec == NULL || input == NULL || output == NULL)
+        return HUFF_ERR_ARGUMENT;
+    if ((status = openSourceReader(&rd, input, inputUser, &dec->ws)) == HUFF_OK &&
+        (status = openSinkWriter(&wr, output, outputUser, &dec->ws)) == HUFF_OK) {
+        status = decompressAny(dec, &rd, &wr);
+        closed = closeWriter(&wr);
+        if (status == HUFF_OK)
+            status = closed;
+    }
+    closeReader(&rd);
+    return status;
+}
+
+// Function to decompress between file descriptors
+int huffDecompressFd(HuffDecoder* dec, int inFd, int outFd) {
+    Reader rd;
+    Writer wr;
+    int status, closed;
+
+    if (dec == NULL || inFd < 0 || outFd < 0)
+        return HUFF_ERR_ARGUMENT;
+    if ((status = openReader(&rd, inFd, &dec->ws)) == HUFF_OK &&
+        (status = openWriter(&wr, outFd, &dec->ws)) == HUFF_OK) {
+        status = decompressAny(dec, &rd, &wr);
+        closed = closeWriter(&wr);
+        if (status == HUFF_OK)
+            status = closed;
+    }
+    closeReader(&rd);
+    return status;
+}
+
+// Function to decode rd without keeping the output and report what was verified
+static int verifyAny(HuffDecoder* dec, Reader* rd, uint64_t* size, int* checked) {
+    Writer wr;
+    int status = openDiscardWriter(&wr, &dec->ws);
+    if (status == HUFF_OK)
+        status = decompressAny(dec, rd, &wr);
+    if (size != NULL)
+        *size = status == HUFF_OK ? wr.written + wr.pos : 0;
+    if (checked != NULL)
+        *checked = status == HUFF_OK && dec->ws.checked;
+    closeWriter(&wr);
+    return status;
+}
+
+// Function to decode a compressed file only to check it
+int huffVerifyFd(HuffDecoder* dec, int inFd, uint64_t* size, int* checked) {
+    Reader rd;
+    int status;
+
+    if (dec == NULL || inFd < 0)
+        return HUFF_ERR_ARGUMENT;
+    if ((status = openReader(&rd, inFd, &dec->ws)) == HUFF_OK)
+        status = verifyAny(dec, &rd, size, checked);
+    closeReader(&rd);
+    return status;
+}
+
+// Function to decode a compressed buffer only to check it
+int huffVerifyBuffer(HuffDecoder* dec, const void* src, size_t srcSize, uint64_t* size, int* checked) {
+    Reader rd;
+
+    if (dec == NULL || (src == NULL && srcSize > 0))
+        return HUFF_ERR_ARGUMENT;
+    openMemoryReader(&rd, (const unsigned char*)src, srcSize);
+    return verifyAny(dec, &rd, size, checked);
+}
+
+// Function to extract a byte range of a block container file into a callback stream
+int huffExtractFd(HuffDecoder* dec, int inFd, uint64_t offset, uint64_t length,
+                  HuffWriteFn output, void* outputUser) {
+    Reader rd;
+    Writer wr;
+    int status, closed;
+
+    if (dec == NULL || inFd < 0 || output == NULL)
+        return HUFF_ERR_ARGUMENT;
+    if ((status = openReader(&rd, inFd, &dec->ws)) == HUFF_OK) {
+        // Random access needs the whole file mapped
+        if (!rd.mapped)
+            status = HUFF_ERR_UNSUPPORTED;
+        else if ((status = openSinkWriter(&wr, output, outputUser, &dec->ws)) == HUFF_OK) {
+            status = extractRange(dec, rd.buf, rd.len, offset, length, &wr);
+            closed = closeWriter(&wr);
+            if (status == HUFF_OK)
+                status = closed;
+        }
+    }
+    closeReader(&rd);
+    return status;
+}
+
+// Function to extract a byte range of a compressed buffer into a caller-owned buffer
+int huffExtractBuffer(HuffDecoder* dec, const void* src, size_t srcSize, uint64_t offset,
+                      uint64_t length, void* dst, size_t dstCapacity, size_t* dstSize) {
+    Writer wr;
+    unsigned char spare;
+    int status;
+
+    if (dec == NULL || src == NULL || (dst == NULL && dstCapacity > 0) || dstSize == NULL)
+        return HUFF_ERR_ARGUMENT;
+    *dstSize = 0;
+    if (dstCapacity == 0)
+        openFixedWriter(&wr, &spare, 1);
+    else
+        openFixedWriter(&wr, (unsigned char*)dst, dstCapacity);
+    status = extractRange(dec, (const unsigned char*)src, srcSize, offset, length, &wr);
+    if (status == HUFF_OK && wr.pos > dstCapacity)
+        status = HUFF_ERR_SPACE;
+    if (status == HUFF_OK)
+        *dstSize = wr.pos;
+    return status;
+}
+
+// Function to search a compressed file for a byte pattern
+int huffSearchFd(HuffDecoder* dec, int inFd, const void* pattern, size_t patternSize,
+                 HuffMatchFn match, void* user) {
+    Reader rd;
+    int status;
+
+    if (dec == NULL || inFd < 0 || pattern == NULL || patternSize < 1 || patternSize > HUFF_MAX_PATTERN || match == NULL)
+        return HUFF_ERR_ARGUMENT;
+    if ((status = openReader(&rd, inFd, &dec->ws)) == HUFF_OK)
+        status = searchAny(dec, &rd, (const unsigned char*)pattern, patternSize, match, user);
+    closeReader(&rd);
+    return status;
+}
+
+// Function to search a compressed buffer for a byte pattern
+int huffSearchBuffer(HuffDecoder* dec, const void* src, size_t srcSize, const void* pattern,
+                     size_t patternSize, HuffMatchFn match, void* user) {
+    Reader rd;
+
+    if (dec == NULL || (src == NULL && srcSize > 0) || pattern == NULL || patternSize < 1 ||
+        patternSize > HUFF_MAX_PATTERN || match == NULL)
+        return HUFF_ERR_ARGUMENT;
+    openMemoryReader(&rd, (const unsigned char*)src, srcSize);
+    return searchAny(dec, &rd, (const unsigned char*)pattern, patternSize, match, user);
+}
+
+// Function to build a dictionary from sample data
+int huffTrainDictionary(const void* samples, size_t size, int maxCodeLen, HuffDictionary** dict) {
+    const unsigned char* p = (const unsigned char*)samples;
+    uint64_t freq[256] = {0};
+    int lengths[256], s;
+    HuffDictionary* d;
+
+    if ((samples == NULL && size > 0) || dict == NULL || maxCodeLen < MIN_CODE_LEN || maxCodeLen > MAX_CODE_LEN)
+        return HUFF_ERR_ARGUMENT;
+    *dict = NULL;
+
+    // Give every byte value a count of at least one so that bytes missing from the
+    // samples still get a (long) code
+    countBytes(p, size, freq);
+    for (s = 0; s < 256; s++)
+        freq[s]++;
+
+    d = (HuffDictionary*)calloc(1, sizeof(HuffDictionary));
+    if (d == NULL)
+        return HUFF_ERR_NOMEM;
+    buildLimitedCodeLengths(freq, maxCodeLen, lengths);
+    assignCanonicalCodes(lengths, d->table);
+    d->maxLen = maxCodeLen;
+    d->id = hashCodeLengths(maxCodeLen, d->table);
+    *dict = d;
+    return HUFF_OK;
+}
+
+// Function to read a saved dictionary
+int huffLoadDictionary(const void* src, size_t srcSize, HuffDictionary** dict) {
+    const unsigned char* p = (const unsigned char*)src;
+    int lengths[256], s;
+    HuffDictionary* d;
+    Reader rd;
+
+    if (src == NULL || dict == NULL)
+        return HUFF_ERR_ARGUMENT;
+    *dict = NULL;
+    // Magic, code length limit, ID, then the code lengths as in a compressed header
+    if (srcSize < DICTIONARY_HEADER_SIZE || memcmp(p, "HUFD", 4) != 0 ||
+        p[4] < MIN_CODE_LEN || p[4] > MAX_CODE_LEN)
+        return HUFF_ERR_CORRUPT;
+    openMemoryReader(&rd, p + DICTIONARY_HEADER_SIZE, srcSize - DICTIONARY_HEADER_SIZE);
+    if (!readCodeLengths(&rd, p[4], lengths))
+        return HUFF_ERR_CORRUPT;
+    // The table has to cover every byte value, or some inputs could not be encoded
+    for (s = 0; s < 256; s++) {
+        if (lengths[s] == 0)
+            return HUFF_ERR_CORRUPT;
+    }
+
+    d = (HuffDictionary*)calloc(1, sizeof(HuffDictionary));
+    if (d == NULL)
+        return HUFF_ERR_NOMEM;
+    d->maxLen = p[4];
+    if (!assignCanonicalCodes(lengths, d->table) ||
+        (d->id = hashCodeLengths(d->maxLen, d->table)) != readU32LE(p + 5)) {
+        free(d);
+        return HUFF_ERR_CORRUPT;
+    }
+    *dict = d;
+    return HUFF_OK;
+}
+
+// Function to serialize a dictionary into a caller-owned buffer
+int huffSaveDictionary(const HuffDictionary* dict, void* dst, size_t dstCapacity, size_t* dstSize) {
+    unsigned char hdr[DICTIONARY_HEADER_SIZE] = { 'H', 'U', 'F', 'D' };
+    Writer wr;
+
+    if (dict == NULL || dst == NULL || dstSize == NULL)
+        return HUFF_ERR_ARGUMENT;
+    *dstSize = 0;
+    if (dstCapacity < DICTIONARY_HEADER_SIZE)
+        return HUFF_ERR_SPACE;
+    hdr[4] = (unsigned char)dict->maxLen;
+    writeU32LE(hdr + 5, dict->id);
+    openFixedWriter(&wr, (unsigned char*)dst, dstCapacity);
+    writeBytes(&wr, hdr, DICTIONARY_HEADER_SIZE);
+    writeCodeLengths(&wr, dict->table);
+    if (wr.error == HUFF_OK)
+        *dstSize = wr.pos;
+    return wr.error;
+}
+
+// Function to get the ID a dictionary writes into compressed files
+uint32_t huffDictionaryId(const HuffDictionary* dict) {
+    return dict->id;
+}
+
+// Function to release a dictionary
+void huffDictionaryFree(HuffDictionary* dict) {
+    free(dict);
+}
+
+// Function to attach a dictionary to an encoder
+int huffEncoderSetDictionary(HuffEncoder* enc, const HuffDictionary* dict) {
+    if (enc == NULL)
+        return HUFF_ERR_ARGUMENT;
+    enc->hasDict = dict != NULL;
+    if (dict != NULL)
+        enc->dict = *dict;
+    return HUFF_OK;
+}
+
+// Function to attach a dictionary to a decoder, building its decode table once
+int huffDecoderSetDictionary(HuffDecoder* dec, const HuffDictionary* dict) {
+    int status;
+
+    if (dec == NULL)
+        return HUFF_ERR_ARGUMENT;
+    dec->hasDict = 0;
+    if (dict == NULL)
+        return HUFF_OK;
+    dec->ws.dictDt.stats = &dec->ws.stats;
+    status = buildDecodeTable(&dec->ws.dictDt, dict->table, dec->opts.tableBits, NULL);
+    if (status == HUFF_OK) {
+        dec->dict = *dict;
+        dec->hasDict = 1;
+    }
+    return status;
+}
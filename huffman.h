@@ -0,0 +1,222 @@
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint64_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// File formats that can be written (all of them can be read)
+#define HUFF_FORMAT_LEGACY 1      // Original format: no magic, 9 bytes per code
+#define HUFF_FORMAT_CANONICAL 2   // One canonical table for the whole input
+#define HUFF_FORMAT_BLOCKS 3      // Independent blocks with an index (default)
+#define HUFF_FORMAT_DICTIONARY 4  // Shared pre-trained table, only its ID in the header (small inputs)
+#define HUFF_FORMAT_ADAPTIVE 5    // No stored tables: both sides rebuild the codes from the bytes seen
+                                  // so far, so output starts as soon as input arrives (streaming)
+
+// Accepted option ranges
+#define HUFF_MIN_TABLE_BITS 6
+#define HUFF_MAX_TABLE_BITS 16
+#define HUFF_MIN_CODE_LEN 8
+#define HUFF_MAX_CODE_LEN 15
+#define HUFF_MIN_BLOCK_SIZE (16 << 10)
+#define HUFF_MAX_BLOCK_SIZE (64 << 20)
+#define HUFF_MIN_SYNC_INTERVAL (1 << 10)
+#define HUFF_MAX_THREADS 256
+#define HUFF_MAX_STREAMS 8
+#define HUFF_MAX_DICTIONARY_SIZE 170  // Largest saved dictionary (header and 256 code lengths)
+#define HUFF_MAX_PATTERN 1024     // Longest pattern huffSearchFd() / huffSearchBuffer() accept
+#define HUFF_MAX_TABLE_CACHE 256  // Most decode tables a decoding thread can keep for reuse
+#define HUFF_MIN_ADAPT_INTERVAL 256
+#define HUFF_MAX_ADAPT_INTERVAL (16 << 20)
+
+// Status codes returned by every call (HUFF_OK on success)
+typedef enum HuffStatus {
+    HUFF_OK = 0,
+    HUFF_ERR_IO = -1,           // Reading or writing failed
+    HUFF_ERR_NOMEM = -2,        // Out of memory (or a thread could not be started)
+    HUFF_ERR_CORRUPT = -3,      // Compressed data is damaged or truncated
+    HUFF_ERR_ARGUMENT = -4,     // Invalid option or argument
+    HUFF_ERR_SPACE = -5,        // Destination buffer is too small
+    HUFF_ERR_UNSUPPORTED = -6,  // Not possible for this input (e.g. two-pass format on a pipe)
+    HUFF_ERR_DICTIONARY = -7,   // Data was compressed with a dictionary the context does not have
+    HUFF_ERR_CHECKSUM = -8      // Decoded data does not match the checksum stored with it
+} HuffStatus;
+
+// Codec settings; start from huffDefaultOptions() and change what is needed
+typedef struct HuffOptions {
+    int format;             // Format written by the encoder (HUFF_FORMAT_*)
+    int maxCodeLen;         // Longest Huffman code when compressing
+    int tableBits;          // Decode table size as 2^tableBits entries
+    size_t blockSize;       // Uncompressed bytes per block
+    size_t syncInterval;    // Uncompressed bytes between random access points (0 = none)
+    int threads;            // Worker threads (0 = one per online CPU, 1 = code on the calling thread)
+    int streams;            // Interleaved bitstreams per block (1 to HUFF_MAX_STREAMS, block format only)
+    int stats;              // 1 to collect HuffStats for every compress/decompress call (0 = no timing at all)
+    int asyncIo;            // 1 to overlap reads and writes of file descriptors with coding, through io_uring
+                            // on Linux when the kernel offers it and otherwise on I/O threads; 2 to use the
+                            // I/O threads even then (0 = all I/O on the calling thread)
+    int checksum;           // 1 to store a CRC32C of every block and of the whole data (block and adaptive formats)
+    int tableCache;         // Decode tables each decoding thread keeps, so blocks and inputs with the
+                            // code lengths of a recent one skip building theirs (0 = build every table)
+    size_t adaptInterval;   // Adaptive format: most bytes coded between two rebuilds of the codes
+} HuffOptions;
+
+// Allocation counters of a context, accumulated over its lifetime; buffers are kept between
+// calls, so repeated calls of the same shape stop adding allocations after the first
+typedef struct HuffMemoryStats {
+    uint64_t allocations;       // Heap allocations (including resizes) made by the context
+    uint64_t bytesAllocated;    // Bytes requested by those allocations
+    uint64_t bytesProcessed;    // Uncompressed bytes compressed or produced by the context
+    uint64_t tablesReused;      // Decode tables taken from the table cache instead of being built
+} HuffMemoryStats;
+
+// Phases timed by the call statistics
+typedef enum HuffPhase {
+    HUFF_PHASE_HISTOGRAM,   // Counting byte frequencies
+    HUFF_PHASE_TREE,        // Building code lengths and codes, writing the code tables
+    HUFF_PHASE_ENCODE,      // Writing the bitstreams
+    HUFF_PHASE_HEADER,      // Reading headers, code tables and the block index, building decode tables
+    HUFF_PHASE_DECODE,      // Decoding the bitstreams (and copying stored blocks)
+    HUFF_PHASE_CHECKSUM,    // Computing the CRC32C of the data
+    HUFF_PHASE_COUNT
+} HuffPhase;
+
+// Statistics of the last compress or decompress call of a context (all zero unless the
+// stats option is set). Phase times are summed over the threads that ran the phase
+typedef struct HuffStats {
+    uint64_t bytesIn;           // Bytes read (uncompressed when compressing)
+    uint64_t bytesOut;          // Bytes written
+    uint64_t blocks;            // Blocks, or 1 for the single-table formats
+    uint64_t storedBlocks;      // Blocks kept unchanged
+    uint64_t rleBlocks;         // Blocks of one repeated byte
+    int symbols;                // Distinct byte values (decoding: values with a code)
+    int maxCodeLen;             // Longest code used
+    double avgCodeLen;          // Bits per Huffman coded byte (decoding: from the compressed sizes)
+    double wallSeconds;         // Elapsed time of the call
+    double cpuSeconds;          // CPU time of the whole process during the call
+    double phaseWall[HUFF_PHASE_COUNT]; // Elapsed time per phase
+    double phaseCpu[HUFF_PHASE_COUNT];  // CPU time per phase
+    HuffMemoryStats memory;     // Allocations made and bytes processed during the call
+} HuffStats;
+
+// Stream callbacks: a reader returns the number of bytes stored (0 at the end, -1 on error),
+// a writer returns 0 once all n bytes have been consumed
+typedef long (*HuffReadFn)(void* user, void* buf, size_t n);
+typedef int (*HuffWriteFn)(void* user, const void* buf, size_t n);
+
+// Search callback: called with the uncompressed offset of every match, in increasing order;
+// returning nonzero ends the search
+typedef int (*HuffMatchFn)(void* user, uint64_t offset);
+
+// Opaque codec contexts; a context may be reused for any number of calls, but must
+// not be used by two threads at the same time
+typedef struct HuffEncoder HuffEncoder;
+typedef struct HuffDecoder HuffDecoder;
+
+// Pre-trained code table shared by both sides (HUFF_FORMAT_DICTIONARY); immutable once built
+typedef struct HuffDictionary HuffDictionary;
+
+// Fill opts with the default settings
+void huffDefaultOptions(HuffOptions* opts);
+
+// Short description of a status code
+const char* huffErrorString(int status);
+
+// Create an encoder (opts may be NULL for defaults); returns NULL if opts are invalid or memory is short
+HuffEncoder* huffEncoderCreate(const HuffOptions* opts);
+void huffEncoderFree(HuffEncoder* enc);
+
+// Allocation counters of an encoder
+void huffEncoderMemoryStats(const HuffEncoder* enc, HuffMemoryStats* stats);
+
+// Statistics of the encoder's last call
+void huffEncoderStats(const HuffEncoder* enc, HuffStats* stats);
+
+// Largest compressed size srcSize bytes can take with this encoder's settings
+size_t huffCompressBound(const HuffEncoder* enc, size_t srcSize);
+
+// Compress a buffer into dst; *dstSize receives the compressed size
+int huffCompressBuffer(HuffEncoder* enc, const void* src, size_t srcSize,
+                       void* dst, size_t dstCapacity, size_t* dstSize);
+
+// Compress everything produced by input into output (block format only, single pass)
+int huffCompressStream(HuffEncoder* enc, HuffReadFn input, void* inputUser,
+                       HuffWriteFn output, void* outputUser);
+
+// Compress between file descriptors (regular input files are memory mapped)
+int huffCompressFd(HuffEncoder* enc, int inFd, int outFd);
+
+// Create a decoder (opts may be NULL for defaults; the encoding settings are not used)
+HuffDecoder* huffDecoderCreate(const HuffOptions* opts);
+void huffDecoderFree(HuffDecoder* dec);
+
+// Allocation counters of a decoder
+void huffDecoderMemoryStats(const HuffDecoder* dec, HuffMemoryStats* stats);
+
+// Statistics of the decoder's last call
+void huffDecoderStats(const HuffDecoder* dec, HuffStats* stats);
+
+// Uncompressed size recorded in a compressed buffer (adaptive format: the sum of its chunk sizes)
+int huffDecompressedSize(const void* src, size_t srcSize, uint64_t* size);
+
+// Decompress a buffer into dst; *dstSize receives the uncompressed size
+int huffDecompressBuffer(HuffDecoder* dec, const void* src, size_t srcSize,
+                         void* dst, size_t dstCapacity, size_t* dstSize);
+
+// Decompress everything produced by input into output
+int huffDecompressStream(HuffDecoder* dec, HuffReadFn input, void* inputUser,
+                         HuffWriteFn output, void* outputUser);
+
+// Decompress between file descriptors (regular output files are filled in parallel)
+int huffDecompressFd(HuffDecoder* dec, int inFd, int outFd);
+
+// Decode without writing anything, checking the CRC32C of every block and of the whole data when
+// the file carries them; *size (if not NULL) receives the uncompressed size and *checked (if not
+// NULL) is set to 1 if checksums were verified, 0 for inputs that have none (formats 1, 2 and 4,
+// block and adaptive files written with checksum = 0), which are only decoded
+int huffVerifyFd(HuffDecoder* dec, int inFd, uint64_t* size, int* checked);
+int huffVerifyBuffer(HuffDecoder* dec, const void* src, size_t srcSize, uint64_t* size, int* checked);
+
+// Write uncompressed bytes [offset, offset + length) of a block format file to output,
+// decoding only the blocks that cover the range (the range is clipped to the data)
+int huffExtractFd(HuffDecoder* dec, int inFd, uint64_t offset, uint64_t length,
+                  HuffWriteFn output, void* outputUser);
+int huffExtractBuffer(HuffDecoder* dec, const void* src, size_t srcSize, uint64_t offset,
+                      uint64_t length, void* dst, size_t dstCapacity, size_t* dstSize);
+
+// Find every occurrence of pattern (1 to HUFF_MAX_PATTERN bytes) in the uncompressed data without
+// writing it out. In an indexed block format file each block's bitstreams are first scanned for
+// the pattern's code bits, so only blocks that may hold a match are decoded, on the decoder's
+// threads; other inputs (pipes, formats 1, 2, 4 and 5) are decoded in memory and scanned
+int huffSearchFd(HuffDecoder* dec, int inFd, const void* pattern, size_t patternSize,
+                 HuffMatchFn match, void* user);
+int huffSearchBuffer(HuffDecoder* dec, const void* src, size_t srcSize, const void* pattern,
+                     size_t patternSize, HuffMatchFn match, void* user);
+
+// Train a dictionary on sample data (the samples concatenated); every byte value gets a code,
+// so the dictionary can encode any input, with short codes for what the samples contain
+int huffTrainDictionary(const void* samples, size_t size, int maxCodeLen, HuffDictionary** dict);
+
+// Read a dictionary saved by huffSaveDictionary()
+int huffLoadDictionary(const void* src, size_t srcSize, HuffDictionary** dict);
+
+// Serialize a dictionary (at most HUFF_MAX_DICTIONARY_SIZE bytes); *dstSize receives its size
+int huffSaveDictionary(const HuffDictionary* dict, void* dst, size_t dstCapacity, size_t* dstSize);
+
+// ID written into every file compressed with the dictionary (a hash of its code lengths)
+uint32_t huffDictionaryId(const HuffDictionary* dict);
+void huffDictionaryFree(HuffDictionary* dict);
+
+// Attach a dictionary to a context (NULL detaches it); the context keeps its own copy, and a
+// decoder builds the decode table once here instead of once per input
+int huffEncoderSetDictionary(HuffEncoder* enc, const HuffDictionary* dict);
+int huffDecoderSetDictionary(HuffDecoder* dec, const HuffDictionary* dict);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,808 @@
+#include <stdio.h>      // Standard I/O functions
+#include <stdlib.h>     // Standard library functions (e.g., malloc, qsort)
+#include <string.h>     // String manipulation functions
+#include <fcntl.h>      // File control options for open()
+#include <unistd.h>     // UNIX standard functions (read, write, pipe, sysconf)
+#include <errno.h>      // errno values (EINTR retries, EADDRINUSE)
+#include <stdint.h>     // Fixed width integers for frame fields
+#include <signal.h>     // Stopping on SIGINT and SIGTERM, ignoring SIGPIPE
+#include <poll.h>       // Waiting for requests on idle connections
+#include <pthread.h>    // Worker and client threads
+#include <time.h>       // Request latencies
+#include <sys/socket.h> // Unix domain sockets
+#include <sys/stat.h>   // File permission constants
+#include <sys/time.h>   // Socket timeouts
+#include <sys/uio.h>    // writev() of a frame header and its payload
+#include <sys/un.h>     // Unix socket addresses
+
+#include "server.h"     // Server mode interface
+
+#define REQUEST_TIMEOUT 10          // Seconds a worker waits for the rest of a started request
+#define MAX_CONNECTIONS 1024        // Most concurrent connections the load generator opens
+
+// Reusable buffers of a worker or client: a request payload and a reply (worker replies start
+// with room for the header, so header and result go out in one write)
+typedef struct FrameBuffers {
+    unsigned char* in;
+    size_t inCap;
+    unsigned char* out;
+    size_t outCap;
+} FrameBuffers;
+
+// State shared by the dispatcher and the workers
+typedef struct Server {
+    pthread_mutex_t lock;   // Protects the queue and stopping
+    pthread_cond_t ready;   // Signalled when a connection is queued or the server stops
+    int* queue;             // Ring of connections with a request waiting
+    size_t head;            // Oldest queued connection
+    size_t count;
+    size_t cap;
+    int stopping;           // 1 once workers should exit after the queue is empty
+    int wake[2];            // Pipe that hands connections back to the dispatcher (-1 asks it to stop)
+} Server;
+
+// One worker thread and its single-threaded contexts
+typedef struct ServerWorker {
+    Server* s;
+    HuffEncoder* enc;
+    HuffDecoder* dec;
+    FrameBuffers buf;
+    uint64_t requests;      // Requests answered
+    uint64_t failed;        // Requests answered with an error
+    uint64_t bytesIn;       // Payload bytes of successful requests
+    uint64_t bytesOut;      // Payload bytes of their replies
+    pthread_t thread;
+} ServerWorker;
+
+// One connection of the load generator
+typedef struct LoadClient {
+    const char* path;
+    unsigned char** files;  // Payloads, shared by all clients
+    size_t* sizes;
+    int count;
+    int first;              // File of the first round trip
+    int rounds;             // Round trips to make
+    uint64_t* latency[2];   // Nanoseconds per compress and decompress request
+    int done[2];            // Latencies recorded per operation
+    int failed;             // Round trips that did not bring the file back
+    uint64_t bytes;         // Uncompressed bytes of the successful round trips
+    pthread_t thread;
+} LoadClient;
+
+// Write end of the dispatcher's wake pipe, for the signal handler
+static int stopFd = -1;
+
+// Function to store a 32-bit value in little-endian byte order
+static void putU32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// Function to load a 32-bit little-endian value
+static uint32_t getU32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Function to write all n bytes to a file descriptor, returns 0 on success
+static int writeAll(int fd, const void* buf, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = write(fd, (const char*)buf + done, n - done);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += (size_t)w;
+    }
+    return 0;
+}
+
+// Function to read exactly n bytes, returns 1 on success, 0 at the end of the input before the
+// first byte and -1 on errors, timeouts and truncated data
+static int readAll(int fd, void* buf, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = read(fd, (char*)buf + done, n - done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return r == 0 && done == 0 ? 0 : -1;
+        done += (size_t)r;
+    }
+    return 1;
+}
+
+// Function to make a buffer hold at least n bytes, returns 0 if memory is short
+static int growBuffer(unsigned char** buf, size_t* cap, size_t n) {
+    if (n <= *cap && *buf != NULL)
+        return 1;
+    size_t size = *cap ? *cap : 65536;
+    while (size < n)
+        size *= 2;
+    unsigned char* grown = (unsigned char*)realloc(*buf, size);
+    if (grown == NULL)
+        return 0;
+    *buf = grown;
+    *cap = size;
+    return 1;
+}
+
+// Function to read a whole file ("-" for standard input) of at most SERVER_MAX_PAYLOAD bytes into
+// buf->in, returns 0 after printing why it could not
+static int readFile(const char* path, FrameBuffers* buf, size_t* size) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    size_t n = 0;
+    ssize_t r = 1;
+
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    while (r > 0 && n <= SERVER_MAX_PAYLOAD) {
+        if (!growBuffer(&buf->in, &buf->inCap, n + 1)) {
+            fprintf(stderr, "Out of memory.\n");
+            break;
+        }
+        r = read(fd, buf->in + n, buf->inCap - n);
+        if (r < 0 && errno == EINTR)
+            r = 1;
+        else if (r > 0)
+            n += (size_t)r;
+    }
+    if (r < 0)
+        perror(path);
+    else if (n > SERVER_MAX_PAYLOAD)
+        fprintf(stderr, "%s: larger than the %u MB a request can carry.\n", path, SERVER_MAX_PAYLOAD >> 20);
+    if (fd != STDIN_FILENO)
+        close(fd);
+    *size = n;
+    return r == 0 && n <= SERVER_MAX_PAYLOAD;
+}
+
+// Function to fill in the address of a Unix socket, returns 0 if the path does not fit
+static int socketAddress(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+// Function to connect to the server at path, returns the socket or -1 (errno set)
+static int connectSocket(const char* path) {
+    struct sockaddr_un addr;
+    int fd;
+    if (!socketAddress(path, &addr) || (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+// Function to create the listening socket; a socket file left by a server that is gone is
+// replaced, one a server still answers on is not
+static int openListener(const char* path) {
+    struct sockaddr_un addr;
+    int fd, ok;
+
+    if (!socketAddress(path, &addr) || (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror(path);
+        return -1;
+    }
+    ok = bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    if (!ok && errno == EADDRINUSE) {
+        int probe = connectSocket(path);
+        if (probe >= 0) {
+            close(probe);
+            errno = EADDRINUSE;
+        }
+        else if (unlink(path) == 0) {
+            ok = bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        }
+        else {
+            errno = EADDRINUSE;
+        }
+    }
+    if (!ok || listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to send a request frame, returns 0 on success
+static int sendRequest(int fd, int op, const void* payload, size_t n) {
+    unsigned char hdr[SERVER_HEADER_SIZE] = { (unsigned char)op, 0, 0, 0 };
+    struct iovec iov[2];
+    ssize_t w;
+
+    putU32(hdr + 4, (uint32_t)n);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = SERVER_HEADER_SIZE;
+    iov[1].iov_base = (void*)payload;
+    iov[1].iov_len = n;
+    do {
+        w = writev(fd, iov, 2);
+    } while (w < 0 && errno == EINTR);
+    if (w < 0)
+        return -1;
+    // Short writes: finish the header, then the payload
+    if ((size_t)w < SERVER_HEADER_SIZE) {
+        if (writeAll(fd, hdr + w, SERVER_HEADER_SIZE - (size_t)w) != 0)
+            return -1;
+        w = SERVER_HEADER_SIZE;
+    }
+    return writeAll(fd, (const char*)payload + (w - SERVER_HEADER_SIZE), n - (size_t)(w - SERVER_HEADER_SIZE));
+}
+
+// Function to send one request and read its reply into reply->out; returns the status the
+// server sent (HUFF_ERR_IO if the connection failed) and stores the reply size in *size
+static int exchange(int fd, int op, const void* payload, size_t n, FrameBuffers* reply, size_t* size) {
+    unsigned char hdr[SERVER_HEADER_SIZE];
+    int status;
+
+    *size = 0;
+    if (sendRequest(fd, op, payload, n) != 0 || readAll(fd, hdr, SERVER_HEADER_SIZE) != 1)
+        return HUFF_ERR_IO;
+    status = (int32_t)getU32(hdr);
+    n = getU32(hdr + 4);
+    if (n > SERVER_MAX_PAYLOAD)
+        return HUFF_ERR_IO;
+    if (!growBuffer(&reply->out, &reply->outCap, n))
+        return HUFF_ERR_NOMEM;
+    if (readAll(fd, reply->out, n) != 1 && n > 0)
+        return HUFF_ERR_IO;
+    *size = n;
+    return status;
+}
+
+// Function to run a request on a worker's contexts; the result goes after the header room in
+// the reply buffer, its size into *size
+static int runRequest(ServerWorker* w, int op, size_t n, size_t* size) {
+    FrameBuffers* b = &w->buf;
+    uint64_t raw;
+    size_t cap;
+    int status;
+
+    if (op == SERVER_OP_COMPRESS) {
+        // Replies are limited like requests, so data that would grow past that fails with HUFF_ERR_SPACE
+        cap = huffCompressBound(w->enc, n);
+        if (cap > SERVER_MAX_PAYLOAD)
+            cap = SERVER_MAX_PAYLOAD;
+        if (!growBuffer(&b->out, &b->outCap, SERVER_HEADER_SIZE + cap))
+            return HUFF_ERR_NOMEM;
+        return huffCompressBuffer(w->enc, b->in, n, b->out + SERVER_HEADER_SIZE, cap, size);
+    }
+    if (op == SERVER_OP_DECOMPRESS) {
+        if ((status = huffDecompressedSize(b->in, n, &raw)) != HUFF_OK)
+            return status;
+        if (raw > SERVER_MAX_PAYLOAD)
+            return HUFF_ERR_SPACE;
+        if (!growBuffer(&b->out, &b->outCap, SERVER_HEADER_SIZE + (size_t)raw))
+            return HUFF_ERR_NOMEM;
+        return huffDecompressBuffer(w->dec, b->in, n, b->out + SERVER_HEADER_SIZE, (size_t)raw, size);
+    }
+    return HUFF_ERR_ARGUMENT;
+}
+
+// Function to read one request from in and write its reply to out; returns 1 if another
+// request may follow, 0 at the end of the input or when the connection has to be closed
+static int answerRequest(ServerWorker* w, int in, int out) {
+    FrameBuffers* b = &w->buf;
+    unsigned char hdr[SERVER_HEADER_SIZE];
+    size_t n, size = 0;
+    int status, keep = 1;
+
+    if (readAll(in, hdr, SERVER_HEADER_SIZE) != 1)
+        return 0;
+    n = getU32(hdr + 4);
+    if (hdr[1] != 0 || hdr[2] != 0 || hdr[3] != 0 || n > SERVER_MAX_PAYLOAD) {
+        // Not a frame this server understands, so its payload cannot be skipped either
+        status = HUFF_ERR_ARGUMENT;
+        keep = 0;
+    }
+    else if (!growBuffer(&b->in, &b->inCap, n)) {
+        status = HUFF_ERR_NOMEM;
+        keep = 0;
+    }
+    else if (readAll(in, b->in, n) != 1 && n > 0) {
+        return 0;
+    }
+    else {
+        status = runRequest(w, hdr[0], n, &size);
+    }
+
+    w->requests++;
+    if (status != HUFF_OK) {
+        w->failed++;
+        size = 0;
+    }
+    else {
+        w->bytesIn += n;
+        w->bytesOut += size;
+    }
+    if (!growBuffer(&b->out, &b->outCap, SERVER_HEADER_SIZE))
+        return 0;
+    putU32(b->out, (uint32_t)status);
+    putU32(b->out + 4, (uint32_t)size);
+    if (writeAll(out, b->out, SERVER_HEADER_SIZE + size) != 0)
+        return 0;
+    return keep;
+}
+
+// Function to queue a connection with a request waiting, returns 0 if memory is short
+static int queueConnection(Server* s, int fd) {
+    pthread_mutex_lock(&s->lock);
+    if (s->count == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 64;
+        int* grown = (int*)malloc(cap * sizeof(int));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&s->lock);
+            return 0;
+        }
+        for (size_t i = 0; i < s->count; i++)
+            grown[i] = s->queue[(s->head + i) % s->cap];
+        free(s->queue);
+        s->queue = grown;
+        s->head = 0;
+        s->cap = cap;
+    }
+    s->queue[(s->head + s->count++) % s->cap] = fd;
+    pthread_cond_signal(&s->ready);
+    pthread_mutex_unlock(&s->lock);
+    return 1;
+}
+
+// Function to take the oldest queued connection, waiting for one; returns -1 once the server
+// stops and the queue is empty
+static int takeConnection(Server* s) {
+    int fd = -1;
+    pthread_mutex_lock(&s->lock);
+    while (s->count == 0 && !s->stopping)
+        pthread_cond_wait(&s->ready, &s->lock);
+    if (s->count > 0) {
+        fd = s->queue[s->head];
+        s->head = (s->head + 1) % s->cap;
+        s->count--;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return fd;
+}
+
+// Worker thread: answer the requests of queued connections, keeping a connection while it has
+// more requests ready and handing it back to the dispatcher once it is idle
+static void* serverWorker(void* arg) {
+    ServerWorker* w = (ServerWorker*)arg;
+    int fd;
+    while ((fd = takeConnection(w->s)) >= 0) {
+        struct pollfd p = { fd, POLLIN, 0 };
+        int keep;
+        do {
+            keep = answerRequest(w, fd, fd);
+        } while (keep && poll(&p, 1, 0) > 0);
+        if (!keep || write(w->s->wake[1], &fd, sizeof(int)) != sizeof(int))
+            close(fd);
+    }
+    return NULL;
+}
+
+// Signal handler: ask the dispatcher to stop
+static void requestStop(int sig) {
+    int stop = -1;
+    ssize_t w = write(stopFd, &stop, sizeof(int));
+    (void)sig;
+    (void)w;
+}
+
+// Function to add a descriptor to the dispatcher's poll set, returns 0 if memory is short
+static int watch(struct pollfd** fds, size_t* count, size_t* cap, int fd) {
+    if (*count == *cap) {
+        size_t grown = *cap ? *cap * 2 : 64;
+        struct pollfd* p = (struct pollfd*)realloc(*fds, grown * sizeof(struct pollfd));
+        if (p == NULL)
+            return 0;
+        *fds = p;
+        *cap = grown;
+    }
+    (*fds)[*count].fd = fd;
+    (*fds)[*count].events = POLLIN;
+    (*fds)[*count].revents = 0;
+    (*count)++;
+    return 1;
+}
+
+// Function to run the dispatcher: accept connections and pass the ones with a request waiting
+// to the workers until a stop is requested; returns the process exit status
+static int runServer(const char* path, Server* s, ServerWorker* workers, int count) {
+    struct pollfd* fds = NULL;
+    size_t nfds = 0, capFds = 0, i;
+    struct timeval timeout = { REQUEST_TIMEOUT, 0 };
+    struct sigaction sa;
+    int listenFd, started = 0, stop = 0, fd;
+    int handback[64];
+
+    if ((listenFd = openListener(path)) < 0)
+        return 1;
+    if (pipe(s->wake) != 0 || fcntl(s->wake[0], F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(s->wake[1], F_SETFL, O_NONBLOCK) != 0 || !watch(&fds, &nfds, &capFds, listenFd) ||
+        !watch(&fds, &nfds, &capFds, s->wake[0])) {
+        perror("server");
+        close(listenFd);
+        unlink(path);
+        free(fds);
+        return 1;
+    }
+
+    // SIGINT and SIGTERM stop the server after the requests in progress; a client that goes
+    // away mid-reply must not kill it
+    stopFd = s->wake[1];
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = requestStop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->ready, NULL);
+    for (int w = 0; w < count; w++) {
+        if (pthread_create(&workers[w].thread, NULL, serverWorker, &workers[w]) != 0)
+            break;
+        started++;
+    }
+    if (started < count) {
+        fprintf(stderr, "Could not start the worker threads.\n");
+        stop = 1;
+    }
+    else {
+        fprintf(stderr, "Listening on %s with %d worker%s.\n", path, count, count > 1 ? "s" : "");
+    }
+
+    while (!stop) {
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        // Connections handed back by the workers, and stop requests
+        if (fds[1].revents & POLLIN) {
+            ssize_t r;
+            while ((r = read(s->wake[0], handback, sizeof(handback))) > 0) {
+                for (i = 0; i < (size_t)r / sizeof(int); i++) {
+                    if (handback[i] < 0)
+                        stop = 1;
+                    else if (!watch(&fds, &nfds, &capFds, handback[i]))
+                        close(handback[i]);
+                }
+            }
+        }
+
+        // Idle connections that sent a request (or hung up) go to the workers
+        for (i = nfds; i-- > 2;) {
+            if (fds[i].revents == 0)
+                continue;
+            if (!queueConnection(s, fds[i].fd))
+                close(fds[i].fd);
+            fds[i] = fds[--nfds];
+        }
+
+        // New connections; a worker waits at most REQUEST_TIMEOUT for a stalled request
+        if (fds[0].revents & POLLIN) {
+            fd = accept(listenFd, NULL, NULL);
+            if (fd >= 0) {
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                if (!watch(&fds, &nfds, &capFds, fd))
+                    close(fd);
+            }
+        }
+    }
+
+    // Let the workers finish what is queued, then close everything
+    pthread_mutex_lock(&s->lock);
+    s->stopping = 1;
+    pthread_cond_broadcast(&s->ready);
+    pthread_mutex_unlock(&s->lock);
+    for (int w = 0; w < started; w++)
+        pthread_join(workers[w].thread, NULL);
+    for (i = 2; i < nfds; i++)
+        close(fds[i].fd);
+    ssize_t r;
+    while ((r = read(s->wake[0], handback, sizeof(handback))) > 0) {
+        for (i = 0; i < (size_t)r / sizeof(int); i++) {
+            if (handback[i] >= 0)
+                close(handback[i]);
+        }
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    stopFd = -1;
+    close(s->wake[0]);
+    close(s->wake[1]);
+    close(listenFd);
+    unlink(path);
+    pthread_cond_destroy(&s->ready);
+    pthread_mutex_destroy(&s->lock);
+    free(s->queue);
+    free(fds);
+    return started < count;
+}
+
+// Function to run the server
+int serve(const char* path, const HuffOptions* opts, const HuffDictionary* dict) {
+    Server s;
+    ServerWorker* workers;
+    HuffOptions o = *opts;
+    HuffMemoryStats ms;
+    uint64_t requests = 0, failed = 0, bytesIn = 0, bytesOut = 0, reused = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = opts->threads > 0 ? opts->threads : (cpus > 0 ? (int)(cpus < HUFF_MAX_THREADS ? cpus : HUFF_MAX_THREADS) : 1);
+    int status = 0, w;
+
+    // Requests run whole on their worker, so every context is single-threaded
+    if (strcmp(path, "-") == 0)
+        count = 1;
+    o.threads = 1;
+    o.asyncIo = 0;
+    memset(&s, 0, sizeof(s));
+    workers = (ServerWorker*)calloc((size_t)count, sizeof(ServerWorker));
+    for (w = 0; workers != NULL && w < count; w++) {
+        workers[w].s = &s;
+        workers[w].enc = huffEncoderCreate(&o);
+        workers[w].dec = huffDecoderCreate(&o);
+        if (workers[w].enc == NULL || workers[w].dec == NULL ||
+            huffEncoderSetDictionary(workers[w].enc, dict) != HUFF_OK ||
+            huffDecoderSetDictionary(workers[w].dec, dict) != HUFF_OK)
+            break;
+    }
+    if (workers == NULL || w < count) {
+        fprintf(stderr, "Out of memory.\n");
+        status = 1;
+    }
+    else if (strcmp(path, "-") == 0) {
+        while (answerRequest(&workers[0], STDIN_FILENO, STDOUT_FILENO))
+            ;
+    }
+    else {
+        status = runServer(path, &s, workers, count);
+    }
+
+    // Summary
+    for (w = 0; workers != NULL && w < count; w++) {
+        requests += workers[w].requests;
+        failed += workers[w].failed;
+        bytesIn += workers[w].bytesIn;
+        bytesOut += workers[w].bytesOut;
+        if (workers[w].dec != NULL) {
+            huffDecoderMemoryStats(workers[w].dec, &ms);
+            reused += ms.tablesReused;
+        }
+        huffEncoderFree(workers[w].enc);
+        huffDecoderFree(workers[w].dec);
+        free(workers[w].buf.in);
+        free(workers[w].buf.out);
+    }
+    free(workers);
+    if (status == 0 || requests > 0)
+        fprintf(stderr, "Answered %llu requests (%llu failed): %.2f MB in, %.2f MB out, %llu decode tables reused.\n",
+                (unsigned long long)requests, (unsigned long long)failed, (double)bytesIn / (1 << 20),
+                (double)bytesOut / (1 << 20), (unsigned long long)reused);
+    return status;
+}
+
+// Function to send one request and save the reply
+int client(const char* path, int op, const char* inputFile, const char* outputFile) {
+    FrameBuffers b = { 0 };
+    size_t n, size = 0;
+    int fd, out, status = 1;
+
+    if (readFile(inputFile, &b, &n)) {
+        if ((fd = connectSocket(path)) < 0) {
+            perror(path);
+        }
+        else {
+            status = exchange(fd, op, b.in, n, &b, &size);
+            close(fd);
+            if (status != HUFF_OK) {
+                fprintf(stderr, "%s: %s\n", path, huffErrorString(status));
+                status = 1;
+            }
+            else {
+                out = strcmp(outputFile, "-") == 0 ? STDOUT_FILENO
+                                                   : open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+                if (out < 0 || writeAll(out, b.out, size) != 0)
+                    perror(outputFile);
+                else
+                    status = 0;
+                if (out > STDOUT_FILENO)
+                    close(out);
+            }
+        }
+    }
+    free(b.in);
+    free(b.out);
+    return status;
+}
+
+// Function to get a monotonic time in nanoseconds
+static uint64_t nowNs(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+// Load generator thread: compress each file, decompress the result and compare
+static void* loadClient(void* arg) {
+    LoadClient* c = (LoadClient*)arg;
+    FrameBuffers reply[2] = { { 0 }, { 0 } };
+    size_t packed, size = 0;
+    uint64_t t0, t1;
+    int fd = connectSocket(c->path);
+    int r, k, status;
+
+    if (fd < 0) {
+        perror(c->path);
+        c->failed = c->rounds;
+        return NULL;
+    }
+    for (r = 0; r < c->rounds; r++) {
+        k = (c->first + r) % c->count;
+        t0 = nowNs();
+        status = exchange(fd, SERVER_OP_COMPRESS, c->files[k], c->sizes[k], &reply[0], &packed);
+        t1 = nowNs();
+        if (status == HUFF_ERR_IO)
+            break;
+        c->latency[0][c->done[0]++] = t1 - t0;
+        if (status == HUFF_OK) {
+            status = exchange(fd, SERVER_OP_DECOMPRESS, reply[0].out, packed, &reply[1], &size);
+            t0 = nowNs();
+            if (status == HUFF_ERR_IO)
+                break;
+            c->latency[1][c->done[1]++] = t0 - t1;
+        }
+        if (status != HUFF_OK || size != c->sizes[k] || memcmp(reply[1].out, c->files[k], size) != 0) {
+            if (c->failed++ == 0)
+                fprintf(stderr, "Round trip of a %zu byte payload failed: %s\n", c->sizes[k],
+                        status != HUFF_OK ? huffErrorString(status) : "data differs");
+        }
+        else {
+            c->bytes += c->sizes[k];
+        }
+    }
+    if (r < c->rounds) {
+        fprintf(stderr, "%s: connection lost.\n", c->path);
+        c->failed += c->rounds - r;
+    }
+    close(fd);
+    free(reply[0].out);
+    free(reply[1].out);
+    return NULL;
+}
+
+// Function to order latencies for the percentiles
+static int byLatency(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Function to print the latency percentiles of one operation (all is sorted)
+static void printLatency(const char* what, const uint64_t* all, size_t n) {
+    if (n == 0) {
+        printf("%-11s no requests answered\n", what);
+        return;
+    }
+    printf("%-11s %zu requests, p50 %.1f us, p99 %.1f us, max %.1f us\n", what, n,
+           (double)all[(n * 50 + 99) / 100 - 1] / 1e3, (double)all[(n * 99 + 99) / 100 - 1] / 1e3,
+           (double)all[n - 1] / 1e3);
+}
+
+// Function to run the load generator
+int loadgen(const char* path, char* files[], int count, int requests, int connections) {
+    static const char* names[2] = { "compress", "decompress" };
+    unsigned char** data = (unsigned char**)calloc((size_t)count, sizeof(unsigned char*));
+    size_t* sizes = (size_t*)calloc((size_t)count, sizeof(size_t));
+    LoadClient* clients;
+    uint64_t* all = NULL;
+    uint64_t t0, t1, bytes = 0;
+    int i, op, started = 0, failed = 0, ok = data != NULL && sizes != NULL;
+
+    if (connections > requests)
+        connections = requests;
+    if (connections > MAX_CONNECTIONS)
+        connections = MAX_CONNECTIONS;
+    clients = (LoadClient*)calloc((size_t)connections, sizeof(LoadClient));
+    ok = ok && clients != NULL;
+    if (!ok)
+        fprintf(stderr, "Out of memory.\n");
+
+    // Every file is one payload; its buffer is handed over from the read
+    for (i = 0; ok && i < count; i++) {
+        FrameBuffers b = { 0 };
+        ok = readFile(files[i], &b, &sizes[i]);
+        data[i] = b.in;
+    }
+    for (i = 0; ok && i < connections; i++) {
+        LoadClient* c = &clients[i];
+        c->path = path;
+        c->files = data;
+        c->sizes = sizes;
+        c->count = count;
+        c->first = i % count;
+        c->rounds = requests / connections + (i < requests % connections);
+        c->latency[0] = (uint64_t*)malloc((size_t)c->rounds * sizeof(uint64_t) + 1);
+        c->latency[1] = (uint64_t*)malloc((size_t)c->rounds * sizeof(uint64_t) + 1);
+        if (c->latency[0] == NULL || c->latency[1] == NULL) {
+            fprintf(stderr, "Out of memory.\n");
+            ok = 0;
+        }
+    }
+
+    if (ok) {
+        t0 = nowNs();
+        for (i = 0; i < connections; i++) {
+            if (pthread_create(&clients[i].thread, NULL, loadClient, &clients[i]) != 0)
+                break;
+            started++;
+        }
+        for (i = 0; i < started; i++)
+            pthread_join(clients[i].thread, NULL);
+        t1 = nowNs();
+        if (started < connections) {
+            fprintf(stderr, "Could not start the client threads.\n");
+            ok = 0;
+        }
+
+        // Percentiles of each operation over all connections
+        all = (uint64_t*)malloc((size_t)requests * sizeof(uint64_t) + 1);
+        if (ok && all == NULL) {
+            fprintf(stderr, "Out of memory.\n");
+            ok = 0;
+        }
+        for (op = 0; ok && op < 2; op++) {
+            size_t n = 0;
+            for (i = 0; i < connections; i++) {
+                memcpy(all + n, clients[i].latency[op], (size_t)clients[i].done[op] * sizeof(uint64_t));
+                n += (size_t)clients[i].done[op];
+            }
+            qsort(all, n, sizeof(uint64_t), byLatency);
+            printLatency(names[op], all, n);
+        }
+        for (i = 0; i < started; i++) {
+            failed += clients[i].failed;
+            bytes += clients[i].bytes;
+        }
+        if (ok) {
+            double seconds = (double)(t1 - t0) * 1e-9;
+            uint64_t answered = 0;
+            for (i = 0; i < connections; i++)
+                answered += (uint64_t)(clients[i].done[0] + clients[i].done[1]);
+            printf("%llu requests over %d connections in %.3f s: %.0f requests/s, %.1f MB/s round trip, "
+                   "%d round trips failed\n", (unsigned long long)answered, connections, seconds,
+                   seconds > 0 ? (double)answered / seconds : 0.0,
+                   seconds > 0 ? (double)bytes / seconds / 1e6 : 0.0, failed);
+        }
+    }
+
+    for (i = 0; clients != NULL && i < connections; i++) {
+        free(clients[i].latency[0]);
+        free(clients[i].latency[1]);
+    }
+    for (i = 0; data != NULL && i < count; i++)
+        free(data[i]);
+    free(all);
+    free(clients);
+    free(data);
+    free(sizes);
+    return !ok || failed > 0;
+}
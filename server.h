@@ -0,0 +1,30 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "huffman.h"
+
+// Framed requests: an 8-byte header (operation, three zero bytes, payload size as 32 bits
+// little-endian) followed by the payload. Every request gets a reply with an 8-byte header
+// (HUFF_* status as 32 bits little-endian, payload size) and, on success, the result
+#define SERVER_HEADER_SIZE 8
+#define SERVER_OP_COMPRESS 1
+#define SERVER_OP_DECOMPRESS 2
+#define SERVER_MAX_PAYLOAD (256u << 20)  // Largest request or reply payload
+#define SERVER_TABLE_CACHE 16            // Decode tables each server worker keeps by default
+
+// Answer compress and decompress requests on the Unix domain socket at path until SIGINT or
+// SIGTERM, spreading the connections over worker threads that each keep their own contexts
+// and buffers; "-" answers the requests read from standard input on standard output until
+// the end of the input. dict may be NULL. Returns the process exit status
+int serve(const char* path, const HuffOptions* opts, const HuffDictionary* dict);
+
+// Send the contents of inputFile as one request (op is SERVER_OP_*) and write the reply
+// to outputFile. Returns the process exit status
+int client(const char* path, int op, const char* inputFile, const char* outputFile);
+
+// Send requests compress-then-decompress round trips of the given files over connections
+// concurrent connections, check that every file comes back unchanged and print the latency
+// percentiles of each operation. Returns the process exit status
+int loadgen(const char* path, char* files[], int count, int requests, int connections);
+
+#endif
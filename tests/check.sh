@@ -0,0 +1,344 @@
+#!/bin/sh
+# Quick regression checks of the command line tool: round trips of every format and option set,
+# commands checked against plain tools, and rejection of damaged input. Run from the repository
+# root: make check (HUFF and BENCH override the binaries)
+set -u
+
+HUFF=${HUFF:-./huffman}
+BENCH=${BENCH:-./bench}
+# Some checks change directory
+case $HUFF in /*) ;; *) HUFF=$PWD/$HUFF ;; esac
+case $BENCH in /*) ;; *) BENCH=$PWD/$BENCH ;; esac
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+passed=0
+failed=0
+
+# Run one check: a name, then the command; its output is shown only if it fails
+check() {
+    name=$1
+    shift
+    if "$@" > "$TMP/log" 2>&1; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL: $name"
+        sed 's/^/    /' "$TMP/log"
+    fi
+}
+
+# Succeed if the command fails (damaged input must be refused, not decoded)
+fails() {
+    ! "$@"
+}
+
+# Compress a file with the given options, decompress it and compare
+roundTrip() {
+    in=$1
+    shift
+    "$HUFF" compress "$in" "$TMP/packed" "$@" > /dev/null &&
+        "$HUFF" decompress "$TMP/packed" "$TMP/restored" > /dev/null &&
+        cmp "$in" "$TMP/restored"
+}
+
+# The same through pipes on standard input and output
+pipeRoundTrip() {
+    in=$1
+    shift
+    cat "$in" | "$HUFF" compress - - "$@" | "$HUFF" decompress - - | cmp "$in" -
+}
+
+# Corpora: empty, one byte, one repeated byte, text, random bytes, text and random bytes across
+# several blocks, and a small record
+: > "$TMP/empty"
+printf 'x' > "$TMP/one"
+head -c 1048576 /dev/zero | tr '\0' 'a' > "$TMP/single"
+cat huffman.c app.c README.md > "$TMP/text"
+head -c 2097152 /dev/urandom > "$TMP/random"
+cat "$TMP/text" "$TMP/random" "$TMP/text" "$TMP/text" > "$TMP/mixed"
+head -c 200 README.md > "$TMP/record"
+corpora="empty one single text random mixed record"
+
+# Every format and the block format's settings
+for c in $corpora; do
+    for f in 1 2 3; do
+        check "format $f round trip of $c" roundTrip "$TMP/$c" --format=$f
+    done
+    check "block format pipe round trip of $c" pipeRoundTrip "$TMP/$c"
+    check "one thread round trip of $c" roundTrip "$TMP/$c" --threads=1
+done
+for opt in --block-size=16K --block-size=64M --streams=1 --streams=8 --max-code-len=8 --max-code-len=15 \
+           --table-bits=6 --table-bits=16 --sync-interval=0 --sync-interval=1K --threads=3 --no-checksum; do
+    check "round trip with $opt" roundTrip "$TMP/mixed" $opt
+    check "pipe round trip with $opt" pipeRoundTrip "$TMP/mixed" $opt
+done
+check "legacy option" roundTrip "$TMP/text" --legacy
+# The original format always ends in a final byte, zero when the codes end on a byte boundary:
+# compare with what the original program writes for 8 one-bit codes
+printf aaaaaaab > "$TMP/aligned"
+printf '\002\000\000\000\010\000\000\000\142\001\000\000\000\000\000\000\000\141\001\000\000\000\001\000\000\000\376\000' > "$TMP/expected"
+check "legacy output matches the original program" sh -c \
+    "'$HUFF' compress '$TMP/aligned' '$TMP/packed' --format=1 > /dev/null && cmp '$TMP/expected' '$TMP/packed'"
+# The same on the worker threads (the input is large enough to be encoded in slices)
+yes aaaaaaab | tr -d '\n' | head -c 9000000 > "$TMP/aligned"
+check "threaded legacy output ends in the final byte" sh -c \
+    "'$HUFF' compress '$TMP/aligned' '$TMP/packed' --format=1 --threads=4 > /dev/null &&
+     '$HUFF' compress '$TMP/aligned' '$TMP/expected' --format=1 --threads=1 > /dev/null &&
+     cmp '$TMP/expected' '$TMP/packed' && [ \$(wc -c < '$TMP/packed') -eq 1125027 ] &&
+     '$HUFF' decompress '$TMP/packed' '$TMP/restored' > /dev/null && cmp '$TMP/aligned' '$TMP/restored'"
+check "single-table format from a pipe is refused" fails pipeRoundTrip "$TMP/text" --format=2
+
+# Dictionary format: trained on some records, used on another
+head -c 3000 huffman.c > "$TMP/sample1"
+head -c 3000 app.c > "$TMP/sample2"
+check "train a dictionary" "$HUFF" train "$TMP/dict" "$TMP/sample1" "$TMP/sample2"
+for c in empty one record text; do
+    check "dictionary round trip of $c" sh -c \
+        "'$HUFF' compress '$TMP/$c' '$TMP/packed' --dictionary='$TMP/dict' > /dev/null &&
+         '$HUFF' decompress '$TMP/packed' '$TMP/restored' --dictionary='$TMP/dict' > /dev/null &&
+         cmp '$TMP/$c' '$TMP/restored'"
+done
+check "dictionary file needs its dictionary" sh -c \
+    "'$HUFF' compress '$TMP/record' '$TMP/packed' --dictionary='$TMP/dict' > /dev/null &&
+     ! '$HUFF' decompress '$TMP/packed' '$TMP/restored' 2> /dev/null"
+
+# Benchmark: every corpus once, with its round trips checked
+if [ -x "$BENCH" ]; then
+    check "benchmark of the synthetic corpora" "$BENCH" --size=256K --repeat=1
+    check "benchmark JSON output" sh -c "'$BENCH' --size=64K --repeat=1 --corpus=text --json | grep -q '\"corpus\"'"
+fi
+
+# Statistics go to standard error, so output on standard output stays intact
+size=$(wc -c < "$TMP/mixed")
+check "stats keep the output intact" sh -c \
+    "'$HUFF' compress '$TMP/mixed' - --stats 2> '$TMP/stats' | '$HUFF' decompress - - | cmp '$TMP/mixed' -"
+check "stats report the input size" grep -q "^  $size -> " "$TMP/stats"
+check "stats report each phase" sh -c "grep -q '^  histogram ' '$TMP/stats' && grep -q '^  encode ' '$TMP/stats'"
+check "JSON stats are one line" sh -c \
+    "'$HUFF' compress '$TMP/mixed' '$TMP/packed' --stats=json 2>&1 > /dev/null | wc -l | grep -qx 1"
+check "JSON stats name the operation and sizes" sh -c \
+    "'$HUFF' decompress '$TMP/packed' '$TMP/restored' --stats=json 2>&1 > /dev/null |
+     grep -q '^{\"op\":\"decompress\".*\"bytes_out\":$size,'"
+check "memory stats" sh -c "'$HUFF' compress '$TMP/text' '$TMP/packed' --mem-stats 2>&1 | grep -q 'allocations'"
+
+# Batch mode: a tree of files to a directory and to an archive, from a directory and from a list
+mkdir -p "$TMP/tree/sub/deeper"
+for c in empty one text record; do
+    cp "$TMP/$c" "$TMP/tree/$c"
+done
+cp "$TMP/random" "$TMP/tree/sub/random"
+cp "$TMP/mixed" "$TMP/tree/sub/deeper/mixed"
+check "batch to a directory" sh -c \
+    "'$HUFF' batch compress '$TMP/tree' '$TMP/packed.d' > /dev/null &&
+     '$HUFF' batch decompress '$TMP/packed.d' '$TMP/restored.d' > /dev/null &&
+     diff -r '$TMP/tree' '$TMP/restored.d'"
+# Small blocks make the mixed file large enough to be spread over all threads
+check "batch to an archive" sh -c \
+    "'$HUFF' batch compress '$TMP/tree' '$TMP/packed.hua' --archive --block-size=16K --threads=3 > /dev/null &&
+     '$HUFF' batch decompress '$TMP/packed.hua' '$TMP/restored.a' > /dev/null &&
+     diff -r '$TMP/tree' '$TMP/restored.a'"
+check "batch from a list on standard input" sh -c \
+    "cd '$TMP/tree' && find . -type f | '$HUFF' batch compress - '$TMP/list.hua' --archive > /dev/null &&
+     '$HUFF' batch decompress '$TMP/list.hua' '$TMP/restored.l' > /dev/null && diff -r '$TMP/tree' '$TMP/restored.l'"
+check "batch refuses names leaving the output" sh -c \
+    "cd '$TMP/tree/sub' && ! (printf '../text\nrandom\n' | '$HUFF' batch compress - '$TMP/escape.hua' --archive) &&
+     '$HUFF' batch decompress '$TMP/escape.hua' '$TMP/restored.e' > /dev/null &&
+     [ \"\$(ls '$TMP/restored.e')\" = random ] && cmp '$TMP/random' '$TMP/restored.e/random'"
+# A member cut off by the file size limit is dropped, and the members after it stay readable
+check "batch archive survives a failed member" sh -c \
+    "trap '' XFSZ; mkdir '$TMP/limit' && cp '$TMP/random' '$TMP/text' '$TMP/record' '$TMP/limit/' &&
+     (ulimit -f 400; ! '$HUFF' batch compress '$TMP/limit' '$TMP/limit.hua' --archive --threads=1) &&
+     '$HUFF' batch decompress '$TMP/limit.hua' '$TMP/restored.f' > /dev/null &&
+     cmp '$TMP/text' '$TMP/restored.f/text' && cmp '$TMP/record' '$TMP/restored.f/record'"
+
+# Overlapped I/O (io_uring where the kernel has it), the I/O threads and plain I/O
+"$HUFF" compress "$TMP/mixed" "$TMP/mixed.huff" --block-size=64K > /dev/null
+for io in "" --io-threads --sync-io; do
+    check "pipe round trip ${io:-with io_uring}" pipeRoundTrip "$TMP/mixed" --block-size=64K $io
+    check "file round trip ${io:-with io_uring}" roundTrip "$TMP/mixed" --block-size=64K $io
+    check "decompress from a pipe ${io:-with io_uring}" sh -c \
+        "cat '$TMP/mixed.huff' | '$HUFF' decompress - - $io | cmp '$TMP/mixed' -"
+    # Output after other bytes of the same file, and bytes appended after it
+    check "output at a file offset ${io:-with io_uring}" sh -c \
+        "{ printf head; cat '$TMP/mixed' | '$HUFF' compress - - $io; printf tail; } > '$TMP/framed' &&
+         [ \"\$(tail -c 4 '$TMP/framed')\" = tail ] &&
+         tail -c +5 '$TMP/framed' | head -c -4 | '$HUFF' decompress - - | cmp '$TMP/mixed' -"
+    # A read left waiting on a pipe whose writer stays open is cancelled once the data has ended
+    if command -v timeout > /dev/null; then
+        check "quiet pipe does not hold up decompression ${io:-with io_uring}" sh -c \
+            "(cat '$TMP/mixed.huff'; sleep 2) | timeout 1 '$HUFF' decompress - '$TMP/restored' $io > /dev/null &&
+             cmp '$TMP/mixed' '$TMP/restored'"
+    fi
+done
+
+# Search, against grep's byte offsets (the patterns cannot overlap themselves). Small blocks put
+# matches across block boundaries; the mixed file also has random bytes between the text
+searchMatches() {
+    file=$1
+    pattern=$2
+    shift 2
+    grep -obaF -- "$pattern" "$TMP/mixed" | cut -d: -f1 > "$TMP/expected"
+    "$HUFF" search "$file" "$pattern" "$@" > "$TMP/found"
+    [ $? -le 1 ] && cmp "$TMP/expected" "$TMP/found"
+}
+"$HUFF" compress "$TMP/mixed" "$TMP/mixed.16k" --block-size=16K --sync-interval=1K > /dev/null
+for f in 1 2 5; do
+    "$HUFF" compress "$TMP/mixed" "$TMP/mixed.f$f" --format=$f > /dev/null 2>&1
+done
+for pattern in "Function to" "{" "static int " "HUFF_ERR_CORRUPT;" "no such pattern here"; do
+    check "search for '$pattern'" searchMatches "$TMP/mixed.16k" "$pattern"
+    check "search for '$pattern' with one thread" searchMatches "$TMP/mixed.16k" "$pattern" --threads=1
+    check "search for '$pattern' in a pipe" sh -c \
+        "grep -obaF -- '$pattern' '$TMP/mixed' | cut -d: -f1 > '$TMP/expected';
+         cat '$TMP/mixed.16k' | '$HUFF' search - '$pattern' > '$TMP/found'; [ \$? -le 1 ] && cmp '$TMP/expected' '$TMP/found'"
+done
+for f in 1 2 5; do
+    [ -f "$TMP/mixed.f$f" ] && check "search format $f" searchMatches "$TMP/mixed.f$f" "static int "
+done
+check "search exit status without a match" sh -c "'$HUFF' search '$TMP/mixed.16k' 'no such pattern here'; [ \$? -eq 1 ]"
+check "search --max-count" sh -c \
+    "grep -obaF 'Function to' '$TMP/mixed' | cut -d: -f1 | head -n 5 > '$TMP/expected' &&
+     '$HUFF' search '$TMP/mixed.16k' 'Function to' --max-count=5 > '$TMP/found' && cmp '$TMP/expected' '$TMP/found'"
+check "search --lines" sh -c \
+    "grep -obaF 'Function to' '$TMP/mixed' | cut -d: -f1 > '$TMP/offsets' && grep -aF 'Function to' '$TMP/mixed' > '$TMP/lines' &&
+     paste -d: '$TMP/offsets' '$TMP/lines' > '$TMP/expected' &&
+     '$HUFF' search '$TMP/mixed.16k' 'Function to' --lines > '$TMP/found' && cmp '$TMP/expected' '$TMP/found'"
+
+# Extract, against the same bytes cut out with tail and head: empty, inside one sync interval,
+# across sync points and blocks, up to the end and past it
+size=$(wc -c < "$TMP/mixed")
+for range in "0 0" "0 10" "1000 1" "16383 2" "20000 70000" "300000 2200000" "$((size - 100)) 100" \
+             "$((size - 10)) 1000" "$size 10" "$((size + 5)) 1"; do
+    set -- $range
+    check "extract $1 $2" sh -c \
+        "tail -c +$(($1 + 1)) '$TMP/mixed' | head -c $2 > '$TMP/expected' &&
+         '$HUFF' extract '$TMP/mixed.16k' $1 $2 > '$TMP/found' && cmp '$TMP/expected' '$TMP/found'"
+    check "extract $1 $2 with the default layout" sh -c \
+        "tail -c +$(($1 + 1)) '$TMP/mixed' | head -c $2 > '$TMP/expected' &&
+         '$HUFF' extract '$TMP/mixed.huff' $1 $2 > '$TMP/found' && cmp '$TMP/expected' '$TMP/found'"
+done
+check "extract needs the block format" fails "$HUFF" extract "$TMP/mixed.f2" 0 10
+
+# Integrity: test passes good files, and damaged or cut-off input is refused, not decoded
+flipByte() {
+    b=$(od -An -tu1 -j "$2" -N1 "$1" | tr -d ' ')
+    printf "\\$(printf %o $((b ^ 255)))" | dd of="$1" bs=1 seek="$2" conv=notrunc 2> /dev/null
+}
+refused() {
+    ! "$HUFF" decompress "$1" "$TMP/restored" > /dev/null 2>&1 &&
+        ! cat "$1" | "$HUFF" decompress - - > /dev/null 2>&1 &&
+        ! "$HUFF" test "$1" > /dev/null 2>&1
+}
+check "test reports checksums" sh -c "'$HUFF' test '$TMP/mixed.16k' '$TMP/mixed.huff' | grep -c 'checksums match' | grep -qx 2"
+check "test of files without checksums" sh -c \
+    "'$HUFF' compress '$TMP/mixed' '$TMP/nosum' --no-checksum > /dev/null &&
+     '$HUFF' test '$TMP/nosum' '$TMP/mixed.f2' | grep -c 'has no checksums' | grep -qx 2"
+packed=$(wc -c < "$TMP/mixed.16k")
+# The random bytes are stored as they are, so only the checksum can tell a change there
+cp "$TMP/mixed.16k" "$TMP/damaged"
+flipByte "$TMP/damaged" $((packed / 2))
+check "changed stored byte is a checksum mismatch" sh -c \
+    "! '$HUFF' decompress '$TMP/damaged' '$TMP/restored' 2> '$TMP/err' && grep -q 'Checksum mismatch' '$TMP/err'"
+check "changed stored byte is refused" refused "$TMP/damaged"
+for at in 20 1000 $((packed / 4)); do
+    cp "$TMP/mixed.16k" "$TMP/damaged"
+    flipByte "$TMP/damaged" $at
+    check "changed byte at $at is refused" refused "$TMP/damaged"
+done
+# decompress does without a damaged block index (the data has its own checksums), test reports it
+indexDamaged() {
+    "$HUFF" decompress "$1" "$TMP/restored" > /dev/null && cmp "$TMP/mixed" "$TMP/restored" &&
+        ! "$HUFF" test "$1" > /dev/null 2>&1
+}
+for at in $((packed - 30)) $((packed - 1)); do
+    cp "$TMP/mixed.16k" "$TMP/damaged"
+    flipByte "$TMP/damaged" $at
+    check "changed index byte at $at" indexDamaged "$TMP/damaged"
+done
+head -c $((packed - 1)) "$TMP/mixed.16k" > "$TMP/cut"
+check "cut index" indexDamaged "$TMP/cut"
+# An index entry whose offset plus size wraps around 2^64 must not be followed: offset
+# 2^64 - 2^32 + 17 and size 2^32 - 16 for the last block
+cp "$TMP/mixed.16k" "$TMP/damaged"
+printf '\021\000\000\000\377\377\377\377\360\377\377\377' |
+    dd of="$TMP/damaged" bs=1 seek=$((packed - 32)) conv=notrunc 2> /dev/null
+check "index entry that wraps" indexDamaged "$TMP/damaged"
+check "index entry that wraps, two threads" sh -c \
+    "'$HUFF' decompress '$TMP/damaged' '$TMP/restored' --threads=2 > /dev/null && cmp '$TMP/mixed' '$TMP/restored'"
+check "extract refuses an index entry that wraps" sh -c "'$HUFF' extract '$TMP/damaged' 0 10 > /dev/null; [ \$? -eq 1 ]"
+check "search refuses an index entry that wraps" sh -c "'$HUFF' search '$TMP/damaged' 'Function to' > /dev/null; [ \$? -eq 2 ]"
+for f in 16k f1 f2 f5; do
+    [ -f "$TMP/mixed.$f" ] || continue
+    packed=$(wc -c < "$TMP/mixed.$f")
+    # The block file's data ends well before its index
+    [ $f = 16k ] && last=$((packed * 9 / 10)) || last=$((packed - 1))
+    for cut in 3 9 $((packed / 2)) $last; do
+        head -c $cut "$TMP/mixed.$f" > "$TMP/cut"
+        check "$f file cut to $cut bytes is refused" refused "$TMP/cut"
+    done
+done
+check "random bytes are refused" refused "$TMP/random"
+check "text is refused" refused "$TMP/text"
+
+# Server: client round trips, damaged payloads answered with an error, a short load run, and the
+# socket removed on stop
+"$HUFF" serve "$TMP/sock" --threads=2 > /dev/null 2>&1 &
+server=$!
+tries=0
+while [ ! -S "$TMP/sock" ] && [ $tries -lt 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+clientRoundTrip() {
+    "$HUFF" client "$TMP/sock" compress "$1" "$TMP/packed" &&
+        "$HUFF" client "$TMP/sock" decompress "$TMP/packed" - | cmp "$1" -
+}
+for c in $corpora; do
+    check "client round trip of $c" clientRoundTrip "$TMP/$c"
+done
+check "server refuses text to decompress" fails "$HUFF" client "$TMP/sock" decompress "$TMP/text" "$TMP/restored"
+head -c 20 "$TMP/text" > "$TMP/cut"
+check "server refuses a short header" fails "$HUFF" client "$TMP/sock" decompress "$TMP/cut" "$TMP/restored"
+check "loadgen round trips" sh -c "'$HUFF' loadgen '$TMP/sock' '$TMP/text' '$TMP/record' --requests=50 --connections=2 |
+    grep -q ' 0 round trips failed'"
+kill $server
+wait $server
+check "socket removed on stop" test ! -e "$TMP/sock"
+# serve - answers on standard input and output: an 8-byte reply header, then the compressed file
+serveStdio() {
+    printf '\001\000\000\000\005\000\000\000hello' | "$HUFF" serve - 2> /dev/null | tail -c +9 > "$TMP/packed" &&
+        [ "$("$HUFF" decompress "$TMP/packed" -)" = hello ]
+}
+check "serve on standard input and output" serveStdio
+
+# Adaptive format: round trips at the interval limits, output that keeps up with a slow producer,
+# and damaged input refused
+for c in $corpora; do
+    check "format 5 round trip of $c" roundTrip "$TMP/$c" --format=5
+    check "format 5 pipe round trip of $c" pipeRoundTrip "$TMP/$c" --format=5
+done
+for opt in --adapt-interval=256 --adapt-interval=16M --max-code-len=8 --no-checksum; do
+    check "format 5 round trip with $opt" roundTrip "$TMP/mixed" --format=5 $opt
+    check "format 5 pipe round trip with $opt" pipeRoundTrip "$TMP/mixed" --format=5 $opt
+done
+check "format 5 interval below 256 is refused" fails roundTrip "$TMP/text" --format=5 --adapt-interval=255
+# The first line must come out while the producer is still sleeping
+streamed() {
+    (printf 'first line\n'; sleep 1; printf 'second line\n') | "$HUFF" compress - - --format=5 |
+        "$HUFF" decompress - - > "$TMP/streamed" &
+    sleep 0.5
+    early=$(cat "$TMP/streamed")
+    wait
+    [ "$early" = "first line" ] && [ "$(tail -n 1 "$TMP/streamed")" = "second line" ]
+}
+check "format 5 output keeps up with the input" streamed
+packed=$(wc -c < "$TMP/mixed.f5")
+for at in 3 100 $((packed / 2)) $((packed - 2)); do
+    cp "$TMP/mixed.f5" "$TMP/damaged"
+    flipByte "$TMP/damaged" $at
+    check "format 5 changed byte at $at is refused" refused "$TMP/damaged"
+done
+check "format 5 has no random access" fails "$HUFF" extract "$TMP/mixed.f5" 0 10
+
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]
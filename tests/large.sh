@@ -0,0 +1,45 @@
+#!/bin/sh
+# Round trips of more than 4 GiB through formats 2 and 3, compared by SHA-256. Format 3 streams
+# through pipes; format 2 needs a seekable input, so its input is written to TMPDIR first
+# (about 4.7 GB of free space). Run from the repository root: make check-large
+set -eu
+
+HUFF=${HUFF:-./huffman}
+SIZE=${LARGE_SIZE:-4700000000}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# Repeating text and code with a random tail, so blocks get Huffman coded as well as stored
+cat huffman.c app.c README.md > "$TMP/seed"
+head -c 262144 /dev/urandom >> "$TMP/seed"
+generate() {
+    while cat "$TMP/seed"; do :; done | head -c "$SIZE"
+}
+
+fail=0
+mkfifo "$TMP/fifo"
+
+# Format 3: generator -> compress -> decompress, all through pipes
+sha256sum < "$TMP/fifo" | cut -d' ' -f1 > "$TMP/in.sum" &
+generate | tee "$TMP/fifo" | "$HUFF" compress - - --format=3 | "$HUFF" decompress - - |
+    sha256sum | cut -d' ' -f1 > "$TMP/out.sum"
+wait
+if cmp -s "$TMP/in.sum" "$TMP/out.sum"; then
+    echo "format 3: $SIZE bytes through pipes: ok"
+else
+    echo "format 3: $SIZE bytes through pipes: FAILED"
+    fail=1
+fi
+
+# Format 2: file -> compress -> decompress through a pipe
+generate > "$TMP/input"
+sha256sum < "$TMP/input" | cut -d' ' -f1 > "$TMP/in.sum"
+"$HUFF" compress "$TMP/input" - --format=2 | "$HUFF" decompress - - | sha256sum | cut -d' ' -f1 > "$TMP/out.sum"
+if cmp -s "$TMP/in.sum" "$TMP/out.sum"; then
+    echo "format 2: $SIZE bytes from a file: ok"
+else
+    echo "format 2: $SIZE bytes from a file: FAILED"
+    fail=1
+fi
+
+exit $fail